@@ -11,14 +11,23 @@
 #include <dune/pdelab/localoperator/pattern.hh>
 #include <dune/pdelab/localoperator/flags.hh>
 
-#include "sysparams.hh"
+#include <map>
+#include <utility>
+#include <vector>
 
+#include "context.hh"
+
+/** \brief Local operator for the (nonlinear) Poisson-Boltzmann equation
+
+    Jacobians are assembled analytically. Basis functions and their reference
+    gradients are tabulated once per local finite element at the quadrature
+    points, which pays off in particular for P2/P3 where the numerical
+    differentiation needed one residual evaluation per local dof.
+    jacobian_apply_volume() applies the Jacobian linearized at x to a
+    direction z without assembling it, see MatrixFreeJacobian.
+*/
 template<typename M, typename B, typename J>
 class PBLocalOperator : 
-  public Dune::PDELab::NumericalJacobianApplyVolume<PBLocalOperator<M, B, J> >,
-  public Dune::PDELab::NumericalJacobianVolume<PBLocalOperator<M, B, J> >,
-  public Dune::PDELab::NumericalJacobianApplyBoundary<PBLocalOperator<M, B, J> >,
-  public Dune::PDELab::NumericalJacobianBoundary<PBLocalOperator<M, B, J> >, 
   public Dune::PDELab::FullVolumePattern,
   public Dune::PDELab::LocalOperatorDefaultFlags
 {
@@ -31,9 +40,9 @@ public:
   enum { doAlphaBoundary = true };                                // assemble boundary
 
   // constructor parametrized by regions and boundary classes
-  PBLocalOperator (const M& m_, const B& b_, const J& j_, 
+  PBLocalOperator (IpbsContext& context, const M& m_, const B& b_, const J& j_, 
 		   unsigned int intorder_=2)  // needs boundary cond. type
-    : m(m_), b(b_), j(j_), intorder(intorder_)
+    : sysParams(context.sysParams), m(m_), b(b_), j(j_), intorder(intorder_)
   {}
 
   // volume integral depending on test and ansatz functions
@@ -45,86 +54,157 @@ public:
       Traits::LocalBasisType::Traits::DomainFieldType DF;
     typedef typename LFSU::Traits::FiniteElementType::
       Traits::LocalBasisType::Traits::RangeFieldType RF;
-    typedef typename LFSU::Traits::FiniteElementType::
-      Traits::LocalBasisType::Traits::JacobianType JacobianType;
-    typedef typename LFSU::Traits::FiniteElementType::
-      Traits::LocalBasisType::Traits::RangeType RangeType;
     typedef typename LFSU::Traits::SizeType size_type;
         
     // dimensions
     const int dim = EG::Geometry::dimension;
-    const int dimw = EG::Geometry::dimensionworld;
 
     // select quadrature rule
     Dune::GeometryType gt = eg.geometry().type();
     const Dune::QuadratureRule<DF,dim>& 
       rule = Dune::QuadratureRules<DF,dim>::rule(gt,intorder);
 
+    const size_type n = lfsu.size();
+    const std::vector<double>& tab = tabulate(lfsu.finiteElement(), rule);
+    std::vector<Dune::FieldVector<RF,dim> > gradphi(n);
+
     // loop over quadrature points
+    size_type q = 0;
     for (typename Dune::QuadratureRule<DF,dim>::const_iterator 
-           it=rule.begin(); it!=rule.end(); ++it)
+           it=rule.begin(); it!=rule.end(); ++it, ++q)
       {
-        // evaluate basis functions on reference element
-        std::vector<RangeType> phi(lfsu.size());
-        lfsu.finiteElement().localBasis().evaluateFunction(it->position(),phi);
+        const double* phi = &tab[q*n*(dim+1)];
+        const double* js = phi + n;
 
         // compute u at integration point
         RF u=0.0;
-        for (size_type i=0; i<lfsu.size(); i++)
+        for (size_type i=0; i<n; i++)
           u += x(lfsu,i)*phi[i];
 
-        // evaluate gradient of basis functions on reference element
-        std::vector<JacobianType> js(lfsu.size());
-        lfsu.finiteElement().localBasis().evaluateJacobian(it->position(),js);
-
         // transform gradients from reference element to real element
-        const Dune::FieldMatrix<DF,dimw,dim> 
-          jac = eg.geometry().jacobianInverseTransposed(it->position());
-        std::vector<Dune::FieldVector<RF,dim> > gradphi(lfsu.size());
-        for (size_type i=0; i<lfsu.size(); i++)
-          jac.mv(js[i][0],gradphi[i]);
+        transformGradients(eg.geometry().jacobianInverseTransposed(it->position()), js, gradphi);
         
         // compute gradient of u
         Dune::FieldVector<RF,dim> gradu(0.0);
-        for (size_type i=0; i<lfsu.size(); i++)
+        for (size_type i=0; i<n; i++)
           gradu.axpy( x(lfsu,i),gradphi[i] );
 
         // evaluate parameters; 
-        Dune::FieldVector<RF,dim> 
-        globalpos = eg.geometry().global(it->position());
-
-        RF f=0.;
-        //if (globalpos[0] < -0.0 && globalpos[0] > -.5 && globalpos[1] < .5.) f = -10.;
       	// Parameters describing the PDE
-        switch (sysParams.get_salt())
-        {
-          case 0:
-            f = -1.0 * sysParams.get_lambda2i() * sinh(u);
-            break;
-          case 1:
-            f = -1.0 * sysParams.get_lambda2i() * exp(u);
-            break;
-          case 2:
-            f = -1.0 * sysParams.get_lambda2i() * u;
-        }
-      	RF a = 0.; 
+        RF f = source(u);
 
-        // integrate grad u * grad phi_i + a*u*phi_i - f phi_i
-        RF factor = it->weight()*eg.geometry().integrationElement(it->position());
+        // integrate grad u * grad phi_i - f phi_i
+        RF factor = it->weight()*eg.geometry().integrationElement(it->position())
+                    * metric(eg.geometry().global(it->position()));
 
-        // choose correct metric for integration
-        // Integration with added term for metric
         for (size_type i=0; i<lfsv.size(); i++)
-        {
-          double thisResidual =  (gradu*gradphi[i] + a*u*phi[i] - f*phi[i] ) * factor;
-          if (sysParams.get_symmetry() > 0)
-            thisResidual *=  2.0 * sysParams.pi * globalpos[1];
-          r.accumulate(lfsv,i,thisResidual); 
-        }
-        
+          r.accumulate(lfsv,i,(gradu*gradphi[i] - f*phi[i]) * factor);
+      }
+  }
+
+  // jacobian of volume term
+  template<typename EG, typename LFSU, typename X, typename LFSV, typename Mat>
+  void jacobian_volume (const EG& eg, const LFSU& lfsu, const X& x, const LFSV& lfsv,
+                        Mat& mat) const
+  {
+    typedef typename LFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::DomainFieldType DF;
+    typedef typename LFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::RangeFieldType RF;
+    typedef typename LFSU::Traits::SizeType size_type;
+
+    const int dim = EG::Geometry::dimension;
+
+    Dune::GeometryType gt = eg.geometry().type();
+    const Dune::QuadratureRule<DF,dim>& 
+      rule = Dune::QuadratureRules<DF,dim>::rule(gt,intorder);
+
+    const size_type n = lfsu.size();
+    const std::vector<double>& tab = tabulate(lfsu.finiteElement(), rule);
+    std::vector<Dune::FieldVector<RF,dim> > gradphi(n);
+
+    size_type q = 0;
+    for (typename Dune::QuadratureRule<DF,dim>::const_iterator 
+           it=rule.begin(); it!=rule.end(); ++it, ++q)
+      {
+        const double* phi = &tab[q*n*(dim+1)];
+        const double* js = phi + n;
+
+        RF u=0.0;
+        for (size_type i=0; i<n; i++)
+          u += x(lfsu,i)*phi[i];
+
+        transformGradients(eg.geometry().jacobianInverseTransposed(it->position()), js, gradphi);
+
+        RF df = sourceDerivative(u);
+        RF factor = it->weight()*eg.geometry().integrationElement(it->position())
+                    * metric(eg.geometry().global(it->position()));
+
+        for (size_type i=0; i<lfsv.size(); i++)
+          for (size_type j=0; j<n; j++)
+            mat.accumulate(lfsv,i,lfsu,j,( gradphi[j]*gradphi[i] - df*phi[j]*phi[i] ) * factor);
+      }
+  }
+
+  //! apply the Jacobian linearized at x to the direction z
+  template<typename EG, typename LFSU, typename X, typename Z, typename LFSV, typename Y>
+  void jacobian_apply_volume (const EG& eg, const LFSU& lfsu, const X& x, const Z& z,
+                              const LFSV& lfsv, Y& y) const
+  {
+    typedef typename LFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::DomainFieldType DF;
+    typedef typename LFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::RangeFieldType RF;
+    typedef typename LFSU::Traits::SizeType size_type;
+
+    const int dim = EG::Geometry::dimension;
+
+    Dune::GeometryType gt = eg.geometry().type();
+    const Dune::QuadratureRule<DF,dim>& 
+      rule = Dune::QuadratureRules<DF,dim>::rule(gt,intorder);
+
+    const size_type n = lfsu.size();
+    const std::vector<double>& tab = tabulate(lfsu.finiteElement(), rule);
+    std::vector<Dune::FieldVector<RF,dim> > gradphi(n);
+
+    size_type q = 0;
+    for (typename Dune::QuadratureRule<DF,dim>::const_iterator 
+           it=rule.begin(); it!=rule.end(); ++it, ++q)
+      {
+        const double* phi = &tab[q*n*(dim+1)];
+        const double* js = phi + n;
+
+        RF u=0.0;
+        for (size_type i=0; i<n; i++)
+          u += x(lfsu,i)*phi[i];
+
+        RF w=0.0;
+        for (size_type i=0; i<n; i++)
+          w += z(lfsu,i)*phi[i];
+
+        transformGradients(eg.geometry().jacobianInverseTransposed(it->position()), js, gradphi);
+
+        Dune::FieldVector<RF,dim> gradw(0.0);
+        for (size_type i=0; i<n; i++)
+          gradw.axpy( z(lfsu,i),gradphi[i] );
+
+        RF df = sourceDerivative(u);
+        RF factor = it->weight()*eg.geometry().integrationElement(it->position())
+                    * metric(eg.geometry().global(it->position()));
+
+        for (size_type i=0; i<lfsv.size(); i++)
+          y.accumulate(lfsv,i,( gradw*gradphi[i] - df*w*phi[i] ) * factor);
       }
   }
 
+  //! apply the Jacobian linearized at x to x itself (interface of the linear operators)
+  template<typename EG, typename LFSU, typename X, typename LFSV, typename Y>
+  void jacobian_apply_volume (const EG& eg, const LFSU& lfsu, const X& x,
+                              const LFSV& lfsv, Y& y) const
+  {
+    jacobian_apply_volume(eg, lfsu, x, x, lfsv, y);
+  }
+
   // boundary integral
   template<typename IG, typename LFSU, typename X, typename LFSV, typename R>
   void alpha_boundary (const IG& ig, const LFSU& lfsu_s, const X& x_s, 
@@ -191,12 +271,133 @@ public:
         }
       }
   }
-  
+
+  /* The flux boundary condition is given by the IPBS iteration and does not
+     depend on the current Newton iterate, so the boundary Jacobian vanishes. */
+  template<typename IG, typename LFSU, typename X, typename LFSV, typename Mat>
+  void jacobian_boundary (const IG& ig, const LFSU& lfsu_s, const X& x_s,
+                          const LFSV& lfsv_s, Mat& mat_ss) const
+  {}
+
+  template<typename IG, typename LFSU, typename X, typename LFSV, typename Y>
+  void jacobian_apply_boundary (const IG& ig, const LFSU& lfsu_s, const X& x_s,
+                                const LFSV& lfsv_s, Y& y_s) const
+  {}
+
+  template<typename IG, typename LFSU, typename X, typename Z, typename LFSV, typename Y>
+  void jacobian_apply_boundary (const IG& ig, const LFSU& lfsu_s, const X& x_s, const Z& z_s,
+                                const LFSV& lfsv_s, Y& y_s) const
+  {}
+
 private:
+  // evaluates the members of a lock-step ensemble at once
+  template<class LOP, int K> friend class LockstepLocalOperator;
+
+  // right hand side f(u) of the PB equation  -laplace u = f(u)
+  template<typename RF>
+  RF source (RF u) const
+  {
+    switch (sysParams.get_salt())
+    {
+      case 0:
+        return -1.0 * sysParams.get_lambda2i() * sinh(u);
+      case 1:
+        return -1.0 * sysParams.get_lambda2i() * exp(u);
+      case 2:
+        return -1.0 * sysParams.get_lambda2i() * u;
+    }
+    return 0.;
+  }
+
+  // derivative df/du of the right hand side
+  template<typename RF>
+  RF sourceDerivative (RF u) const
+  {
+    switch (sysParams.get_salt())
+    {
+      case 0:
+        return -1.0 * sysParams.get_lambda2i() * cosh(u);
+      case 1:
+        return -1.0 * sysParams.get_lambda2i() * exp(u);
+      case 2:
+        return -1.0 * sysParams.get_lambda2i();
+    }
+    return 0.;
+  }
+
+  // choose correct metric for integration
+  template<typename DV>
+  typename DV::field_type metric (const DV& globalpos) const
+  {
+    if (sysParams.get_symmetry() > 0)
+      return 2.0 * sysParams.pi * globalpos[1];
+    return 1.0;
+  }
+
+  // transform gradients from reference element to real element
+  template<typename JIT, typename RF, int dim>
+  void transformGradients (const JIT& jac, const double* js,
+                           std::vector<Dune::FieldVector<RF,dim> >& gradphi) const
+  {
+    Dune::FieldVector<RF,dim> ref;
+    for (size_t i=0; i<gradphi.size(); i++)
+    {
+      for (int d=0; d<dim; d++)
+        ref[d] = js[i*dim+d];
+      jac.mv(ref,gradphi[i]);
+    }
+  }
+
+  /** \brief Tabulate basis functions and reference gradients at the quadrature points
+
+      The table is stored per local finite element (the Pk maps hand out a fixed
+      set of elements) and quadrature rule, both are kept by their owners for
+      the whole run. The layout is [phi_0..phi_n-1, grad phi_0..grad phi_n-1]
+      for each quadrature point.
+  */
+  template<typename FE, typename DF, int dim>
+  const std::vector<double>& tabulate (const FE& fe, const Dune::QuadratureRule<DF,dim>& rule) const
+  {
+    const BasisKey key(&fe, &rule);
+    typename BasisCache::iterator c = basisCache.find(key);
+    if (c != basisCache.end())
+      return c->second;
+
+    typedef typename FE::Traits::LocalBasisType::Traits::RangeType RangeType;
+    typedef typename FE::Traits::LocalBasisType::Traits::JacobianType JacobianType;
+
+    const size_t n = fe.localBasis().size();
+    std::vector<double>& tab = basisCache[key];
+    tab.resize(rule.size()*n*(dim+1));
+
+    std::vector<RangeType> phi(n);
+    std::vector<JacobianType> js(n);
+    size_t q = 0;
+    for (typename Dune::QuadratureRule<DF,dim>::const_iterator 
+           it=rule.begin(); it!=rule.end(); ++it, ++q)
+    {
+      fe.localBasis().evaluateFunction(it->position(),phi);
+      fe.localBasis().evaluateJacobian(it->position(),js);
+      double* entry = &tab[q*n*(dim+1)];
+      for (size_t i=0; i<n; i++)
+      {
+        entry[i] = phi[i];
+        for (int d=0; d<dim; d++)
+          entry[n+i*dim+d] = js[i][0][d];
+      }
+    }
+    return tab;
+  }
+
+  SysParams& sysParams;
   const M& m;
   const B& b;
   const J& j;
   unsigned int intorder;
+
+  typedef std::pair<const void*, const void*> BasisKey;	// finite element, quadrature rule
+  typedef std::map<BasisKey, std::vector<double> > BasisCache;
+  mutable BasisCache basisCache;
 };
 
 #endif  // _PBLOP_H
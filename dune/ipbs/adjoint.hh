@@ -0,0 +1,170 @@
+#ifndef _ADJOINT_HH
+#define _ADJOINT_HH
+
+/** \file
+    \brief Adjoint problem for the force acting on a particle
+
+    The force on particle p in direction d is the surface integral of the
+    Maxwell stress tensor (see IpbsAnalysis::forces)
+    \f[ F_d = \sum_F \sigma_{dj}(u_h) \nu_j, \qquad \nu = -n |F| \f]
+    ForceFunctional assembles its derivative with respect to the coefficients
+    of u_h, which is the right hand side of the adjoint (dual) problem
+    \f[ A^T z = \partial F_d / \partial u. \f]
+    The dual solution z weights the local residuals in goal oriented (DWR)
+    adaptivity.
+*/
+
+#include <vector>
+
+#include <dune/common/fvector.hh>
+#include <dune/common/fmatrix.hh>
+#include <dune/pdelab/gridfunctionspace/localfunctionspace.hh>
+#include <dune/pdelab/gridfunctionspace/constraints.hh>
+
+#include "context.hh"
+
+template <class GV, class GFS, typename PGMap>
+class ForceFunctional
+{
+  // Some typedef
+  typedef typename GV::Grid::ctype ctype;
+  static const int dim = GV::dimension;
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+
+  typedef typename GV::template Codim<0>::template Partition
+          <Dune::Interior_Partition>::Iterator LeafIterator;
+  typedef typename GV::IntersectionIterator IntersectionIterator;
+
+  typedef Dune::PDELab::LocalFunctionSpace<GFS> LFS;
+  typedef typename LFS::Traits::FiniteElementType::
+    Traits::LocalBasisType::Traits::RangeType RangeType;
+  typedef typename LFS::Traits::FiniteElementType::
+    Traits::LocalBasisType::Traits::JacobianType JacobianType;
+
+  public:
+    /*!
+       \param particle_ physical group of the particle surface
+       \param direction_ component of the force vector
+    */
+    ForceFunctional(IpbsContext& context, const GV& gv_, const GFS& gfs_, const PGMap& pgmap_,
+        const int particle_, const int direction_) :
+      sysParams(context.sysParams), gv(gv_), gfs(gfs_), pgmap(pgmap_),
+      particle(particle_), direction(direction_)
+    {}
+
+    // ------------------------------------------------------------------------
+    /// Evaluate the force component and its derivative dF/du
+    // ------------------------------------------------------------------------
+    double derivative(const U& u, U& dF) const
+    {
+      const double c = 1.0/(4.0 * sysParams.pi * sysParams.get_bjerrum());
+
+      dF = 0.0;
+      double F = 0;
+
+      LFS lfs(gfs);
+      std::vector<Real> ul, dFl;
+      std::vector<RangeType> phi;
+      std::vector<JacobianType> js;
+      std::vector<Dune::FieldVector<Real,dim> > gradphi;
+
+      for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+               	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+      {
+        if (it->hasBoundaryIntersections() == false)
+          continue;
+
+        bool bound = false;
+        for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii)
+        {
+          if (ii->boundary() == false || pgmap[ii->boundarySegmentIndex()] != particle)
+            continue;
+
+          if (!bound) {
+            lfs.bind(*it);
+            lfs.vread(u, ul);
+            dFl.assign(lfs.size(), 0.);
+            phi.resize(lfs.size());
+            js.resize(lfs.size());
+            gradphi.resize(lfs.size());
+            bound = true;
+          }
+
+          // same evaluation point as in the force computation
+          Dune::FieldVector<ctype,dim> evalPos = ii->geometry().center();
+          Dune::FieldVector<ctype,dim> local = it->geometry().local(evalPos);
+          Dune::FieldVector<ctype,dim> nu = ii->centerUnitOuterNormal();
+          nu *= -1.0 * ii->geometry().volume();
+          if (sysParams.get_symmetry() > 0)
+            nu *= 2.*sysParams.pi*evalPos[1];
+
+          lfs.finiteElement().localBasis().evaluateFunction(local,phi);
+          lfs.finiteElement().localBasis().evaluateJacobian(local,js);
+          const Dune::FieldMatrix<ctype,dim,dim>
+            jac = it->geometry().jacobianInverseTransposed(local);
+          for (size_t i=0; i<lfs.size(); i++)
+            jac.mv(js[i][0],gradphi[i]);
+
+          Real value = 0;
+          Dune::FieldVector<Real,dim> g(0.);
+          for (size_t i=0; i<lfs.size(); i++) {
+            value += ul[i]*phi[i];
+            g.axpy(ul[i],gradphi[i]);
+          }
+
+          // osmotic pressure and its derivative, linearized for salt = 2 as in maxwelltensor()
+          const bool linear = sysParams.get_salt() == 2;
+          const double osmotic = sysParams.get_lambda2i()
+            * (linear ? .5 * value * value : std::cosh(value) - 1.0);
+          const double dosmotic = sysParams.get_lambda2i() * (linear ? value : std::sinh(value));
+          F += c * ( g[direction] * (g*nu) - nu[direction] * (osmotic + .5 * g.two_norm2()) );
+
+          // derivative of sigma_dj nu_j with respect to the coefficient of phi_i
+          for (size_t i=0; i<lfs.size(); i++)
+            dFl[i] += c * ( gradphi[i][direction] * (g*nu) + g[direction] * (gradphi[i]*nu)
+                - nu[direction] * ( dosmotic * phi[i] + g*gradphi[i] ) );
+        }
+        if (bound)
+          lfs.vadd(dFl, dF);
+      }
+      return gv.comm().sum(F);
+    }
+
+  private:
+    SysParams& sysParams;
+    const GV& gv;
+    const GFS& gfs;
+    const PGMap& pgmap;
+    const int particle;
+    const int direction;
+};
+
+
+// ------------------------------------------------------------------------
+/// Solve the adjoint problem A^T z = dF/du linearized at u
+// ------------------------------------------------------------------------
+/*!
+   The PB Jacobian is symmetric (the iterated boundary flux does not depend on
+   the Newton iterate), so the assembled Jacobian is used directly.
+
+   \return the value of the force functional
+*/
+template<class GO, class LS, class CC, class Functional, class U>
+double solve_adjoint(const GO& go, LS& ls, const CC& cc, const Functional& functional,
+    const U& u, U& z)
+{
+  U dF(u);
+  double F = functional.derivative(u, dF);
+  Dune::PDELab::set_constrained_dofs(cc, 0.0, dF);
+
+  typedef typename GO::Traits::Jacobian M;
+  M A(go);
+  A = 0.0;
+  go.jacobian(u, A);
+
+  z = 0.0;
+  ls.apply(A, z, dF, 1e-8);
+  return F;
+}
+
+#endif  // _ADJOINT_HH
@@ -5,7 +5,7 @@
 
 #include "p0layout.hh"
 #include "ipbsolver.hh"
-#include "boundary.hh"
+#include "context.hh"
 
 
 /** \brief Set Dirichlet B.C.
@@ -25,7 +25,8 @@ public :
   typedef typename GV::ctype ctype;
 
   //! construct from grid view
-  BCExtension(const GV& gv_, const PGMap& pg_) : gv(gv_), pg(pg_) {}
+  BCExtension(IpbsContext& context, const GV& gv_, const PGMap& pg_) :
+    boundary(context.boundary), gv(gv_), pg(pg_) {}
 
   const inline bool global_on_intersection(Dune::FieldVector<ctype, GV::dimensionworld> 
           integrationPointGlobal, IntersectionIterator& ii ) const 
@@ -89,6 +90,7 @@ public :
 
 private :
 
+  std::vector<Boundary*>& boundary;
   const GV& gv;
   const PGMap& pg;
 };
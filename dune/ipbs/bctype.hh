@@ -6,7 +6,7 @@
 #include<dune/pdelab/common/function.hh>
 #include<dune/pdelab/constraints/constraintsparameters.hh>
 
-#include "boundary.hh"
+#include "context.hh"
 
 
 //! \brief Parameter class selecting boundary conditions
@@ -34,9 +34,10 @@ public:
   }
  
   //! constructor for obtaining BoundaryIndexToEntity
-  BCTypeParam (const PGMap& pg_) : pg(pg_) {}
+  BCTypeParam (IpbsContext& context, const PGMap& pg_) : boundary(context.boundary), pg(pg_) {}
 
 private:
+  std::vector<Boundary*>& boundary;
   const PGMap& pg;
 
 };
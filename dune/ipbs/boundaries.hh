@@ -12,7 +12,7 @@
 
 #include "p0layout.hh"
 #include "ipbsolver.hh"
-#include "boundary.hh"
+#include "context.hh"
 
 // BC Type
 #include "bctype.hh"
@@ -38,7 +38,7 @@ public:
       Dune::FieldVector<RF,1> >, Regions<GV,RF,PGMap> > BaseT;
 
   // constructor
-  Regions(const GV& gv_, const PGMap& pg_) : gv(gv_), mapper(gv), pg(pg_) {}
+  Regions(const GV& gv_, const PGMap& pg_) : gv(gv_), pg(pg_) {}
 
   // evaluate the inner elements
   inline void evaluate (const typename Traits::ElementType& e,
@@ -48,7 +48,7 @@ public:
     // retrieve element index and corresponding material index on level 0
     typename GV::template Codim<0>::EntityPointer ep(e);
     while (ep->level() != 0) ep = ep->father();
-    const int ei              = mapper.map(e);
+    const int ei              = gv.grid().levelIndexSet(0).index(*ep);
     const int physgroup_index = pg[ei];
 
     // evaluate physical group map and set values accordingly
@@ -64,7 +64,6 @@ public:
 private:
 
   const GV& gv;
-  const Dune::MultipleCodimMultipleGeomTypeMapper<GV,P0Layout> mapper;
   const PGMap& pg;
 };
 
@@ -85,8 +84,10 @@ public:
   typedef typename Traits::GridViewType::Grid::ctype ctype;
 
   //! constructor
-  BoundaryFlux(const GV& gv_, const PGMap& pg_, const Ipbssolver& ipbsolver_)
-    : gv(gv_), pg(pg_), ipbsolver(ipbsolver_) {}
+  BoundaryFlux(IpbsContext& context, const GV& gv_, const PGMap& pg_,
+      const Ipbssolver& ipbsolver_)
+    : sysParams(context.sysParams), boundary(context.boundary),
+      gv(gv_), pg(pg_), ipbsolver(ipbsolver_) {}
 
   //! evaluate flux boundary condition
   template<typename I>
@@ -112,6 +113,8 @@ public:
 
 private:
 
+  SysParams& sysParams;
+  std::vector<Boundary*>& boundary;
   const GV&    gv;
   const PGMap& pg;
   const Ipbssolver& ipbsolver;
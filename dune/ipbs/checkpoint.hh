@@ -0,0 +1,233 @@
+#ifndef _CHECKPOINT_HH
+#define _CHECKPOINT_HH
+
+/** \file
+    \brief Binary checkpoints of the IPBS iteration
+
+    Each process writes its part of the coefficient vector together with the
+    iterated boundary state (see IpbsState) to name_pRANK.chk. A checkpoint can
+    only be read by a run on the same mesh with the same number of processes
+    and polynomial degree, which is checked against the header.
+
+    Checkpoints are requested by an iteration interval, a wall clock budget
+    or the signals SIGUSR1 and SIGTERM.
+*/
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/timer.hh>
+
+/// Set by the signal handler, polled once per outer iteration
+inline volatile std::sig_atomic_t& checkpoint_signal()
+{
+  static volatile std::sig_atomic_t flag = 0;
+  return flag;
+}
+
+extern "C" inline void checkpoint_signal_handler(int)
+{
+  checkpoint_signal() = 1;
+}
+
+/// Request a checkpoint and a clean stop on SIGUSR1 and SIGTERM
+inline void install_checkpoint_handlers()
+{
+  checkpoint_signal();
+  std::signal(SIGUSR1, checkpoint_signal_handler);
+  std::signal(SIGTERM, checkpoint_signal_handler);
+}
+
+/// Wall clock time since the first call
+inline double checkpoint_walltime()
+{
+  static Dune::Timer timer;
+  return timer.elapsed();
+}
+
+inline std::string checkpoint_filename(const std::string& name, int rank)
+{
+  std::ostringstream filename;
+  filename << name << "_p" << rank << ".chk";
+  return filename.str();
+}
+
+namespace CheckpointIO
+{
+  const char magic[8] = {'I','P','B','S','C','H','K','2'};
+
+  struct Header
+  {
+    char magic[8];
+    int nproc;
+    int degree;
+    int dim;
+    int iterations;
+    int continuationPoint;
+    int pointStart;
+    unsigned long ndofs;
+    unsigned long nipbs;
+    unsigned long ngroups;
+  };
+
+  template<typename T>
+  void write(std::ofstream& out, const std::vector<T>& v)
+  {
+    if (!v.empty())
+      out.write(reinterpret_cast<const char*>(&v[0]), v.size()*sizeof(T));
+  }
+
+  template<typename T>
+  void read(std::ifstream& in, std::vector<T>& v, size_t n)
+  {
+    v.resize(n);
+    if (n > 0)
+      in.read(reinterpret_cast<char*>(&v[0]), n*sizeof(T));
+  }
+
+  inline bool tryReadHeader(std::ifstream& in, Header& header)
+  {
+    in.read(reinterpret_cast<char*>(&header), sizeof(Header));
+    return in && std::string(header.magic, 8) == std::string(magic, 8);
+  }
+
+  inline Header readHeader(std::ifstream& in, const std::string& filename)
+  {
+    Header header;
+    if (!tryReadHeader(in, header))
+      DUNE_THROW(Dune::IOError, "Could not read checkpoint " << filename);
+    return header;
+  }
+}
+
+// ------------------------------------------------------------------------
+/// Polynomial degree a checkpoint was written with
+// ------------------------------------------------------------------------
+inline int checkpoint_degree(const std::string& name, int rank)
+{
+  const std::string filename = checkpoint_filename(name, rank);
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  if (!in)
+    DUNE_THROW(Dune::IOError, "Could not open checkpoint " << filename);
+  return CheckpointIO::readHeader(in, filename).degree;
+}
+
+// ------------------------------------------------------------------------
+/// Write the solution and the iterated boundary state of this process
+// ------------------------------------------------------------------------
+/*!
+   The file is written under a temporary name and moved afterwards, so an
+   interrupted write never destroys the previous checkpoint.
+*/
+template<class U, class State>
+void write_checkpoint(const std::string& name, int rank, int nproc, int degree,
+    const U& u, const State& state)
+{
+  typedef typename State::Position Position;
+
+  std::vector<double> coefficients;
+  for (size_t i = 0; i < u.base().N(); i++)
+    for (size_t j = 0; j < u.base()[i].size(); j++)
+      coefficients.push_back(u.base()[i][j]);
+  std::vector<double> positions;
+  for (size_t i = 0; i < state.size(); i++)
+    for (int d = 0; d < Position::dimension; d++)
+      positions.push_back(state.positions[i][d]);
+
+  CheckpointIO::Header header;
+  std::copy(CheckpointIO::magic, CheckpointIO::magic+8, header.magic);
+  header.nproc = nproc;
+  header.degree = degree;
+  header.dim = Position::dimension;
+  header.iterations = state.iterationCounter;
+  header.continuationPoint = state.continuationPoint;
+  header.pointStart = state.pointStart;
+  header.ndofs = coefficients.size();
+  header.nipbs = state.size();
+  header.ngroups = state.efieldShift.size();
+
+  const std::string filename = checkpoint_filename(name, rank);
+  const std::string tmpname = filename + ".tmp";
+  std::ofstream out(tmpname.c_str(), std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  CheckpointIO::write(out, coefficients);
+  CheckpointIO::write(out, positions);
+  CheckpointIO::write(out, state.types);
+  CheckpointIO::write(out, state.bContainer);
+  CheckpointIO::write(out, state.inducedChargeDensity);
+  CheckpointIO::write(out, state.regulatedChargeDensity);
+  CheckpointIO::write(out, state.efieldShift);
+  out.close();
+  if (!out || std::rename(tmpname.c_str(), filename.c_str()) != 0)
+    DUNE_THROW(Dune::IOError, "Could not write checkpoint " << filename);
+}
+
+// ------------------------------------------------------------------------
+/// Read the solution and the iterated boundary state of this process
+// ------------------------------------------------------------------------
+/*!
+   Collective, the files of all processes have to be of the same iteration.
+   Every process renames its own file in write_checkpoint(), so a job killed
+   in between leaves files of different iterations behind.
+*/
+template<class U, class State, class Communication>
+void read_checkpoint(const std::string& name, const Communication& comm, int degree,
+    U& u, State& state)
+{
+  typedef typename State::Position Position;
+
+  const std::string filename = checkpoint_filename(name, comm.rank());
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  CheckpointIO::Header header;
+  const bool readable = CheckpointIO::tryReadHeader(in, header);
+  int iterations = readable ? header.iterations : -1;
+  const int first = comm.min(iterations);
+  const int last = comm.max(iterations);
+  if (!readable)
+    DUNE_THROW(Dune::IOError, "Could not read checkpoint " << filename);
+  if (first < 0)
+    DUNE_THROW(Dune::IOError, "Checkpoint " << name << " could not be read by all processes");
+  if (first != last)
+    DUNE_THROW(Dune::IOError, "Checkpoint " << name << " is a mix of the iterations " << first
+        << " to " << last << " (" << filename << " has " << iterations << ")");
+
+  size_t ndofs = 0;
+  for (size_t i = 0; i < u.base().N(); i++)
+    ndofs += u.base()[i].size();
+  if (header.nproc != comm.size() || header.degree != degree || header.dim != Position::dimension
+      || header.ndofs != ndofs)
+    DUNE_THROW(Dune::IOError, "Checkpoint " << filename << " was written by a different setup ("
+        << header.nproc << " processes, P" << header.degree << ", " << header.ndofs << " unknowns)");
+
+  std::vector<double> coefficients, positions;
+  CheckpointIO::read(in, coefficients, header.ndofs);
+  CheckpointIO::read(in, positions, header.nipbs*header.dim);
+  CheckpointIO::read(in, state.types, header.nipbs);
+  CheckpointIO::read(in, state.bContainer, header.nipbs);
+  CheckpointIO::read(in, state.inducedChargeDensity, header.nipbs);
+  CheckpointIO::read(in, state.regulatedChargeDensity, header.nipbs);
+  CheckpointIO::read(in, state.efieldShift, header.ngroups);
+  if (!in)
+    DUNE_THROW(Dune::IOError, "Checkpoint " << filename << " is truncated");
+
+  size_t n = 0;
+  for (size_t i = 0; i < u.base().N(); i++)
+    for (size_t j = 0; j < u.base()[i].size(); j++)
+      u.base()[i][j] = coefficients[n++];
+  state.positions.resize(header.nipbs);
+  for (size_t i = 0; i < header.nipbs; i++)
+    for (int d = 0; d < Position::dimension; d++)
+      state.positions[i][d] = positions[i*header.dim+d];
+  state.iterationCounter = header.iterations;
+  state.continuationPoint = header.continuationPoint;
+  state.pointStart = header.pointStart;
+  state.invalidate();
+}
+
+#endif  // _CHECKPOINT_HH
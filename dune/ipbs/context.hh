@@ -0,0 +1,51 @@
+#ifndef _CONTEXT_HH
+#define _CONTEXT_HH
+
+/** \file
+    \brief Parameters of one IPBS problem
+
+    An IpbsContext holds the system parameters and the particles (boundaries)
+    of one problem. All classes that need them are constructed with a context
+    and keep references to its members under the names sysParams and
+    boundary, so several problems can be set up and solved in one process.
+*/
+
+#include <vector>
+
+#include "sysparams.hh"
+#include "boundary.hh"
+
+class IpbsContext
+{
+  public:
+    IpbsContext() {}
+
+    /// Copy with its own particles, e.g. for a problem with perturbed parameters
+    IpbsContext(const IpbsContext& other) : sysParams(other.sysParams)
+    {
+      for (size_t i = 0; i < other.boundary.size(); i++)
+        boundary.push_back(new Boundary(*other.boundary[i]));
+    }
+
+    ~IpbsContext()
+    {
+      for (size_t i = 0; i < boundary.size(); i++)
+        delete boundary[i];
+    }
+
+    /// Add a particle with default properties and return it
+    Boundary* add_boundary()
+    {
+      boundary.push_back(new Boundary());
+      return boundary.back();
+    }
+
+    SysParams sysParams;
+    std::vector<Boundary*> boundary;
+
+  private:
+    // the boundaries are owned by the context
+    IpbsContext& operator=(const IpbsContext&);
+};
+
+#endif  // _CONTEXT_HH
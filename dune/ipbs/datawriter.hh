@@ -15,10 +15,7 @@
 #include <dune/common/fvector.hh>
 #include <dune/grid/common/grid.hh>
 
-#include "sysparams.hh"
-#include "boundary.hh"
-extern SysParams sysParams;
-extern std::vector<Boundary*> boundary;
+#include "context.hh"
 
 /** \brief Writer for grid data in gnuplot format
     \tparam GridType the grid
@@ -34,7 +31,8 @@ class DataWriter {
 
   public:
 
-    DataWriter (const GridView & _gv) : gv(_gv), 
+    DataWriter (IpbsContext& context, const GridView & _gv) :
+      sysParams(context.sysParams), boundary(context.boundary), gv(_gv), 
       communicator(gv.comm()) {}
     
     /** \brief Add cell data
@@ -116,6 +114,8 @@ class DataWriter {
       }
   
   private:
+    SysParams& sysParams;
+    std::vector<Boundary*>& boundary;
     const GridView &gv;
     
     /// The communicator decides weither to use MPI or fake
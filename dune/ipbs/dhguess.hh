@@ -0,0 +1,160 @@
+#ifndef _DHGUESS_HH
+#define _DHGUESS_HH
+
+/** \file
+    \brief Debye-Hueckel initial guess for the potential and the boundary fluxes
+
+    Each iterated physical group is replaced by a sphere (a cylinder for
+    2D cartesian grids) of the same area centered at its area weighted
+    center. The screened potential of such a particle carrying the flux
+    j = 4 pi l_B sigma is
+    \f[ u(r) = -j \frac{R^2 e^{-\kappa (r-R)}}{(1+\kappa R) r} \quad \mbox{resp.} \quad
+        u(r) = -j \frac{K_0(\kappa r)}{\kappa K_1(\kappa R)}, \f]
+    normalized such that du/dr = j at r = R (without salt the unscreened
+    limits). The contributions of all particles are superposed. For the full
+    nonlinear PB equation the sum U is saturated as
+    u = 2 asinh(U/2), which maps the Debye-Hueckel onto the Gouy-Chapman surface
+    potential of a planar surface.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <dune/common/fvector.hh>
+#include <dune/pdelab/common/function.hh>
+#include <gsl/gsl_sf_bessel.h>
+
+#include "context.hh"
+
+template<typename GV, typename RF>
+class DebyeHueckelGuess
+  : public Dune::PDELab::GridFunctionBase<Dune::PDELab::
+           GridFunctionTraits<GV,RF,1,Dune::FieldVector<RF,1> >,
+           DebyeHueckelGuess<GV,RF> >
+{
+public :
+
+  typedef Dune::PDELab::GridFunctionTraits<GV,RF,1,Dune::FieldVector<RF,1> > Traits;
+  typedef typename GV::ctype ctype;
+  static const int dim = GV::dimension;
+  typedef Dune::FieldVector<ctype,dim> Position;
+
+  //! construct from the iterated boundaries known to the Ipbsolver
+  template<class Ipbs>
+  DebyeHueckelGuess(IpbsContext& context, const GV& gv_, const Ipbs& ipbs) :
+    sysParams(context.sysParams), boundary(context.boundary), gv(gv_)
+  {
+    ipbs.groupGeometry(centers, areas);
+    kappa = std::sqrt(sysParams.get_lambda2i());
+    cylinder = (dim == 2 && sysParams.get_symmetry() == 0);
+    radii.assign(areas.size(), 0.);
+    fluxes.assign(areas.size(), 0.);
+    for (size_t p = 0; p < areas.size(); p++) {
+      if (areas[p] <= 0)
+        continue;
+      radii[p] = cylinder ? areas[p] / (2.*sysParams.pi) : std::sqrt(areas[p] / (4.*sysParams.pi));
+      fluxes[p] = 4. * sysParams.pi * sysParams.get_bjerrum() * boundary[p]->get_charge_density();
+    }
+  }
+
+  //! evaluate the potential on element
+  inline void evaluate (const typename Traits::ElementType& e,
+                        const typename Traits::DomainType& xlocal,
+                        typename Traits::RangeType& y) const
+  {
+    Position x = e.geometry().global(xlocal);
+    double U = 0;
+    for (size_t p = 0; p < areas.size(); p++)
+      if (areas[p] > 0)
+        U += potential(p, x);
+    y = saturate(U);
+  }
+
+  //! boundary flux -grad u * n at a point on the surface of physical group type
+  double flux(const Position& x, const Position& normal, int type) const
+  {
+    double U = 0;
+    Position grad(0.);
+    for (size_t p = 0; p < areas.size(); p++) {
+      if (areas[p] <= 0)
+        continue;
+      U += potential(p, x);
+      if ((int) p != type)
+        grad.axpy(derivative(p, x), direction(p, x));
+    }
+    // the particle itself contributes its charge, independent of the shape
+    return fluxes[type] - saturateDerivative(U) * (grad * normal);
+  }
+
+  //! get a reference to the grid view
+  inline const GV& getGridView() { return gv; }
+
+private :
+
+  double distance(size_t p, const Position& x) const
+  {
+    Position d = x;
+    d -= centers[p];
+    // points on the surface may lie slightly inside the replacing sphere
+    return std::max((double) d.two_norm(), radii[p]);
+  }
+
+  Position direction(size_t p, const Position& x) const
+  {
+    Position d = x;
+    d -= centers[p];
+    if (d.two_norm() > 0)
+      d /= d.two_norm();
+    return d;
+  }
+
+  double potential(size_t p, const Position& x) const
+  {
+    const double r = distance(p, x);
+    const double R = radii[p];
+    if (cylinder && kappa > 0)
+      return -fluxes[p] * gsl_sf_bessel_K0(kappa*r) / (kappa * gsl_sf_bessel_K1(kappa*R));
+    if (cylinder)
+      return fluxes[p] * R * std::log(r/R);
+    return -fluxes[p] * R*R * std::exp(-kappa*(r-R)) / ((1.+kappa*R) * r);
+  }
+
+  // du/dr of the potential of particle p
+  double derivative(size_t p, const Position& x) const
+  {
+    const double r = distance(p, x);
+    const double R = radii[p];
+    if (cylinder && kappa > 0)
+      return fluxes[p] * gsl_sf_bessel_K1(kappa*r) / gsl_sf_bessel_K1(kappa*R);
+    if (cylinder)
+      return fluxes[p] * R / r;
+    return fluxes[p] * R*R * std::exp(-kappa*(r-R)) * (1.+kappa*r) / ((1.+kappa*R) * r*r);
+  }
+
+  double saturate(double U) const
+  {
+    if (sysParams.get_salt() == 0)
+      return 2. * asinh(.5*U);
+    return U;
+  }
+
+  double saturateDerivative(double U) const
+  {
+    if (sysParams.get_salt() == 0)
+      return 1. / std::sqrt(1. + .25*U*U);
+    return 1.;
+  }
+
+  SysParams& sysParams;
+  std::vector<Boundary*>& boundary;
+  const GV& gv;
+  std::vector<Position> centers;
+  std::vector<double> areas;
+  std::vector<double> radii;
+  std::vector<double> fluxes;
+  double kappa;
+  bool cylinder;
+};
+
+#endif // _DHGUESS_HH
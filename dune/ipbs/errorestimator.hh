@@ -0,0 +1,365 @@
+#ifndef _ERRORESTIMATOR_HH
+#define _ERRORESTIMATOR_HH
+
+/** \file
+    \brief A posteriori residual error estimator for the PB equation and grid marking
+
+    The local indicator of element K is
+    \f[ \eta_K^2 = h_K^2 \| f(u_h) + \Delta u_h \|_K^2
+          + \frac{1}{2} \sum_{F \subset K \cap \Omega} h_F \| [\nabla u_h \cdot n] \|_F^2
+          + \sum_{F \subset K \cap \Gamma_N} h_F \| \nabla u_h \cdot n + j \|_F^2 \f]
+    where the norms carry the metric of the (axially symmetric) integration.
+    The second derivatives of u_h are neglected, which is exact for P1.
+    Faces between processes are evaluated from both sides like the others,
+    with the values of the ghost elements taken from their owners.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <dune/common/fvector.hh>
+#include <dune/geometry/quadraturerules.hh>
+#include <dune/grid/common/scsgmapper.hh>
+#include <dune/pdelab/common/geometrywrapper.hh>
+#include <dune/pdelab/gridfunctionspace/genericdatahandle.hh>
+#include <dune/pdelab/gridfunctionspace/gridfunctionspaceutilities.hh>
+
+#include "context.hh"
+#include "physicalgroups.hh"
+#include "reduction.hh"
+
+template <class GV, class GFS, class B, class J>
+class ResidualErrorEstimator
+{
+  // Some typedef
+  typedef typename GV::Grid::ctype ctype;
+  static const int dim = GV::dimension;
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+
+  typedef typename GV::template Codim<0>::template Partition
+          <Dune::Interior_Partition>::Iterator LeafIterator;
+  typedef typename GV::IntersectionIterator IntersectionIterator;
+  typedef typename GV::Intersection Intersection;
+
+  public:
+    /// Indicators are indexed with this mapper
+    typedef Dune::SingleCodimSingleGeomTypeMapper<GV, 0> ElementMapper;
+
+    /*!
+       \param b boundary condition type, used to skip Dirichlet boundaries
+       \param j flux boundary condition on Neumann and IPBS boundaries
+       \param intorder_ order of the quadrature rules used for the norms
+    */
+    ResidualErrorEstimator(IpbsContext& context, const GV& gv_, const GFS& gfs_,
+        const B& b_, const J& j_, const int intorder_=2) :
+      sysParams(context.sysParams), gv(gv_), gfs(gfs_), b(b_), j(j_), mapper(gv),
+      intorder(intorder_)
+    {}
+
+    const ElementMapper& elementMapper() const
+    {
+      return mapper;
+    }
+
+    // ------------------------------------------------------------------------
+    /// Compute the squared local error indicators, returns the global estimate
+    // ------------------------------------------------------------------------
+    double estimate(const U& u, std::vector<double>& eta) const
+    {
+      typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+      typedef typename DGF::Traits::RangeType RT;
+      typedef Dune::PDELab::DiscreteGridFunctionGradient<GFS,U> DGFG;
+      U ughost(u);
+      ghostValues(ughost);
+      DGF udgf(gfs,ughost);
+      DGFG grads(gfs,ughost);
+
+      eta.assign(mapper.size(), 0.);
+
+      for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+               	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+      {
+        const int index = mapper.map(*it);
+        const double hK = diameter(it->geometry());
+
+        // element residual
+        Dune::GeometryType gt = it->geometry().type();
+        const Dune::QuadratureRule<ctype,dim>&
+          rule = Dune::QuadratureRules<ctype,dim>::rule(gt,intorder);
+        double elementResidual = 0;
+        for (typename Dune::QuadratureRule<ctype,dim>::const_iterator
+                   q_it=rule.begin(); q_it!=rule.end(); ++q_it)
+        {
+          Dune::FieldVector<ctype,dim> global = it->geometry().global(q_it->position());
+          RT value;
+          udgf.evaluate(*it, q_it->position(), value);
+          Dune::FieldVector<Real,dim> gradu;
+          grads.evaluate(*it, q_it->position(), gradu);
+
+          double residual = source(value);
+          // additional term of the laplacian in cylindrical coordinates
+          if (sysParams.get_symmetry() > 0 && global[1] > 1e-12)
+            residual += gradu[1] / global[1];
+          elementResidual += residual * residual * q_it->weight()
+            * it->geometry().integrationElement(q_it->position()) * metric(global);
+        }
+        eta[index] += hK * hK * elementResidual;
+
+        // face residuals
+        for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii)
+        {
+          const double hF = diameter(ii->geometry());
+          Dune::GeometryType gtface = ii->geometryInInside().type();
+          const Dune::QuadratureRule<ctype,dim-1>&
+            facerule = Dune::QuadratureRules<ctype,dim-1>::rule(gtface,intorder);
+
+          if (ii->neighbor())
+          {
+            // each interior face is visited from both sides, also across processes
+            eta[index] += .5 * hF * jump(grads, *it, *ii, facerule);
+          }
+          else if (ii->boundary())
+          {
+            Dune::PDELab::IntersectionGeometry<Intersection> ig(*ii, 0);
+            double residual = 0;
+            for (typename Dune::QuadratureRule<ctype,dim-1>::const_iterator
+                       q_it=facerule.begin(); q_it!=facerule.end(); ++q_it)
+            {
+              if ( b.isDirichlet( ig, q_it->position() ) )
+                continue;
+              Dune::FieldVector<ctype,dim> global = ii->geometry().global(q_it->position());
+              Dune::FieldVector<ctype,dim> n = ii->unitOuterNormal(q_it->position());
+              Dune::FieldVector<Real,dim> gradu;
+              grads.evaluate(*it, ii->geometryInInside().global(q_it->position()), gradu);
+              typename J::Traits::RangeType y;
+              j.evaluate(ig, y);
+              // natural boundary condition of the weak form is grad u * n = -j
+              double flux = gradu * n + y;
+              residual += flux * flux * q_it->weight()
+                * ii->geometry().integrationElement(q_it->position()) * metric(global);
+            }
+            eta[index] += hF * residual;
+          }
+        }
+      }
+
+      double total = 0;
+      for (size_t i = 0; i < eta.size(); i++)
+        total += eta[i];
+      gv.comm().sum(&total, 1);
+      return std::sqrt(total);
+    }
+
+    // ------------------------------------------------------------------------
+    /// Squared weights of the local residuals for the error in a functional
+    // ------------------------------------------------------------------------
+    /*!
+       The interpolation error of the dual solution z is approximated by the
+       jumps of its normal derivative,
+       \f[ \omega_K^2 = \frac{1}{2} \sum_{F \subset K \cap \Omega} h_F \| [\nabla z \cdot n] \|_F^2, \f]
+       so that eta_K^2 omega_K^2 is the squared dual weighted residual indicator.
+    */
+    void dualWeights(const U& z, std::vector<double>& omega) const
+    {
+      typedef Dune::PDELab::DiscreteGridFunctionGradient<GFS,U> DGFG;
+      U zghost(z);
+      ghostValues(zghost);
+      DGFG grads(gfs,zghost);
+
+      omega.assign(mapper.size(), 0.);
+
+      for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+               	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+      {
+        const int index = mapper.map(*it);
+        for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii)
+        {
+          if (!ii->neighbor())
+            continue;
+          Dune::GeometryType gtface = ii->geometryInInside().type();
+          const Dune::QuadratureRule<ctype,dim-1>&
+            facerule = Dune::QuadratureRules<ctype,dim-1>::rule(gtface,intorder);
+          omega[index] += .5 * diameter(ii->geometry()) * jump(grads, *it, *ii, facerule);
+        }
+      }
+    }
+
+  private:
+    // the nonoverlapping solvers constrain the ghost dofs to zero, they get
+    // the values of their owners to evaluate the ghost side of a face
+    void ghostValues(U& u) const
+    {
+      if (gv.comm().size() == 1)
+        return;
+      Dune::PDELab::CopyDataHandle<GFS,U> handle(gfs,u);
+      gv.communicate(handle, Dune::InteriorBorder_All_Interface, Dune::ForwardCommunication);
+    }
+
+    // squared jump of the normal derivative across an interior face
+    template<class DGFG, class Entity>
+    double jump(const DGFG& grads, const Entity& e, const Intersection& is,
+        const Dune::QuadratureRule<ctype,dim-1>& facerule) const
+    {
+      typename GV::template Codim<0>::EntityPointer outside = is.outside();
+      double jump = 0;
+      for (typename Dune::QuadratureRule<ctype,dim-1>::const_iterator
+                 q_it=facerule.begin(); q_it!=facerule.end(); ++q_it)
+      {
+        Dune::FieldVector<ctype,dim> global = is.geometry().global(q_it->position());
+        Dune::FieldVector<ctype,dim> n = is.unitOuterNormal(q_it->position());
+        Dune::FieldVector<Real,dim> grad_s, grad_n;
+        grads.evaluate(e, is.geometryInInside().global(q_it->position()), grad_s);
+        grads.evaluate(*outside, is.geometryInOutside().global(q_it->position()), grad_n);
+        double flux = (grad_s - grad_n) * n;
+        jump += flux * flux * q_it->weight()
+          * is.geometry().integrationElement(q_it->position()) * metric(global);
+      }
+      return jump;
+    }
+
+    // right hand side f(u) of the PB equation  -laplace u = f(u)
+    double source(double u) const
+    {
+      switch (sysParams.get_salt())
+      {
+        case 0:
+          return -1.0 * sysParams.get_lambda2i() * sinh(u);
+        case 1:
+          return -1.0 * sysParams.get_lambda2i() * exp(u);
+        case 2:
+          return -1.0 * sysParams.get_lambda2i() * u;
+      }
+      return 0.;
+    }
+
+    double metric(const Dune::FieldVector<ctype,dim>& global) const
+    {
+      if (sysParams.get_symmetry() > 0)
+        return 2.0 * sysParams.pi * global[1];
+      return 1.0;
+    }
+
+    /// Longest edge of a simplex (or the length of a line segment)
+    template<class Geometry>
+    double diameter(const Geometry& geo) const
+    {
+      double h = 0;
+      for (int c0 = 0; c0 < geo.corners(); c0++)
+        for (int c1 = c0+1; c1 < geo.corners(); c1++)
+          h = std::max(h, (geo.corner(c0) - geo.corner(c1)).two_norm());
+      return h;
+    }
+
+    SysParams& sysParams;
+    const GV& gv;
+    const GFS& gfs;
+    const B& b;
+    const J& j;
+    ElementMapper mapper;
+    const int intorder;
+};
+
+
+// ------------------------------------------------------------------------
+/// Mark the elements with the largest indicators for refinement
+// ------------------------------------------------------------------------
+/*!
+   The thresholds are chosen such that the given fractions of all elements
+   (summed over all processes) are refined and coarsened, respectively. Each
+   process sorts its indicators and sends only its largest and smallest ones,
+   as many as are marked in total, to rank 0, which selects the thresholds.
+
+   \param eta squared local indicators as computed by ResidualErrorEstimator
+   \return the number of elements marked for refinement on all processes
+*/
+template<class Grid, class GV, class Mapper>
+int mark_grid_fraction(Grid& grid, const GV& gv, const Mapper& mapper,
+    const std::vector<double>& eta, double refineFraction, double coarsenFraction=0.)
+{
+  typedef typename GV::template Codim<0>::template Partition
+          <Dune::Interior_Partition>::Iterator LeafIterator;
+
+  std::vector<double> local;
+  for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+           	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+    local.push_back(eta[mapper.map(*it)]);
+  const int nElems = gv.comm().sum((int) local.size());
+  const size_t refineTarget = (size_t) (refineFraction*nElems);
+  const size_t coarsenTarget = coarsenFraction > 0 ?
+      nElems - (size_t) ((1.-coarsenFraction)*nElems) : 0;
+
+  // the marked elements of all processes are among the marked ones of each
+  std::sort(local.begin(), local.end());
+  std::vector<double> smallest(local.begin(),
+      local.begin() + std::min(coarsenTarget, local.size()));
+  std::vector<double> largest(local.end() - std::min(refineTarget, local.size()), local.end());
+#if HAVE_MPI
+  if (gv.comm().size() > 1)
+  {
+    const MPI_Comm communicator = mpi_communicator(gv.comm());
+    std::vector<double> all;
+    std::vector<int> counts;
+    root_gather(communicator, smallest, all, counts);
+    smallest.swap(all);
+    root_gather(communicator, largest, all, counts);
+    largest.swap(all);
+  }
+#endif
+
+  // refine from the refineTarget-th largest, coarsen up to the coarsenTarget-th smallest
+  double thresholds[2] = { std::numeric_limits<double>::infinity(), -1. };
+  if (gv.comm().rank() == 0)
+  {
+    if (refineTarget > 0) {
+      std::nth_element(largest.begin(), largest.end() - refineTarget, largest.end());
+      thresholds[0] = *(largest.end() - refineTarget);
+    }
+    if (coarsenTarget > 0) {
+      std::nth_element(smallest.begin(), smallest.begin() + coarsenTarget - 1, smallest.end());
+      thresholds[1] = smallest[coarsenTarget - 1];
+    }
+  }
+  gv.comm().broadcast(thresholds, 2, 0);
+
+  int refined = 0;
+  for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+           	it!=gv.template end<0,Dune::Interior_Partition>(); ++it) {
+    double e = eta[mapper.map(*it)];
+    if (e >= thresholds[0] && e > 0) {
+      grid.mark(1, *it);
+      refined++;
+    }
+    else if (e <= thresholds[1])
+      grid.mark(-1, *it);
+  }
+  return gv.comm().sum(refined);
+}
+
+
+// ------------------------------------------------------------------------
+/// Mark all elements for refinement
+// ------------------------------------------------------------------------
+/*!
+   Unlike grid.globalRefine() this goes through the adaptation cycle, so the
+   solution can be transferred with Dune::PDELab::adapt_grid.
+
+   \return the number of elements marked on all processes
+*/
+template<class Grid, class GV>
+int mark_grid_uniform(Grid& grid, const GV& gv)
+{
+  typedef typename GV::template Codim<0>::template Partition
+          <Dune::Interior_Partition>::Iterator LeafIterator;
+
+  int refined = 0;
+  for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+           	it!=gv.template end<0,Dune::Interior_Partition>(); ++it) {
+    grid.mark(1, *it);
+    refined++;
+  }
+  return gv.comm().sum(refined);
+}
+
+#endif  // _ERRORESTIMATOR_HH
@@ -1,4 +1,4 @@
-/** \brief Driver for solving the IPBS problem using P1 piecewise linear Lagrange elements
+/** \brief Driver for solving the IPBS problem using Pk Lagrange elements
 
     Dirichlet boundary conditions are used for domain (outer) boundaries, Neumann b.c. on
     symmetry axis and IPBS Neumann b.c. where we want the IPBS iterative procedure.
@@ -10,6 +10,8 @@
    \param boundaryIndexToEntity mapper defining the index of boundary elements
 */
 
+#include <memory>
+
 #include <dune/pdelab/gridoperator/gridoperator.hh>
 #if GRIDDIM == 2
 #include<dune/pdelab/finiteelementmap/pk2dfem.hh>	// Pk in 2 dimensions
@@ -25,29 +27,99 @@
 #include<dune/pdelab/backend/istlmatrixbackend.hh>
 #include<dune/pdelab/backend/istlsolverbackend.hh>
 #include<dune/pdelab/newton/newton.hh>
+#include<dune/pdelab/adaptivity/adapt.hh>
+#include<dune/grid/io/file/gmshreader.hh>
 
 #if HAVE_MPI
 #include <dune/pdelab/backend/novlpistlsolverbackend.hh>
 #endif
 
+#include <dune/ipbs/context.hh>
 #include <dune/ipbs/datawriter.hh>
 #include <dune/ipbs/ipbsolver.hh>
 #include <dune/ipbs/boundaries.hh>
 #include <dune/ipbs/PBLocalOperator.hh>
 
 #include <dune/ipbs/ipbsanalysis.hh>
+#include <dune/ipbs/errorestimator.hh>
+#include <dune/ipbs/adjoint.hh>
+#include <dune/ipbs/sensitivity.hh>
+#include <dune/ipbs/dhguess.hh>
+#include <dune/ipbs/checkpoint.hh>
+#include <dune/ipbs/snapshot.hh>
+#include <dune/ipbs/meshcache.hh>
+#include <dune/ipbs/physicalgroups.hh>
+#include <dune/ipbs/loadbalance.hh>
+#include <dune/ipbs/processgroup.hh>
+#include <dune/ipbs/reduced.hh>
+#include <dune/ipbs/service.hh>
+// the drivers test MORPHING at run time, others than src/ipbs.cc may not define it
+#ifndef MORPHING
+#define MORPHING 0
+#endif
+#if MORPHING
+#include <dune/ipbs/morphing.hh>
+#endif
+#if MATRIXFREE
+#include <dune/ipbs/matrixfree.hh>
+#endif
+#include <dune/ipbs/parser.hh>
+#if LOCKSTEP
+#include <dune/pdelab/gridfunctionspace/powergridfunctionspace.hh>
+#include <dune/ipbs/lockstep.hh>
+#endif
 
 // test some solvers
 //#include<dune/pdelab/stationary/linearproblem.hh>
 //#include <dune/pdelab/backend/seqistlsolverbackend.hh>
 
-template<class GridType, typename PGMap, int k>
-void ipbs_Pk(GridType* grid, const PGMap& elementIndexToEntity,
-             const PGMap& boundaryIndexToEntity)
+/// Initial guess from the solution obtained with a lower polynomial degree
+template<class GF, class State>
+struct WarmStart
+{
+  static const bool enabled = true;
+  WarmStart(const GF& u_, const State& state_) : u(u_), state(state_) {}
+  const GF& u;
+  const State& state;
+};
+
+/// Start from the default initial guess
+struct NoWarmStart
+{
+  static const bool enabled = false;
+};
+
+template<class GFS, class U, class Ipbs>
+void apply_warm_start(const NoWarmStart& start, const GFS& gfs, U& u, Ipbs& ipbs)
+{}
+
+template<class GF, class State, class GFS, class U, class Ipbs>
+void apply_warm_start(const WarmStart<GF,State>& start, const GFS& gfs, U& u, Ipbs& ipbs)
+{
+  Dune::PDELab::interpolate(start.u, gfs, u);
+  // the boundary elements do not depend on the degree
+  ipbs.restoreState(start.state);
+}
+
+template<class GridType, typename PGMap, int k, int maxk>
+struct DegreeSequence;
+
+/*!
+   \param k polynomial degree
+   \param maxk highest polynomial degree compiled into this executable
+   \param context parameters and particles of the problem
+   \param start initial guess, the solution of the previous degree in p-continuation
+*/
+template<class GridType, typename PGMap, int k, int maxk, class Start>
+void ipbs_Pk(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+             const PGMap& boundaryIndexToEntity, const Start& start)
 {
+  SysParams& sysParams = context.sysParams;
+
   // We want to know the total calulation time
   Dune::Timer timer;
   timer.start();
+  Dune::Timer totalTimer;
   
   std::stringstream status;
   //std::ofstream status;
@@ -73,10 +145,10 @@ void ipbs_Pk(GridType* grid, const PGMap& elementIndexToEntity,
   M m(gv, elementIndexToEntity);
   // boundary condition type
   typedef BCTypeParam<std::vector<int> > B;
-  B b(boundaryIndexToEntity);
+  B b(context, boundaryIndexToEntity);
   // Class defining Dirichlet B.C.
   typedef BCExtension<GV,double,std::vector<int> > G;
-  G g(gv, boundaryIndexToEntity);
+  G g(context, gv, boundaryIndexToEntity);
 
   // Create finite element map
 #if GRIDDIM == 2
@@ -123,14 +195,38 @@ void ipbs_Pk(GridType* grid, const PGMap& elementIndexToEntity,
   Dune::PDELab::set_nonconstrained_dofs(cc,0.0,u);
 
   typedef Ipbsolver<GV, GFS> Ipbs;
-  Ipbs ipbs(gv, gfs, boundaryIndexToEntity, 1);
+  Ipbs ipbs(context, gv, gfs, boundaryIndexToEntity, 1);
   // instanciate boundary fluxes
   typedef BoundaryFlux<GV,double,std::vector<int>, Ipbs > J;
-  J j(gv, boundaryIndexToEntity, ipbs);
+  J j(context, gv, boundaryIndexToEntity, ipbs);
+
+  // Start from a better guess than u = 0 and a constant boundary flux
+  if (Start::enabled || sysParams.get_initialGuess() == 1 || !sysParams.get_warmStart().empty())
+  {
+    if (Start::enabled)
+      apply_warm_start(start, gfs, u, ipbs);
+    else if (!sysParams.get_warmStart().empty()) {
+      // solution of a run on a different mesh
+      typedef SnapshotFunction<GV,Real,typename Ipbs::State> Snapshot;
+      const Snapshot snapshot(gv, sysParams.get_warmStart());
+      Dune::PDELab::interpolate(snapshot,gfs,u);
+      ipbs.restoreState(snapshot.state());
+    }
+    else {
+      typedef DebyeHueckelGuess<GV,Real> DH;
+      const DH dh(context, gv, ipbs);
+      Dune::PDELab::interpolate(dh,gfs,u);
+      ipbs.initial_guess(dh);
+    }
+    // keep the Dirichlet values
+    U ug(gfs,0.0);
+    Dune::PDELab::interpolate(g,gfs,ug);
+    Dune::PDELab::copy_constrained_dofs(cc,ug,u);
+  }
 
   // <<<4>>> Make Grid Operator Space
   typedef PBLocalOperator<M,B,J> LOP;
-  LOP lop(m,b,j,k+1);   // integration order
+  LOP lop(context,m,b,j,k+1);   // integration order
   typedef Dune::PDELab::ISTLBCRSMatrixBackend<1,1> MBE;
 #if HAVE_MPI    // enable overlapping mode
   typedef Dune::PDELab::GridOperator<GFS,GFS,LOP,MBE,
@@ -139,129 +235,445 @@ void ipbs_Pk(GridType* grid, const PGMap& elementIndexToEntity,
   typedef Dune::PDELab::GridOperator<GFS,GFS,LOP,MBE,
                                     Real,Real,Real,CC,CC> GO;
 #endif
-  GO go(gfs,cc,gfs,cc,lop);
 
-const int solverMaxIter = 20000;
+  typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+  
+  double inittime = timer.elapsed();
+  double solvertime = 0.;
+  double itertime = 0.;
+
+  double fluxError, icError;
+  int iterations = 0;
+
+  // parameter continuation, see SysParams::get_continuationKey
+  size_t continuationPoint = 0;
+  int pointStart = 0;
+
+  // Resume the iteration from a checkpoint written by an earlier run
+  unsigned int restartIterations = 0;
+  if (!Start::enabled && sysParams.get_restart())
+  {
+    typename Ipbs::State state;
+    read_checkpoint(sysParams.get_checkpointName(), communicator, k, u, state);
+    ipbs.restoreState(state);
+    iterations = restartIterations = state.iterationCounter;
+    continuationPoint = state.continuationPoint;
+    pointStart = state.pointStart;
+    if (communicator.rank() == 0)
+      std::cout << "Restarting from checkpoint after " << iterations << " iterations" << std::endl;
+    status << "# restarted after iteration " << iterations << std::endl;
+
+    // continue with the value of the checkpoint, the rows of the later values are dropped
+    const std::vector<double>& values = sysParams.get_continuationValues();
+    if (continuationPoint > 0 && continuationPoint < values.size())
+    {
+      apply_parameter(context, sysParams.get_continuationKey(), values[continuationPoint]);
+      if (communicator.rank() == 0) {
+        const std::string filename = sysParams.get_outname() + "_continuation.dat";
+        std::ifstream in(filename.c_str());
+        std::string line, rows;
+        for (size_t n = 0; n <= continuationPoint && std::getline(in, line); n++)
+          rows += line + "\n";
+        in.close();
+        std::ofstream out(filename.c_str());
+        out << rows;
+        std::cout << "Continuing with " << sysParams.get_continuationKey() << " = "
+          << values[continuationPoint] << std::endl;
+      }
+    }
+  }
+
+  const int checkpointInterval = sysParams.get_checkpointInterval();
+  const double walltime = sysParams.get_checkpointWalltime();
+  const bool checkpointing = checkpointInterval > 0 || walltime > 0
+    || sysParams.get_checkpointOnSignal();
+  if (sysParams.get_checkpointOnSignal())
+    install_checkpoint_handlers();
+  // iteration of the last checkpoint, the one restarted from is not written again
+  int checkpointIteration = iterations;
+  bool stopped = false;
+
+  DataWriter<GV,dim> mydatawriter(context, gv);
+
+  // Analysis class
+  typedef IpbsAnalysis<GV,GFS,std::vector<int> , Ipbs> Analyzer;
+  const Analyzer analyzer(context, gv, gfs, boundaryIndexToEntity, ipbs);
+
+  // Error estimator driving the adaptive refinement
+  typedef ResidualErrorEstimator<GV,GFS,B,J> Estimator;
+  const Estimator estimator(context, gv, gfs, b, j, 2*k);
+
+  // With nested iteration the given mesh is the coarsest level and the IPBS
+  // iteration is done to a looser tolerance on all but the finest level.
+  // In p-continuation the same holds for the lower degrees, the nested levels
+  // are done with the first and the adaptive steps with the final degree.
+  const bool finalDegree = (k == sysParams.get_degree());
+  // members of an ensemble prefix all output files with their name
+  const std::string prefix = sysParams.get_ensembleMember() >= 0 ?
+    sysParams.get_outname() + "_" : "";
+  const int nestedLevels = Start::enabled ? 0 : sysParams.get_nestedLevels();
+  const int refinementSteps = finalDegree ? sysParams.get_refinementSteps() : 0;
+  const double tolerance = sysParams.get_tolerance();
+  if (nestedLevels > 0 || !finalDegree)
+    sysParams.set_tolerance(sysParams.get_nestedTolerance());
+
+  // parameter updates from the requests of a service
+  IpbsService* service = (finalDegree && sysParams.get_service()) ?
+    new IpbsService(context, communicator.rank()) : 0;
+
+#if MORPHING
+  int morphStep = 0;
+#endif
+
+  // Solver objects are rebuilt in each refinement step as they depend on the
+  // function space and the constraints
+  for (int refinementStep = 0; ; refinementStep++)
+  {
+    GO go(gfs,cc,gfs,cc,lop);
+
+    const int solverMaxIter = 20000;
 
-  // <<<5a>>> Select a linear solver backend
+    // <<<5a>>> Select a linear solver backend
 #if HAVE_MPI
 #if LINEARSOLVER == BCGS_SSORk
-  typedef Dune::PDELab::ISTLBackend_NOVLP_BCGS_SSORk<GO> LS;
-  LS ls( gfs, solverMaxIter, 5, sysParams.get_verbose() );
+    typedef Dune::PDELab::ISTLBackend_NOVLP_BCGS_SSORk<GO> LS;
+    LS ls( gfs, solverMaxIter, 5, sysParams.get_verbose() );
 #endif
 
 #if LINEARSOLVER == BCGS_NOPREC
-  typedef Dune::PDELab::ISTLBackend_NOVLP_BCGS_NOPREC<GFS> LS;
-  LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
+    typedef Dune::PDELab::ISTLBackend_NOVLP_BCGS_NOPREC<GFS> LS;
+    LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
 #endif
 
 #if LINEARSOLVER == CG_SSORk
-  typedef Dune::PDELab::ISTLBackend_NOVLP_CG_SSORk< GO > LS;
-  LS ls( gfs, solverMaxIter, 5, sysParams.get_verbose() );
+    typedef Dune::PDELab::ISTLBackend_NOVLP_CG_SSORk< GO > LS;
+    LS ls( gfs, solverMaxIter, 5, sysParams.get_verbose() );
 #endif
 
 #if LINEARSOLVER == CG_NOPREC
-  typedef Dune::PDELab::ISTLBackend_NOVLP_CG_NOPREC<GFS> LS;
-  LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
+    typedef Dune::PDELab::ISTLBackend_NOVLP_CG_NOPREC<GFS> LS;
+    LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
 #endif
 
 #if LINEARSOLVER == CG_Jacobi
-  typedef Dune::PDELab::ISTLBackend_NOVLP_CG_Jacobi< GFS > LS;
-  LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
+    typedef Dune::PDELab::ISTLBackend_NOVLP_CG_Jacobi< GFS > LS;
+    LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
 #endif
 
 #if LINEARSOLVER == CG_AMG_SSOR
-    typedef Dune::PDELab::ISTLBackend_NOVLP_CG_AMG_SSOR<GO> LS;
-    LS ls( gfs, 5, solverMaxIter, sysParams.get_verbose() );
+      typedef Dune::PDELab::ISTLBackend_NOVLP_CG_AMG_SSOR<GO> LS;
+      LS ls( gfs, 5, solverMaxIter, sysParams.get_verbose() );
 #endif
 
 #if LINEARSOLVER == BCGS_AMG_SSOR
-  typedef Dune::PDELab::ISTLBackend_NOVLP_BCGS_AMG_SSOR<GO> LS;
-  LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
+    typedef Dune::PDELab::ISTLBackend_NOVLP_BCGS_AMG_SSOR<GO> LS;
+    LS ls( gfs, solverMaxIter, sysParams.get_verbose() );
 #endif
 
 #else
-  typedef Dune::PDELab::ISTLBackend_SEQ_BCGS_SSOR LS;
-  //typedef Dune::PDELab::ISTLBackend_SEQ_SuperLU LS;
-  //typedef Dune::PDELab::ISTLBackend_SEQ_CG_ILU0 LS;
-  //typedef Dune::PDELab::ISTLBackend_SEQ_BCGS_AMG_SOR<GOS> LS;
-  LS ls(5000, true);
+    typedef Dune::PDELab::ISTLBackend_SEQ_BCGS_SSOR LS;
+    //typedef Dune::PDELab::ISTLBackend_SEQ_SuperLU LS;
+    //typedef Dune::PDELab::ISTLBackend_SEQ_CG_ILU0 LS;
+    //typedef Dune::PDELab::ISTLBackend_SEQ_BCGS_AMG_SOR<GOS> LS;
+    LS ls(5000, true);
 #endif
 
-  //typedef Dune::PDELab::StationaryLinearProblemSolver<GOS,LS,U> SLP;
-  //SLP slp(gos, u, ls, 1e-10);
-  //slp.apply();
+    //typedef Dune::PDELab::StationaryLinearProblemSolver<GOS,LS,U> SLP;
+    //SLP slp(gos, u, ls, 1e-10);
+    //slp.apply();
 
-  // <<<5b>>> Solve nonlinear problem
-  typedef Dune::PDELab::Newton<GO,LS,U> NEWTON;
-  NEWTON newton(go,u,ls);
-  newton.setLineSearchStrategy(newton.hackbuschReuskenAcceptBest);
-  newton.setVerbosityLevel(sysParams.get_verbose());
-  newton.setMinLinearReduction(1e-9);
-  newton.setMaxIterations(100);
-  newton.setLineSearchMaxIterations(50);
+    // <<<5b>>> Solve nonlinear problem
+#if MATRIXFREE
+    // the Jacobian is applied element by element and preconditioned with P1,
+    // the linear solver above is left for the adjoint problems
+    typedef MatrixFreeJacobian<GV,GFS,LOP,CC,U> MFJ;
+    MFJ jacobian(gv,gfs,lop,cc);
+    LOP lop1(context,m,b,j,2);
+    typedef P1CoarsePreconditioner<GV,GFS,B,LOP,MFJ,U> PREC;
+    PREC preconditioner(gv,gfs,b,lop1,jacobian);
+    typedef MatrixFreeNewton<GO,CC,MFJ,PREC,U> NEWTON;
+    NEWTON newton(go,cc,jacobian,preconditioner,u);
+#else
+    typedef Dune::PDELab::Newton<GO,LS,U> NEWTON;
+    NEWTON newton(go,u,ls);
+    newton.setLineSearchStrategy(newton.hackbuschReuskenAcceptBest);
+#endif
+    newton.setVerbosityLevel(sysParams.get_verbose());
+    newton.setMinLinearReduction(1e-9);
+    newton.setMaxIterations(100);
+    newton.setLineSearchMaxIterations(50);
 
-  typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
-  
-  double inittime = timer.elapsed();
-  double solvertime = 0.;
-  double itertime = 0.;
+    // --- Here the iterative loop starts ---
 
-  double fluxError, icError;
-  int iterations = 0;
+    unsigned int counter = restartIterations > 0 ? restartIterations - pointStart : 0;
+    restartIterations = 0;
+    double iterationTime = 0;
+    // In parameter continuation the points are solved one after the other with
+    // the same solver objects, each starting from the solution of the previous one
+    for (;;)
+    {
+      // false when Newton fails or maxiter is reached first
+      bool converged = false;
+      do
+      {
+        // write a checkpoint at the interval, and stop before the time is up or when signalled
+        if (counter > 0 && checkpointing)
+        {
+          int stop = checkpoint_signal()
+            || (walltime > 0 && checkpoint_walltime() + 1.5*iterationTime > walltime);
+          stop = communicator.max(stop);
+          if ((stop || (checkpointInterval > 0 && iterations % checkpointInterval == 0))
+              && iterations != checkpointIteration) {
+            typename Ipbs::State state;
+            ipbs.saveState(state);
+            state.continuationPoint = continuationPoint;
+            state.pointStart = pointStart;
+            write_checkpoint(sysParams.get_checkpointName(), communicator.rank(),
+                communicator.size(), k, u, state);
+            status << "# checkpoint after iteration " << iterations << std::endl;
+            checkpointIteration = iterations;
+          }
+          if (stop) {
+            if (communicator.rank() == 0)
+              std::cout << "Stopping after checkpoint in iteration " << iterations << std::endl;
+            stopped = true;
+            break;
+          }
+        }
+        Dune::Timer iterationTimer;
 
-  DataWriter<GV,dim> mydatawriter(gv);
+        timer.reset();
+        try{
+            newton.apply();
+        }
+        catch (Dune::Exception &e){
+            status << "# Dune reported error: " << e << std::endl;
+            std::cerr << "Dune reported error: " << e << std::endl;
+            break;
+        }
+        catch (...){
+            std::cerr << "Unknown exception thrown!" << std::endl;
+            break;
+        }
+        solvertime += timer.elapsed();
 
-  // Analysis class
-  typedef IpbsAnalysis<GV,GFS,std::vector<int> , Ipbs> Analyzer;
-  const Analyzer analyzer(gv, gfs, boundaryIndexToEntity, ipbs);
+        // save snapshots every N step
+        if(iterations % sysParams.get_outStep() == 0) {
+          std::stringstream out;
+          out << sysParams.get_outname() << "_step_" << iterations;
+          std::string filename = out.str();
+          DGF udgf_snapshot(gfs,u);
+          Dune::VTKWriter<GV> vtkwriter(gv,Dune::VTKOptions::conforming);
+          vtkwriter.addVertexData(new Dune::PDELab::VTKGridFunctionAdapter<DGF>(udgf_snapshot,"solution"));
+          vtkwriter.write(filename,Dune::VTK::appendedraw);
+          mydatawriter.writeIpbsCellData(gfs, u, "solution", filename, status);
+          std::stringstream fname;
+          fname << prefix << "forces_step_" << iterations;
+          std::string forcefilename = fname.str();
+          analyzer.forces(u, forcefilename);
+        }
 
-  // --- Here the iterative loop starts ---
+        timer.reset();
+        ipbs.updateChargeRegulation(u);
+        ipbs.updateBC(u);
+        itertime += timer.elapsed();
+        iterationTime = iterationTimer.elapsed();
+        counter++;
+      }
+      while (!(converged = ipbs.converged(fluxError,icError,iterations))
+          && counter < sysParams.get_maxiter());
 
-  unsigned int counter = 0;
-  do
-  {
-    timer.reset();
-    try{
-        newton.apply();
-    }
-    catch (Dune::Exception &e){
-        status << "# Dune reported error: " << e << std::endl;
-        std::cerr << "Dune reported error: " << e << std::endl;
+      if (service && !stopped && refinementStep >= nestedLevels + refinementSteps)
+      {
+        // answer the request and solve again from this solution for the next one
+        std::vector<Dune::FieldVector<Real,dim> > F(sysParams.get_npart());
+        for (size_t i = 0; i < F.size(); i++)
+          F[i] = analyzer.force(u, i);
+        const std::vector<double> potentials = analyzer.surfacePotentials(u);
+        service->answer(F, potentials, analyzer.energy(u, ""), iterations - pointStart,
+            converged);
+        if (!service->next(communicator))
+          break;
+        // the potentials of the Dirichlet boundaries may have changed
+        U ug(gfs,0.0);
+        Dune::PDELab::interpolate(g,gfs,ug);
+        Dune::PDELab::copy_constrained_dofs(cc,ug,u);
+        pointStart = iterations;
+        counter = 0;
+        continue;
+      }
+
+      if (stopped || sysParams.get_continuationKey().empty() || !finalDegree
+          || refinementStep < nestedLevels + refinementSteps
+          || continuationPoint >= sysParams.get_continuationValues().size())
         break;
-    }
-    catch (...){
-        std::cerr << "Unknown exception thrown!" << std::endl;
+
+      // record this point and continue with the next value
+      const std::string key = sysParams.get_continuationKey();
+      const std::vector<double>& values = sysParams.get_continuationValues();
+      std::vector<Dune::FieldVector<Real,dim> > F(sysParams.get_npart());
+      for (size_t i = 0; i < F.size(); i++)
+        F[i] = analyzer.force(u, i);
+      if (communicator.rank() == 0) {
+        std::ofstream results((sysParams.get_outname() + "_continuation.dat").c_str(),
+            continuationPoint == 0 ? std::ios::out : std::ios::app);
+        if (continuationPoint == 0)
+          results << "# " << key << " iterations fluxError icError, forces on particles 0.."
+            << F.size()-1 << std::endl;
+        results << values[continuationPoint] << " " << iterations - pointStart << " "
+          << fluxError << " " << icError;
+        for (size_t i = 0; i < F.size(); i++)
+          results << " " << F[i];
+        results << std::endl;
+      }
+      status << "# " << key << " = " << values[continuationPoint] << " done after "
+        << iterations - pointStart << " iterations" << std::endl;
+      if (++continuationPoint >= values.size())
         break;
+      apply_parameter(context, key, values[continuationPoint]);
+      if (communicator.rank() == 0)
+        std::cout << "Continuing with " << key << " = " << values[continuationPoint] << std::endl;
+      pointStart = iterations;
+      counter = 0;
     }
-    solvertime += timer.elapsed();
 
-    // save snapshots every N step
-    if(iterations % sysParams.get_outStep() == 0) {
-      std::stringstream out;
-      out << sysParams.get_outname() << "_step_" << iterations;
-      std::string filename = out.str();
-      DGF udgf_snapshot(gfs,u);
-      Dune::VTKWriter<GV> vtkwriter(gv,Dune::VTKOptions::conforming);
-      vtkwriter.addVertexData(new Dune::PDELab::VTKGridFunctionAdapter<DGF>(udgf_snapshot,"solution"));
-      vtkwriter.write(filename,Dune::VTK::appendedraw);
-      mydatawriter.writeIpbsCellData(gfs, u, "solution", filename, status);
-      std::stringstream fname;
-      fname << "forces_step_" << iterations;
-      std::string forcefilename = fname.str();
-      analyzer.forces(u, forcefilename);
+    // --- here the iterative loop ends! ---
+
+    if (stopped)
+      break;
+    if (refinementStep >= nestedLevels + refinementSteps)
+    {
+      // derivatives of the forces, next to the forces written below
+      if (finalDegree && sysParams.get_sensitivities())
+        write_sensitivities<J,LOP>(context, gv, gfs, boundaryIndexToEntity, ipbs, m, b, cc,
+            go, ls, u, k+1, prefix + "sensitivities.dat");
+#if MORPHING
+      // distance sweep: record the force and move the particle to the next position
+      if (finalDegree)
+      {
+        const int particle = sysParams.get_morphParticle();
+        Dune::FieldVector<Real,dim> F = analyzer.force(u, particle);
+        if (communicator.rank() == 0) {
+          std::ofstream curve((sysParams.get_outname() + "_force_curve.dat").c_str(),
+              morphStep == 0 ? std::ios::out : std::ios::app);
+          curve << grid->coordFunction().displacement() << " " << F << std::endl;
+        }
+        if (morphStep < sysParams.get_morphSteps())
+        {
+          if (morphStep == 0) {
+            std::vector<Dune::FieldVector<ctype,dim> > centers;
+            std::vector<double> areas;
+            ipbs.groupGeometry(centers, areas);
+            const double radius = (dim == 2 && sysParams.get_symmetry() == 0) ?
+              areas[particle] / (2.*sysParams.pi) : std::sqrt(areas[particle] / (4.*sysParams.pi));
+            const double inner = sysParams.get_morphInnerRadius() > 0 ?
+              sysParams.get_morphInnerRadius() : 1.2*radius;
+            const double outer = sysParams.get_morphOuterRadius() > 0 ?
+              sysParams.get_morphOuterRadius() : 3.*radius;
+            grid->coordFunction().setRegion(centers[particle], inner, outer);
+          }
+          morphStep++;
+          grid->coordFunction().setDisplacement(morphStep * sysParams.get_morphIncrement());
+          if (grid->coordFunction().maxStrain() > .5 && communicator.rank() == 0)
+            std::cerr << "Warning: mesh deformation " << grid->coordFunction().maxStrain()
+              << " is large, elements may degenerate" << std::endl;
+          if (communicator.rank() == 0)
+            std::cout << "Moving particle " << particle << " by "
+              << grid->coordFunction().displacement() << std::endl;
+          status << "# particle moved by " << grid->coordFunction().displacement() << std::endl;
+          // same boundary elements at new positions
+          ipbs.reinit();
+          continue;
+        }
+      }
+#endif
+      break;
     }
 
-    timer.reset();
-    ipbs.updateChargeRegulation(u);
-    ipbs.updateBC(u);
-    itertime += timer.elapsed();
-    counter++;
+    // <<<5c>>> Refine the grid
+    if (refinementStep < nestedLevels)
+    {
+      // nested iteration: the coarse solution is the initial guess on the next level
+      int marked = mark_grid_uniform(*grid, gv);
+      if (communicator.rank() == 0)
+        std::cout << "Nested level " << refinementStep << " reached after " << iterations
+          << " iterations, refining all " << marked << " elements" << std::endl;
+      status << "# nested level " << refinementStep << " iterations " << iterations << std::endl;
+      if (refinementStep+1 == nestedLevels && finalDegree)
+        sysParams.set_tolerance(tolerance);
+    }
+    else
+    {
+      // Adapt the grid where the residual error estimator is largest
+      std::vector<double> eta;
+      double estimate = estimator.estimate(u, eta);
+      if (sysParams.get_adaptiveStrategy() == 1)
+      {
+        // weight the residuals with the solution of the adjoint problem for the force
+        typedef ForceFunctional<GV,GFS,PGMap> Functional;
+        const Functional functional(context, gv, gfs, boundaryIndexToEntity,
+            sysParams.get_goalParticle(), sysParams.get_goalDirection());
+        U z(gfs,0.0);
+        double force = solve_adjoint(go, ls, cc, functional, u, z);
+        std::vector<double> omega;
+        estimator.dualWeights(z, omega);
+        estimate = 0;
+        for (size_t i = 0; i < eta.size(); i++) {
+          eta[i] *= omega[i];
+          estimate += eta[i];
+        }
+        estimate = std::sqrt(communicator.sum(estimate));
+        if (communicator.rank() == 0)
+          std::cout << "Adaptive step " << refinementStep << ": force on particle "
+            << sysParams.get_goalParticle() << " is " << force << std::endl;
+        status << "# adaptive step " << refinementStep << " force " << force << std::endl;
+      }
+      int marked = mark_grid_fraction(*grid, gv, estimator.elementMapper(), eta,
+          sysParams.get_refinementFraction(), sysParams.get_coarsenFraction());
+      if (communicator.rank() == 0)
+        std::cout << "Adaptive step " << refinementStep << ": estimated error " << estimate
+          << ", refining " << marked << " elements" << std::endl;
+      status << "# adaptive step " << refinementStep << " estimated error " << estimate << std::endl;
+    }
+
+    // transfers the solution to the new grid
+    Dune::PDELab::adapt_grid(*grid, gfs, u, 2*k);
+#if HAVE_MPI
+    con.compute_ghosts(gfs);
+#endif
+    cc.clear();
+    Dune::PDELab::constraints(b,gfs,cc);
+    U ug(gfs,0.0);
+    Dune::PDELab::interpolate(g,gfs,ug);
+    Dune::PDELab::copy_constrained_dofs(cc,ug,u);
+
+    // and the iterated boundary values to the new boundary elements
+    ipbs.reinit();
+    if (communicator.rank() == 0)
+      std::cout << "Grid has " << gv.size(0) << " local elements and " << ipbs.get_n()
+        << " iterated boundary elements after adaptation" << std::endl;
   }
-  while (!ipbs.converged(fluxError,icError,iterations) && counter < sysParams.get_maxiter());
 
-  // --- here the iterative loop ends! ---
+  delete service;
 
+  // the run is continued from the checkpoint
+  if (stopped)
+    return;
+
+  if (!finalDegree)
+  {
+    // <<<5d>>> Continue with the next polynomial degree
+    if (communicator.rank() == 0)
+      std::cout << "P" << k << " done after " << iterations << " iterations, continuing with P"
+        << k+1 << std::endl;
+    sysParams.set_tolerance(tolerance);
+    DGF ucoarse(gfs,u);
+    typename Ipbs::State state;
+    ipbs.saveState(state);
+    DegreeSequence<GridType,PGMap,k,maxk>::next(context, grid, elementIndexToEntity,
+        boundaryIndexToEntity, WarmStart<DGF,typename Ipbs::State>(ucoarse, state));
+    return;
+  }
 
   status << "# reached convergence criterion: " << std::boolalpha <<
     ipbs.converged(fluxError, icError, iterations) << std::endl;
@@ -269,6 +681,16 @@ const int solverMaxIter = 20000;
       << "# maximum relative change in boundary condition calculation is " <<  fluxError << std::endl
       << "# maximum relative change in induced charge density is " << icError << std::endl;
 
+  // converged solution for later restarts or as basis of a superposition
+  if (sysParams.get_checkpointFinal()) {
+    typename Ipbs::State state;
+    ipbs.saveState(state);
+    state.continuationPoint = continuationPoint;
+    state.pointStart = pointStart;
+    write_checkpoint(sysParams.get_checkpointName(), communicator.rank(), communicator.size(),
+        k, u, state);
+  }
+
   // <<<6>>> graphical output
   DGF udgf(gfs,u);
   Dune::VTKWriter<GV> vtkwriter(gv,Dune::VTKOptions::conforming);
@@ -276,12 +698,18 @@ const int solverMaxIter = 20000;
   vtkwriter.write((sysParams.get_outname() + "_solution").c_str(), Dune::VTK::appendedraw);
   // Also do Gnuplot output
   mydatawriter.writeIpbsCellData(gfs, u, "solution", sysParams.get_outname() + "_solution", status);
+  // Initial guess for runs on other meshes
+  if (sysParams.get_writeSnapshot()) {
+    typename Ipbs::State state;
+    ipbs.saveState(state);
+    write_snapshot(sysParams.get_outname() + "_snapshot", gv, gfs, u, state);
+  }
 
-  analyzer.forces(u, "forces.dat");
-  analyzer.surfacepot(u, "surface_potential.dat");
-  analyzer.E_ext(u, "e_ext.dat");
+  analyzer.forces(u, prefix + "forces.dat");
+  analyzer.surfacepot(u, prefix + "surface_potential.dat");
+  analyzer.E_ext(u, prefix + "e_ext.dat");
 
-  analyzer.energy(u, "idiot");
+  const double energy = analyzer.energy(u, prefix + "idiot");
   std::vector<double> corners;
   corners.push_back(0);
   corners.push_back(10);
@@ -294,4 +722,1033 @@ const int solverMaxIter = 20000;
       << " init: " << inittime << " solver: " << solvertime/iterations 
       << " boundary update " << itertime/iterations << std::endl;
   }
+
+  // one line of results, e.g. for the table of a parameter sweep
+  if (sysParams.get_writeSummary())
+  {
+    std::vector<Dune::FieldVector<Real,dim> > F(sysParams.get_npart());
+    for (size_t i = 0; i < F.size(); i++)
+      F[i] = analyzer.force(u, i);
+    const std::vector<double> potentials = analyzer.surfacePotentials(u);
+    if (communicator.rank() == 0) {
+      std::ofstream summary((sysParams.get_outname() + "_summary.dat").c_str());
+      summary << "# iterations fluxError icError init solver boundary_update total";
+      for (size_t i = 0; i < F.size(); i++)
+        for (int d = 0; d < dim; d++)
+          summary << " F" << i << "_" << "xyz"[d];
+      for (size_t i = 0; i < potentials.size(); i++)
+        summary << " phi" << i;
+      summary << " energy" << std::endl;
+      summary << iterations << " " << fluxError << " " << icError << " " << inittime << " "
+        << solvertime << " " << itertime << " " << totalTimer.elapsed();
+      for (size_t i = 0; i < F.size(); i++)
+        summary << " " << F[i];
+      for (size_t i = 0; i < potentials.size(); i++)
+        summary << " " << potentials[i];
+      summary << " " << energy << std::endl;
+    }
+  }
+}
+
+
+// ------------------------------------------------------------------------
+/// Run the driver for the degrees k, ..., sysParams.get_degree()
+// ------------------------------------------------------------------------
+template<class GridType, typename PGMap, int k, int maxk>
+struct DegreeSequence
+{
+  /// Start the sequence, with the lowest degree only for p-continuation
+  static void start(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+                    const PGMap& boundaryIndexToEntity)
+  {
+    SysParams& sysParams = context.sysParams;
+    checkpoint_walltime();    // start the clock for the checkpoint budget
+    if (sysParams.get_degree() <= 0)
+      sysParams.set_degree(maxk);
+    if (sysParams.get_degree() > maxk)
+      DUNE_THROW(Dune::Exception, "Polynomial degree " << sysParams.get_degree()
+          << " requested, but only compiled up to PDEGREE=" << maxk);
+    // a restart continues with the degree of the checkpoint
+    int first = sysParams.get_pContinuation() ? 1 : sysParams.get_degree();
+    if (sysParams.get_restart())
+      first = checkpoint_degree(sysParams.get_checkpointName(), grid->comm().rank());
+    if (k >= first)
+      ipbs_Pk<GridType,PGMap,k,maxk>(context, grid, elementIndexToEntity, boundaryIndexToEntity,
+          NoWarmStart());
+    else
+      DegreeSequence<GridType,PGMap,k+1,maxk>::start(context, grid, elementIndexToEntity,
+          boundaryIndexToEntity);
+  }
+
+  /// Continue with degree k+1 from the solution of degree k
+  template<class Start>
+  static void next(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+                   const PGMap& boundaryIndexToEntity, const Start& start)
+  {
+    ipbs_Pk<GridType,PGMap,k+1,maxk>(context, grid, elementIndexToEntity, boundaryIndexToEntity,
+        start);
+  }
+};
+
+template<class GridType, typename PGMap, int maxk>
+struct DegreeSequence<GridType,PGMap,maxk,maxk>
+{
+  static void start(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+                    const PGMap& boundaryIndexToEntity)
+  {
+    checkpoint_walltime();
+    if (context.sysParams.get_degree() <= 0)
+      context.sysParams.set_degree(maxk);
+    ipbs_Pk<GridType,PGMap,maxk,maxk>(context, grid, elementIndexToEntity, boundaryIndexToEntity,
+        NoWarmStart());
+  }
+
+  template<class Start>
+  static void next(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+                   const PGMap& boundaryIndexToEntity, const Start& start)
+  {
+    DUNE_THROW(Dune::Exception, "No polynomial degree above PDEGREE=" << maxk);
+  }
+};
+
+
+// ------------------------------------------------------------------------
+/// Read a gmsh file and create the load balanced grid
+// ------------------------------------------------------------------------
+/*!
+   Each process gets the physical groups of its own elements and boundary
+   segments, see PhysicalGroups.
+   A mesh rank 0 can not read throws GroupFailure on all processes. The
+   caller owns the returned grid.
+
+   \param cache directory of the binary mesh cache (see meshcache.hh), empty
+                to always parse the gmsh file
+*/
+template<class GridType, typename PGMap>
+GridType* ipbs_read_mesh(const std::string& meshfile, const ProcessGroup& helper,
+                         PGMap& elementIndexToEntity, PGMap& boundaryIndexToEntity,
+                         const std::string& cache = "")
+{
+  GroupGridFactory<GridType> factory(helper);
+  std::string error;
+  if(helper.rank() == 0)
+  {
+    try {
+      const std::string cachefile = cache.empty() ? "" : mesh_cache_filename(cache, meshfile);
+      if (!cachefile.empty()
+          && read_mesh_cache(cachefile, factory, elementIndexToEntity, boundaryIndexToEntity))
+        std::cout << "Mesh read from cache " << cachefile << std::endl;
+      else
+      {
+        if (!cachefile.empty())
+          factory.record();
+        // read a gmsh file
+        Dune::GmshReader<GridType> gmshreader;
+        gmshreader.read(factory, meshfile, boundaryIndexToEntity, elementIndexToEntity, true, true);
+        if (!cachefile.empty()
+            && factory.write(cachefile, elementIndexToEntity, boundaryIndexToEntity))
+          std::cout << "Mesh written to cache " << cachefile << std::endl;
+      }
+    }
+    catch (Dune::Exception& e) {
+      error = e.what();
+    }
+    catch (std::exception& e) {
+      error = e.what();
+    }
+  }
+  // the other processes would wait for rank 0 in createGrid()
+  if (!helper.agree(error.empty()))
+    DUNE_THROW(GroupFailure, "Could not read the mesh " << meshfile
+        << (error.empty() ? "" : ": " + error));
+
+  // create the grid
+  std::auto_ptr<GridType> grid(factory.createGrid());
+  // the physical groups move with the elements
+  const PhysicalGroups<GridType> groups(*grid, factory, elementIndexToEntity);
+
+  // Load balance the parallel grid
+  std::cout << "Grid has been modified by load balancing: " << grid->loadBalance() << std::endl;
+
+  // ProcessGroup ensures that this works for the sequential case
+  groups.distribute(*grid, helper.getCommunicator(), elementIndexToEntity, boundaryIndexToEntity);
+  return grid.release();
+}
+
+/// Read the mesh of a context and balance it by the cost of the boundary integration
+template<class GridType, typename PGMap>
+GridType* ipbs_read_mesh(IpbsContext& context, const ProcessGroup& helper,
+                         PGMap& elementIndexToEntity, PGMap& boundaryIndexToEntity)
+{
+  std::auto_ptr<GridType> grid(ipbs_read_mesh<GridType>(context.sysParams.get_meshfile(),
+      helper, elementIndexToEntity, boundaryIndexToEntity, context.sysParams.get_meshCache()));
+  ipbs_balance_grid(context, helper, *grid, elementIndexToEntity, boundaryIndexToEntity);
+  return grid.release();
+}
+
+// ------------------------------------------------------------------------
+/// Solve the problem of a context on a given grid
+// ------------------------------------------------------------------------
+/*!
+   \param maxk highest polynomial degree compiled into this executable
+*/
+template<class GridType, int maxk, typename PGMap>
+void ipbs_solve(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+                const PGMap& boundaryIndexToEntity)
+{
+#if MORPHING
+  // particles are moved by deforming the coordinates of the grid read from file
+  typedef MorphingCoordinates<typename GridType::ctype, GridType::dimension> Coordinates;
+  Coordinates coordinates(context.sysParams.get_morphDirection());
+  typedef Dune::GeometryGrid<GridType, Coordinates> MorphedGridType;
+  std::auto_ptr<MorphedGridType> morphedGrid(new MorphedGridType(*grid, coordinates));
+  DegreeSequence<MorphedGridType, PGMap, 1, maxk>::start(context, morphedGrid.get(),
+      elementIndexToEntity, boundaryIndexToEntity);
+#else
+  DegreeSequence<GridType, PGMap, 1, maxk>::start(context, grid, elementIndexToEntity,
+      boundaryIndexToEntity);
+#endif
+}
+
+// ------------------------------------------------------------------------
+/// Read the mesh of a problem and solve it
+// ------------------------------------------------------------------------
+/*!
+   Entry point for programs driving IPBS. The context is set up either from a
+   configuration file with parser() or directly with the SysParams setters and
+   IpbsContext::add_boundary(). Several contexts can be solved one after the
+   other in the same process.
+
+   \param maxk highest polynomial degree compiled into this executable
+*/
+template<class GridType, int maxk>
+void ipbs_solve(IpbsContext& context, const ProcessGroup& helper)
+{
+  typedef std::vector<int> PGMap;
+  PGMap boundaryIndexToEntity;
+  PGMap elementIndexToEntity;
+
+  std::auto_ptr<GridType> grid(ipbs_read_mesh<GridType>(context, helper,
+      elementIndexToEntity, boundaryIndexToEntity));
+  ipbs_solve<GridType, maxk>(context, grid.get(), elementIndexToEntity, boundaryIndexToEntity);
+}
+
+// ------------------------------------------------------------------------
+/// Read a table of n values per line, like the charge combinations of a superposition
+// ------------------------------------------------------------------------
+/*!
+   Comment lines starting with '#' and lines not starting with a number
+   are skipped.
+*/
+inline std::vector<std::vector<double> > read_value_table(const std::string& filename, size_t n)
+{
+  std::ifstream in(filename.c_str());
+  if (!in)
+    DUNE_THROW(Dune::IOError, "Could not open table " << filename);
+  std::vector<std::vector<double> > rows;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream values(line);
+    std::vector<double> q;
+    double value;
+    while (values >> value)
+      q.push_back(value);
+    if (q.empty())
+      continue;
+    if (q.size() != n)
+      DUNE_THROW(Dune::IOError, "Expected " << n << " values in line \""
+          << line << "\" of " << filename);
+    rows.push_back(q);
+  }
+  return rows;
+}
+
+/// Parameter keys (see apply_parameter()) in the first line of a table that is no comment
+inline std::vector<std::string> read_parameter_keys(const std::string& filename)
+{
+  std::ifstream in(filename.c_str());
+  if (!in)
+    DUNE_THROW(Dune::IOError, "Could not open table " << filename);
+  std::string line;
+  while (std::getline(in, line))
+    if (!line.empty() && line[0] != '#')
+      break;
+  std::istringstream names(line);
+  std::vector<std::string> keys;
+  std::string key;
+  while (names >> key)
+    keys.push_back(key);
+  return keys;
 }
+
+/// Deletes the objects of a vector of pointers when leaving the scope
+template<typename T>
+class DeleteAll
+{
+  public:
+    DeleteAll(std::vector<T*>& objects_) : objects(objects_) {}
+    ~DeleteAll()
+    {
+      for (size_t i = 0; i < objects.size(); i++)
+        delete objects[i];
+    }
+
+  private:
+    DeleteAll(const DeleteAll&);
+    DeleteAll& operator=(const DeleteAll&);
+
+    std::vector<T*>& objects;
+};
+
+// ------------------------------------------------------------------------
+/// Evaluate charge combinations from the responses to unit charges
+// ------------------------------------------------------------------------
+/*!
+   The solution and the iterated boundary data of a combination q are
+   \f[ u = u_0 + \sum_s q_s (u_s - u_0), \f]
+   where u_s was solved with unit charge on surface s only and u_0 without
+   charges. The forces are evaluated from the superposed solution.
+
+   \param surfaces boundaries carrying a charge
+   \param basis checkpoint names of u_0 (empty if it vanishes) and the u_s
+*/
+template<class GridType, typename PGMap, int k>
+void ipbs_superpose_Pk(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+                       const PGMap& boundaryIndexToEntity, const std::vector<int>& surfaces,
+                       const std::vector<std::string>& basis,
+                       const std::vector<std::vector<double> >& combinations)
+{
+  SysParams& sysParams = context.sysParams;
+  std::vector<Boundary*>& boundary = context.boundary;
+
+  typedef typename GridType::LeafGridView GV;
+  const GV& gv = grid->leafView();
+  typedef typename GV::Traits::CollectiveCommunication CollectiveCommunication;
+  const CollectiveCommunication & communicator = gv.comm();
+  typedef typename GV::Grid::ctype ctype;
+  const int dim = GV::dimension;
+
+#if GRIDDIM == 2
+  typedef Dune::PDELab::Pk2DLocalFiniteElementMap<GV, ctype, Real, k> FEM;
+#elif GRIDDIM == 3
+  typedef Dune::PDELab::Pk3DLocalFiniteElementMap<GV, ctype, Real, k> FEM;
+#endif
+  FEM fem(gv);
+  typedef Dune::PDELab::ISTLVectorBackend<1> VBE;
+#if HAVE_MPI
+  typedef Dune::PDELab::NonoverlappingConformingDirichletConstraints CON;
+#else
+  typedef Dune::PDELab::ConformingDirichletConstraints CON;
+#endif
+  CON con;
+  typedef Dune::PDELab::GridFunctionSpace<GV,FEM,CON,VBE> GFS;
+  GFS gfs(gv,fem,con);
+#if HAVE_MPI
+  con.compute_ghosts(gfs);
+#endif
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+
+  typedef Ipbsolver<GV, GFS> Ipbs;
+  Ipbs ipbs(context, gv, gfs, boundaryIndexToEntity, 1, false);
+  typedef typename Ipbs::State State;
+
+  // the basis solutions are turned into the responses to unit charges
+  U u0(gfs,0.0);
+  State state0;
+  if (!basis[0].empty())
+    read_checkpoint(basis[0], communicator, k, u0, state0);
+  std::vector<U*> responses(surfaces.size());
+  const DeleteAll<U> deleteResponses(responses);
+  std::vector<State> responseStates(surfaces.size());
+  for (size_t s = 0; s < surfaces.size(); s++)
+  {
+    responses[s] = new U(gfs,0.0);
+    read_checkpoint(basis[s+1], communicator, k, *responses[s], responseStates[s]);
+    if (!basis[0].empty()) {
+      responses[s]->axpy(-1.0, u0);
+      responseStates[s].axpy(-1.0, state0);
+    }
+  }
+
+  typedef IpbsAnalysis<GV,GFS,std::vector<int> , Ipbs> Analyzer;
+  const Analyzer analyzer(context, gv, gfs, boundaryIndexToEntity, ipbs);
+  typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+
+  std::ofstream results;
+  if (communicator.rank() == 0) {
+    results.open((sysParams.get_outname() + "_superposition.dat").c_str(), std::ios::out);
+    results << "# combination, charge densities of boundaries";
+    for (size_t s = 0; s < surfaces.size(); s++)
+      results << " " << surfaces[s];
+    results << ", forces on particles 0.." << sysParams.get_npart()-1 << std::endl;
+  }
+
+  U u(gfs,0.0);
+  for (size_t c = 0; c < combinations.size(); c++)
+  {
+    const std::vector<double>& q = combinations[c];
+    u = u0;
+    State state = state0;
+    for (size_t s = 0; s < surfaces.size(); s++) {
+      u.axpy(q[s], *responses[s]);
+      state.axpy(q[s], responseStates[s]);
+      boundary[surfaces[s]]->set_charge_density(q[s]);
+    }
+    ipbs.restoreState(state);
+
+    std::ostringstream name;
+    name << sysParams.get_outname() << "_c" << c;
+    DGF udgf(gfs,u);
+    Dune::VTKWriter<GV> vtkwriter(gv,Dune::VTKOptions::conforming);
+    vtkwriter.addVertexData(new Dune::PDELab::VTKGridFunctionAdapter<DGF>(udgf,"solution"));
+    vtkwriter.write((name.str() + "_solution").c_str(), Dune::VTK::appendedraw);
+    analyzer.surfacepot(u, name.str() + "_surface_potential.dat");
+    analyzer.forces(u, name.str() + "_forces.dat");
+
+    std::vector<Dune::FieldVector<Real,dim> > F(sysParams.get_npart());
+    for (size_t i = 0; i < F.size(); i++)
+      F[i] = analyzer.force(u, i);
+    if (communicator.rank() == 0) {
+      results << c;
+      for (size_t s = 0; s < q.size(); s++)
+        results << " " << q[s];
+      for (size_t i = 0; i < F.size(); i++)
+        results << " " << F[i];
+      results << std::endl;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------
+/// Solve the linear responses to unit charges and superpose them
+// ------------------------------------------------------------------------
+/*!
+   In the linearized case (salt = 2) the solution is affine in the charge
+   densities of the boundaries. One IPBS run per charged boundary (type 1
+   or 2) with unit charge, and one without charges if a Dirichlet boundary
+   has a non-zero potential, give the solution of any charge combination in
+   the file sysParams.get_superposition() without another PDE solve. The
+   basis runs write their output with the prefix <outname>_basis<b>, the
+   combination c with <outname>_c<c>, and <outname>_superposition.dat
+   lists the forces of all combinations.
+
+   \param maxk highest polynomial degree compiled into this executable
+*/
+template<class GridType, int maxk>
+void ipbs_superposition(IpbsContext& context, const ProcessGroup& helper)
+{
+  typedef std::vector<int> PGMap;
+  SysParams& sysParams = context.sysParams;
+  std::vector<Boundary*>& boundary = context.boundary;
+  if (sysParams.get_salt() != 2)
+    DUNE_THROW(Dune::Exception, "Superposition needs the linearized equation (salt = 2)");
+  if (sysParams.get_refinementSteps() > 0 || sysParams.get_nestedLevels() > 0 || MORPHING
+      || !sysParams.get_continuationKey().empty() || sysParams.get_restart())
+    DUNE_THROW(Dune::NotImplemented, "Superposition needs a fixed grid and one parameter set");
+  if (sysParams.get_degree() > 0 && sysParams.get_degree() != maxk)
+    DUNE_THROW(Dune::NotImplemented, "Superposition is done with PDEGREE=" << maxk);
+
+  // charged surfaces, and whether the Dirichlet values contribute
+  std::vector<int> surfaces;
+  bool offset = false;
+  for (size_t i = 0; i < boundary.size(); i++)
+  {
+    if (boundary[i]->get_type() == 1 || boundary[i]->get_type() == 2) {
+      if (boundary[i]->get_sigma_max() != 0)
+        DUNE_THROW(Dune::NotImplemented, "Charge regulation is not linear in the charges");
+      surfaces.push_back(i);
+    }
+    else if (boundary[i]->get_potential() != 0)
+      offset = true;
+  }
+  const std::vector<std::vector<double> > combinations =
+    read_value_table(sysParams.get_superposition(), surfaces.size());
+
+  PGMap boundaryIndexToEntity;
+  PGMap elementIndexToEntity;
+  std::auto_ptr<GridType> grid(ipbs_read_mesh<GridType>(context, helper,
+      elementIndexToEntity, boundaryIndexToEntity));
+
+  const std::string outname = sysParams.get_outname();
+  std::vector<double> charges(boundary.size());
+  for (size_t i = 0; i < boundary.size(); i++)
+    charges[i] = boundary[i]->get_charge_density();
+
+  // basis 0 without charges, basis s+1 with unit charge on surface s
+  std::vector<std::string> basis(surfaces.size()+1);
+  for (size_t b = offset ? 0 : 1; b < basis.size(); b++)
+  {
+    std::ostringstream name;
+    name << outname << "_basis" << b;
+    basis[b] = name.str();
+    for (size_t s = 0; s < surfaces.size(); s++)
+      boundary[surfaces[s]]->set_charge_density(s+1 == b ? 1. : 0.);
+    sysParams.set_outname(basis[b]);
+    sysParams.set_checkpointName(basis[b]);
+    sysParams.set_checkpointFinal(true);
+    // prefix the output files of the basis runs
+    sysParams.set_ensembleMember(b);
+    if (helper.rank() == 0)
+      std::cout << "Solving superposition basis " << b << " of " << basis.size()-1 << std::endl;
+    ipbs_solve<GridType, maxk>(context, grid.get(), elementIndexToEntity, boundaryIndexToEntity);
+  }
+  sysParams.set_outname(outname);
+  sysParams.set_ensembleMember(-1);
+
+  ipbs_superpose_Pk<GridType, PGMap, maxk>(context, grid.get(), elementIndexToEntity,
+      boundaryIndexToEntity, surfaces, basis, combinations);
+
+  for (size_t i = 0; i < boundary.size(); i++)
+    boundary[i]->set_charge_density(charges[i]);
+}
+
+// ------------------------------------------------------------------------
+/// Evaluate parameter sets with a reduced model built from training solutions
+// ------------------------------------------------------------------------
+/*!
+   Queries with an error indicator above sysParams.get_reducedTolerance()
+   are solved by the full IPBS iteration (output prefix <outname>_q<c>).
+
+   \param keys the parameters of the columns of the tables
+   \param snapshots checkpoint names of the solutions for the training rows
+*/
+template<class GridType, typename PGMap, int k>
+void ipbs_reduced_Pk(IpbsContext& context, GridType* grid, const PGMap& elementIndexToEntity,
+                     const PGMap& boundaryIndexToEntity, const std::vector<std::string>& keys,
+                     const std::vector<std::vector<double> >& training,
+                     const std::vector<std::string>& snapshots,
+                     const std::vector<std::vector<double> >& queries)
+{
+  SysParams& sysParams = context.sysParams;
+
+  typedef typename GridType::LeafGridView GV;
+  const GV& gv = grid->leafView();
+  typedef typename GV::Traits::CollectiveCommunication CollectiveCommunication;
+  const CollectiveCommunication & communicator = gv.comm();
+  typedef typename GV::Grid::ctype ctype;
+
+  typedef Regions<GV,double,std::vector<int> > M;
+  M m(gv, elementIndexToEntity);
+  typedef BCTypeParam<std::vector<int> > B;
+  B b(context, boundaryIndexToEntity);
+  typedef BCExtension<GV,double,std::vector<int> > G;
+  G g(context, gv, boundaryIndexToEntity);
+
+#if GRIDDIM == 2
+  typedef Dune::PDELab::Pk2DLocalFiniteElementMap<GV, ctype, Real, k> FEM;
+#elif GRIDDIM == 3
+  typedef Dune::PDELab::Pk3DLocalFiniteElementMap<GV, ctype, Real, k> FEM;
+#endif
+  FEM fem(gv);
+  typedef Dune::PDELab::ISTLVectorBackend<1> VBE;
+#if HAVE_MPI
+  typedef Dune::PDELab::NonoverlappingConformingDirichletConstraints CON;
+#else
+  typedef Dune::PDELab::ConformingDirichletConstraints CON;
+#endif
+  CON con;
+  typedef Dune::PDELab::GridFunctionSpace<GV,FEM,CON,VBE> GFS;
+  GFS gfs(gv,fem,con);
+#if HAVE_MPI
+  con.compute_ghosts(gfs);
+#endif
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+  typedef typename GFS::template ConstraintsContainer<Real>::Type CC;
+  CC cc;
+  Dune::PDELab::constraints(b,gfs,cc);
+
+  // Dirichlet extension
+  U uD(gfs,0.0);
+  Dune::PDELab::interpolate(g,gfs,uD);
+  Dune::PDELab::set_nonconstrained_dofs(cc,0.0,uD);
+
+  // <<<1>>> Offline stage
+  typedef Ipbsolver<GV, GFS> Ipbs;
+  typename Ipbs::State state;
+  std::vector<U*> solutions(snapshots.size());
+  const DeleteAll<U> deleteSolutions(solutions);
+  for (size_t t = 0; t < snapshots.size(); t++)
+  {
+    solutions[t] = new U(gfs,0.0);
+    read_checkpoint(snapshots[t], communicator, k, *solutions[t], state);
+  }
+  Dune::Timer timer;
+  typedef ReducedModel<GV,GFS,PGMap,M,B> Model;
+  const Model model(context, gv, gfs, boundaryIndexToEntity, m, b, cc, uD, solutions, k+1);
+  for (size_t t = 0; t < solutions.size(); t++) {
+    delete solutions[t];
+    solutions[t] = 0;
+  }
+  std::cout << "Reduced basis of dimension " << model.size() << " with "
+            << model.points() << " interpolation points built in "
+            << timer.elapsed() << " s" << std::endl;
+
+  // scale of each parameter for the distance to the training points
+  std::vector<double> scale(keys.size(), 0.);
+  for (size_t t = 0; t < training.size(); t++)
+    for (size_t p = 0; p < keys.size(); p++)
+      scale[p] = std::max(scale[p], std::abs(training[t][p]));
+
+  const std::string outname = sysParams.get_outname();
+  std::ofstream results((outname + "_reduced.dat").c_str(), std::ios::out);
+  results << "# query";
+  for (size_t p = 0; p < keys.size(); p++)
+    results << " " << keys[p];
+  results << ", error indicator, full solve, time [ms], surface potentials and forces"
+          << " on particles 0.." << sysParams.get_npart()-1 << std::endl;
+
+  // <<<2>>> Online stage
+  typedef typename Model::Force Force;
+  int fullSolves = 0;
+  for (size_t c = 0; c < queries.size(); c++)
+  {
+    IpbsContext query(context);
+    for (size_t p = 0; p < keys.size(); p++)
+      apply_parameter(query, keys[p], queries[c][p]);
+
+    // start from the coefficients of the nearest training point
+    size_t nearest = 0;
+    double distance = std::numeric_limits<double>::max();
+    for (size_t t = 0; t < training.size(); t++)
+    {
+      double d = 0;
+      for (size_t p = 0; p < keys.size(); p++)
+        if (scale[p] > 0)
+          d += std::pow((queries[c][p] - training[t][p]) / scale[p], 2);
+      if (d < distance) {
+        distance = d;
+        nearest = t;
+      }
+    }
+    std::vector<double> a = model.coefficients(nearest);
+
+    timer.reset();
+    const double indicator = model.solve(query, a);
+    std::vector<double> potentials;
+    std::vector<Force> forces;
+    const bool full = !(indicator <= sysParams.get_reducedTolerance());
+    if (!full)
+      model.outputs(query, a, potentials, forces);
+    else
+    {
+      std::ostringstream name;
+      name << outname << "_q" << c;
+      query.sysParams.set_outname(name.str());
+      query.sysParams.set_checkpointName(name.str());
+      query.sysParams.set_checkpointFinal(true);
+      query.sysParams.set_ensembleMember(c);
+      std::cout << "Query " << c << " has error indicator " << indicator
+                << ", solving the full problem" << std::endl;
+      ipbs_solve<GridType, k>(query, grid, elementIndexToEntity, boundaryIndexToEntity);
+      U u(gfs,0.0);
+      read_checkpoint(name.str(), communicator, k, u, state);
+      model.outputs(query, u, potentials, forces);
+      fullSolves++;
+    }
+    const double time = timer.elapsed();
+
+    results << c;
+    for (size_t p = 0; p < keys.size(); p++)
+      results << " " << queries[c][p];
+    results << " " << indicator << " " << full << " " << 1e3 * time;
+    for (size_t i = 0; i < potentials.size(); i++)
+      results << " " << potentials[i];
+    for (size_t i = 0; i < forces.size(); i++)
+      results << " " << forces[i];
+    results << std::endl;
+  }
+  std::cout << queries.size() << " queries evaluated, " << fullSolves
+            << " of them by the full solver" << std::endl;
+}
+
+// ------------------------------------------------------------------------
+/// Solve the training parameter sets and evaluate the queries with a reduced model
+// ------------------------------------------------------------------------
+/*!
+   The tables sysParams.get_reducedTraining() and get_reducedQueries() list
+   the parameter keys in their first line (system.lambda and charge
+   densities like boundary_0.charge_density), followed by one line of
+   values per parameter set. The training runs write their output with the
+   prefix <outname>_train<t>, <outname>_reduced.dat lists the results of
+   all queries (see ReducedModel).
+
+   \param maxk highest polynomial degree compiled into this executable
+*/
+template<class GridType, int maxk>
+void ipbs_reduced(IpbsContext& context, const ProcessGroup& helper)
+{
+  typedef std::vector<int> PGMap;
+  SysParams& sysParams = context.sysParams;
+  if (helper.size() > 1)
+    DUNE_THROW(Dune::NotImplemented, "Reduced models are built on one process");
+  if (sysParams.get_refinementSteps() > 0 || sysParams.get_nestedLevels() > 0 || MORPHING
+      || !sysParams.get_continuationKey().empty() || sysParams.get_restart())
+    DUNE_THROW(Dune::NotImplemented, "Reduced models need a fixed grid and one parameter set");
+  if (sysParams.get_degree() > 0 && sysParams.get_degree() != maxk)
+    DUNE_THROW(Dune::NotImplemented, "Reduced models are built with PDEGREE=" << maxk);
+
+  const std::vector<std::string> keys = read_parameter_keys(sysParams.get_reducedTraining());
+  if (read_parameter_keys(sysParams.get_reducedQueries()) != keys)
+    DUNE_THROW(Dune::IOError, "Training and query tables need the same parameter keys");
+  const std::string charge = ".charge_density";
+  for (size_t p = 0; p < keys.size(); p++)
+    if (keys[p] != "system.lambda" && (keys[p].size() <= charge.size()
+          || keys[p].compare(keys[p].size() - charge.size(), charge.size(), charge) != 0))
+      DUNE_THROW(Dune::NotImplemented, "Reduced models vary the Debye length and the "
+          "charge densities, not " << keys[p]);
+  const std::vector<std::vector<double> > training =
+    read_value_table(sysParams.get_reducedTraining(), keys.size());
+  const std::vector<std::vector<double> > queries =
+    read_value_table(sysParams.get_reducedQueries(), keys.size());
+
+  PGMap boundaryIndexToEntity;
+  PGMap elementIndexToEntity;
+  std::auto_ptr<GridType> grid(ipbs_read_mesh<GridType>(context, helper,
+      elementIndexToEntity, boundaryIndexToEntity));
+
+  std::vector<std::string> snapshots(training.size());
+  for (size_t t = 0; t < training.size(); t++)
+  {
+    IpbsContext member(context);
+    for (size_t p = 0; p < keys.size(); p++)
+      apply_parameter(member, keys[p], training[t][p]);
+    std::ostringstream name;
+    name << sysParams.get_outname() << "_train" << t;
+    snapshots[t] = name.str();
+    member.sysParams.set_outname(snapshots[t]);
+    member.sysParams.set_checkpointName(snapshots[t]);
+    member.sysParams.set_checkpointFinal(true);
+    member.sysParams.set_ensembleMember(t);
+    std::cout << "Solving training point " << t+1 << " of " << training.size() << std::endl;
+    ipbs_solve<GridType, maxk>(member, grid.get(), elementIndexToEntity, boundaryIndexToEntity);
+  }
+
+  ipbs_reduced_Pk<GridType, PGMap, maxk>(context, grid.get(), elementIndexToEntity,
+      boundaryIndexToEntity, keys, training, snapshots, queries);
+}
+
+// ------------------------------------------------------------------------
+/// Create the members of an ensemble from the key holding a list of values
+// ------------------------------------------------------------------------
+/*!
+   Each member gets the configuration with one of the values (see parser()).
+   Member i writes its output with the prefix <outname>_m<i>,
+   <outname>_ensemble.dat lists the members.
+*/
+inline std::vector<IpbsContext*> ensemble_members(const std::string& config_file,
+    IpbsContext& context, int rank)
+{
+  SysParams& sysParams = context.sysParams;
+  const std::string key = sysParams.get_continuationKey();
+  const std::vector<double> values = sysParams.get_continuationValues();
+  if (key.empty())
+    DUNE_THROW(Dune::Exception, "An ensemble needs a key with a list of values");
+
+  std::ofstream index;
+  if (rank == 0) {
+    index.open((sysParams.get_outname() + "_ensemble.dat").c_str(), std::ios::out);
+    index << "# member " << key << " output" << std::endl;
+  }
+  std::vector<IpbsContext*> members(values.size());
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    members[i] = new IpbsContext();
+    parser(config_file, *members[i]);
+    apply_parameter(*members[i], key, values[i]);
+    std::ostringstream name;
+    name << sysParams.get_outname() << "_m" << i;
+    SysParams& memberParams = members[i]->sysParams;
+    memberParams.set_continuation("", std::vector<double>());
+    memberParams.set_outname(name.str());
+    memberParams.set_checkpointName(name.str() + "_checkpoint");
+    memberParams.set_ensembleMember(i);
+    if (rank == 0)
+      index << i << " " << values[i] << " " << name.str() << std::endl;
+  }
+  return members;
+}
+
+// ------------------------------------------------------------------------
+/// Solve an ensemble of problems one after the other on one mesh
+// ------------------------------------------------------------------------
+/*!
+   The members are given by the key holding a list of values, see
+   ensemble_members(). The mesh is read once and shared, so the members must
+   not refine or deform the grid. A failing member is reported and the
+   ensemble goes on with the next one, in a parallel run only if all
+   processes agreed on the failure (GroupFailure).
+*/
+template<class GridType, int maxk>
+void ipbs_ensemble(const std::string& config_file, IpbsContext& context, const ProcessGroup& helper)
+{
+  typedef std::vector<int> PGMap;
+  SysParams& sysParams = context.sysParams;
+  const std::string key = sysParams.get_continuationKey();
+  const std::vector<double> values = sysParams.get_continuationValues();
+  if (sysParams.get_refinementSteps() > 0 || sysParams.get_nestedLevels() > 0 || MORPHING)
+    DUNE_THROW(Dune::NotImplemented, "Ensemble members can not refine or deform the shared grid");
+
+  // each member gets its own parameters, solution and boundary state
+  std::vector<IpbsContext*> members = ensemble_members(config_file, context, helper.rank());
+  const DeleteAll<IpbsContext> deleteMembers(members);
+
+  PGMap boundaryIndexToEntity;
+  PGMap elementIndexToEntity;
+  std::auto_ptr<GridType> grid(ipbs_read_mesh<GridType>(context, helper,
+      elementIndexToEntity, boundaryIndexToEntity));
+
+  int failed = 0;
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    try {
+      ipbs_solve<GridType, maxk>(*members[i], grid.get(), elementIndexToEntity,
+          boundaryIndexToEntity);
+    }
+    catch (Dune::Exception& e) {
+      // the other processes of the group may wait in a collective operation
+      if (helper.size() > 1 && dynamic_cast<GroupFailure*>(&e) == 0)
+        throw;
+      std::cerr << "Ensemble member " << i << " (" << key << " = " << values[i] << ") failed: "
+        << e << std::endl;
+      failed++;
+    }
+    delete members[i];
+    members[i] = 0;
+  }
+  if (failed > 0)
+    DUNE_THROW(Dune::Exception, failed << " of " << members.size() << " ensemble members failed");
+}
+
+#if LOCKSTEP
+// ------------------------------------------------------------------------
+/// Solve K members of an ensemble together on blocked vectors
+// ------------------------------------------------------------------------
+/*!
+   The members share the grid, the function space and the Newton solver, the
+   first member provides the settings of the solver. Each member keeps its own
+   IPBS iteration, which are updated together until all of them converged.
+   Only the first active members write output, the others pad the batch.
+
+   \param k polynomial degree
+   \param K number of members, the block size of the vectors
+*/
+template<class GridType, typename PGMap, int k, int K>
+void ipbs_lockstep_Pk(const std::vector<IpbsContext*>& members, const size_t active,
+                      GridType* grid, const PGMap& elementIndexToEntity,
+                      const PGMap& boundaryIndexToEntity)
+{
+  IpbsContext& context = *members[0];
+  SysParams& sysParams = context.sysParams;
+
+  Dune::Timer timer;
+
+  typedef typename GridType::LeafGridView GV;
+  const GV& gv = grid->leafView();
+  typedef typename GV::Grid::ctype ctype;
+  const int dim = GV::dimension;
+
+  // the types of the boundaries and the Dirichlet values are those of all members
+  typedef Regions<GV,double,std::vector<int> > M;
+  M m(gv, elementIndexToEntity);
+  typedef BCTypeParam<std::vector<int> > B;
+  B b(context, boundaryIndexToEntity);
+  typedef BCExtension<GV,double,std::vector<int> > G;
+  G g(context, gv, boundaryIndexToEntity);
+
+#if GRIDDIM == 2
+  typedef Dune::PDELab::Pk2DLocalFiniteElementMap<GV, ctype, Real, k> FEM;
+#elif GRIDDIM == 3
+  typedef Dune::PDELab::Pk3DLocalFiniteElementMap<GV, ctype, Real, k> FEM;
+#endif
+  FEM fem(gv);
+  typedef Dune::PDELab::ConformingDirichletConstraints CON;
+  CON con;
+
+  // scalar space of a single member, for the boundary iteration and the output
+  typedef Dune::PDELab::GridFunctionSpace<GV,FEM,CON,Dune::PDELab::ISTLVectorBackend<1> > GFS;
+  GFS gfs(gv,fem,con);
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+
+  // the members are the components of a blocked space
+  typedef Dune::PDELab::GridFunctionSpace<GV,FEM,CON,Dune::PDELab::ISTLVectorBackend<K> > BGFS;
+  BGFS bgfs(gv,fem,con);
+  typedef Dune::PDELab::PowerGridFunctionSpace<BGFS,K,
+          Dune::PDELab::GridFunctionSpaceBlockwiseMapper> PGFS;
+  PGFS pgfs(bgfs);
+  typedef typename Dune::PDELab::BackendVectorSelector<PGFS,Real>::Type PU;
+  PU u(pgfs,0.0);
+
+  typedef typename PGFS::template ConstraintsContainer<Real>::Type CC;
+  CC cc;
+  Dune::PDELab::PowerConstraintsParameters<B,K> pb(b);
+  Dune::PDELab::constraints(pb,pgfs,cc);
+  std::cout << "constrained dofs=" << cc.size()
+            << " of " << pgfs.globalSize() << " for " << K << " members" << std::endl;
+
+  PU ug(pgfs,0.0);
+  U uc(gfs,0.0);
+  Dune::PDELab::interpolate(g,gfs,uc);
+  for (int c = 0; c < K; c++)
+    lockstep_set_component(ug, c, uc);
+
+  // each member iterates its own boundary values
+  typedef Ipbsolver<GV, GFS> Ipbs;
+  typedef BoundaryFlux<GV,double,std::vector<int>, Ipbs > J;
+  typedef PBLocalOperator<M,B,J> MemberLOP;
+  std::vector<Ipbs*> ipbs(K);
+  std::vector<J*> j(K);
+  std::vector<MemberLOP*> lops(K);
+  for (int c = 0; c < K; c++)
+  {
+    ipbs[c] = new Ipbs(*members[c], gv, gfs, boundaryIndexToEntity, 1);
+    j[c] = new J(*members[c], gv, boundaryIndexToEntity, *ipbs[c]);
+    lops[c] = new MemberLOP(*members[c], m, b, *j[c], k+1);
+    if (sysParams.get_initialGuess() == 1)
+    {
+      typedef DebyeHueckelGuess<GV,Real> DH;
+      const DH dh(*members[c], gv, *ipbs[c]);
+      Dune::PDELab::interpolate(dh,gfs,uc);
+      ipbs[c]->initial_guess(dh);
+      lockstep_set_component(u, c, uc);
+    }
+  }
+  Dune::PDELab::copy_constrained_dofs(cc,ug,u);
+
+  typedef LockstepLocalOperator<MemberLOP,K> LOP;
+  LOP lop(lops);
+  typedef Dune::PDELab::ISTLBCRSMatrixBackend<K,K> MBE;
+  typedef Dune::PDELab::GridOperator<PGFS,PGFS,LOP,MBE,
+                                    Real,Real,Real,CC,CC> GO;
+  GO go(pgfs,cc,pgfs,cc,lop);
+
+  typedef Dune::PDELab::ISTLBackend_SEQ_BCGS_SSOR LS;
+  LS ls(5000, true);
+  typedef Dune::PDELab::Newton<GO,LS,PU> NEWTON;
+  NEWTON newton(go,u,ls);
+  newton.setLineSearchStrategy(newton.hackbuschReuskenAcceptBest);
+  newton.setVerbosityLevel(sysParams.get_verbose());
+  newton.setMinLinearReduction(1e-9);
+  newton.setMaxIterations(100);
+  newton.setLineSearchMaxIterations(50);
+
+  typedef LockstepValues<PGFS,PU> Values;
+  const Values values(pgfs, u);
+
+  double inittime = timer.elapsed();
+  double solvertime = 0.;
+  double itertime = 0.;
+
+  std::vector<double> fluxError(K), icError(K);
+  int iterations = 0;
+  bool converged = false;
+  for (int counter = 0; !converged && counter < sysParams.get_maxiter(); counter++)
+  {
+    timer.reset();
+    try{
+        newton.apply();
+    }
+    catch (Dune::Exception &e){
+        std::cerr << "Dune reported error: " << e << std::endl;
+        break;
+    }
+    solvertime += timer.elapsed();
+
+    timer.reset();
+    Ipbs::updateChargeRegulation(ipbs, values);
+    Ipbs::updateBC(ipbs, values);
+    itertime += timer.elapsed();
+
+    converged = true;
+    for (int c = 0; c < K; c++)
+      if (!ipbs[c]->converged(fluxError[c], icError[c], iterations))
+        converged = false;
+  }
+
+  // <<<6>>> output of each member
+  typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+  typedef IpbsAnalysis<GV,GFS,std::vector<int> , Ipbs> Analyzer;
+  for (size_t c = 0; c < active; c++)
+  {
+    const std::string name = members[c]->sysParams.get_outname();
+    std::stringstream status;
+    status << "# reached convergence criterion: " << std::boolalpha << converged << std::endl
+        << "# in iteration " << iterations << std::endl
+        << "# maximum relative change in boundary condition calculation is " << fluxError[c] << std::endl
+        << "# maximum relative change in induced charge density is " << icError[c] << std::endl;
+
+    lockstep_component(u, c, uc);
+    DGF udgf(gfs,uc);
+    Dune::VTKWriter<GV> vtkwriter(gv,Dune::VTKOptions::conforming);
+    vtkwriter.addVertexData(new Dune::PDELab::VTKGridFunctionAdapter<DGF>(udgf,"solution"));
+    vtkwriter.write((name + "_solution").c_str(), Dune::VTK::appendedraw);
+    DataWriter<GV,dim> mydatawriter(*members[c], gv);
+    mydatawriter.writeIpbsCellData(gfs, uc, "solution", name + "_solution", status);
+
+    const Analyzer analyzer(*members[c], gv, gfs, boundaryIndexToEntity, *ipbs[c]);
+    analyzer.forces(uc, name + "_forces.dat");
+    analyzer.surfacepot(uc, name + "_surface_potential.dat");
+    analyzer.E_ext(uc, name + "_e_ext.dat");
+  }
+
+  std::cout << "K: " << K << " N: " << elementIndexToEntity.size() << " M: " << ipbs[0]->get_n()
+    << " init: " << inittime << " solver: " << solvertime/iterations
+    << " boundary update " << itertime/iterations << std::endl;
+
+  for (int c = 0; c < K; c++) {
+    delete lops[c];
+    delete j[c];
+    delete ipbs[c];
+  }
+}
+
+// ------------------------------------------------------------------------
+/// Solve an ensemble of problems on one mesh in batches of K members
+// ------------------------------------------------------------------------
+/*!
+   The members are given by the key holding a list of values, see
+   ensemble_members(). A last batch with less than K members is padded with
+   copies of its last member. Only sequential runs with the highest compiled
+   degree and without refinement are supported.
+
+   \param maxk highest polynomial degree compiled into this executable
+   \param K number of members solved together
+*/
+template<class GridType, int maxk, int K>
+void ipbs_lockstep(const std::string& config_file, IpbsContext& context, const ProcessGroup& helper)
+{
+  typedef std::vector<int> PGMap;
+  SysParams& sysParams = context.sysParams;
+  if (helper.size() > 1)
+    DUNE_THROW(Dune::NotImplemented, "Lock-step ensembles are solved sequentially");
+  if (sysParams.get_refinementSteps() > 0 || sysParams.get_nestedLevels() > 0 || MORPHING)
+    DUNE_THROW(Dune::NotImplemented, "Lock-step ensembles can not refine or deform the grid");
+  if ((sysParams.get_degree() > 0 && sysParams.get_degree() != maxk)
+      || sysParams.get_pContinuation())
+    DUNE_THROW(Dune::NotImplemented, "Lock-step ensembles are solved with PDEGREE=" << maxk);
+  if (sysParams.get_restart() || !sysParams.get_warmStart().empty())
+    DUNE_THROW(Dune::NotImplemented, "Lock-step ensembles start from the default initial guess");
+
+  std::vector<IpbsContext*> members = ensemble_members(config_file, context, helper.rank());
+  const DeleteAll<IpbsContext> deleteMembers(members);
+
+  PGMap boundaryIndexToEntity;
+  PGMap elementIndexToEntity;
+  std::auto_ptr<GridType> grid(ipbs_read_mesh<GridType>(context, helper,
+      elementIndexToEntity, boundaryIndexToEntity));
+
+  for (size_t first = 0; first < members.size(); first += K)
+  {
+    const size_t active = std::min(size_t(K), members.size() - first);
+    std::vector<IpbsContext*> batch(K);
+    for (size_t c = 0; c < size_t(K); c++)
+      batch[c] = members[first + std::min(c, active-1)];
+    std::cout << "Solving members " << first << " to " << first+active-1
+      << " in lock-step" << std::endl;
+    ipbs_lockstep_Pk<GridType, PGMap, maxk, K>(batch, active, grid.get(), elementIndexToEntity,
+        boundaryIndexToEntity);
+  }
+}
+#endif
@@ -10,11 +10,7 @@
 #include <dune/common/fvector.hh>
 
 #include "maxwelltensor.hh"
-#include "sysparams.hh"
-#include "boundary.hh"
-
-extern SysParams sysParams;
-extern std::vector<Boundary*> boundary;
+#include "context.hh"
 
 template <class GV, class GFS, typename PGMap, class IPBSolver>
 class IpbsAnalysis
@@ -28,8 +24,10 @@ class IpbsAnalysis
 
   public:
 
-    IpbsAnalysis(const GV& _gv, const GFS& _gfs, const PGMap& _pgmap, const IPBSolver& ipbsolver_)
-      : gv(_gv), gfs(_gfs), pgmap(_pgmap), communicator( gv.comm() ), ipbsolver(ipbsolver_) {} 
+    IpbsAnalysis(IpbsContext& context, const GV& _gv, const GFS& _gfs, const PGMap& _pgmap,
+        const IPBSolver& ipbsolver_)
+      : sysParams(context.sysParams), boundary(context.boundary),
+        gv(_gv), gfs(_gfs), pgmap(_pgmap), communicator( gv.comm() ), ipbsolver(ipbsolver_) {} 
 
      typedef typename GV::template Codim<0>::template Partition
               <Dune::Interior_Partition>::Iterator LeafIterator;
@@ -59,37 +57,7 @@ class IpbsAnalysis
       {
         if (communicator.rank() == 0)
           std::cout << "Calculating the force acting on particle id " << i << std::endl;
-        Dune::FieldVector<Real, dim> F(0);
-  
-        for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
-                 	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
-        {
-          if(it->hasBoundaryIntersections() == true) {
-            for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii) {
-              if(ii->boundary() == true) {
-                if ( pgmap[ii->boundarySegmentIndex()] == (int)i ) // check if IPBS boundary
-                {
-                  Dune::FieldVector<Real, dim> normal = ii->centerUnitOuterNormal();
-                  Dune::FieldVector<Real, dim> forcevec;
-                  normal *= -1.0 * ii->geometry().volume(); // Surface normal
-                  Dune::FieldVector<Real, dim> evalPos = ii->geometry().center();
-                  Dune::FieldMatrix<Real, dim, dim> sigma = maxwelltensor(gfs, it, evalPos, u);
-                  //sigma.umv(normal, F);
-                  sigma.mv(normal, forcevec);
-                  if (sysParams.get_symmetry() > 0) {
-                    // integration in theta
-                    forcevec *= 2.*sysParams.pi*evalPos[1]; 
-                  }
-                  F += forcevec;
-                  vector_force_file << evalPos << " " << forcevec << std::endl;
-                }
-              }
-            }
-          }
-        }
-        // Sum up force of all nodes
-        communicator.barrier();
-        communicator.sum(&F[0], F.dim());
+        Dune::FieldVector<Real, dim> F = force(u, i, &vector_force_file);
         if (communicator.rank() == 0)
           force_file << i << " " << F << std::endl;        
       }
@@ -101,60 +69,110 @@ class IpbsAnalysis
       }
     }
 
+    // ------------------------------------------------------------------------
+    /// Force acting on one particle, summed over all nodes
+    // ------------------------------------------------------------------------
+    /*!
+       \param vector_force_file optionally receives the force on each surface element
+    */
+    Dune::FieldVector<Real, dim> force(const U& u, size_t i,
+        std::ostream* vector_force_file = 0) const
+    {
+      Dune::FieldVector<Real, dim> F(0);
+
+      for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+               	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+      {
+        if(it->hasBoundaryIntersections() == true) {
+          for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii) {
+            if(ii->boundary() == true) {
+              if ( pgmap[ii->boundarySegmentIndex()] == (int)i ) // check if IPBS boundary
+              {
+                Dune::FieldVector<Real, dim> normal = ii->centerUnitOuterNormal();
+                Dune::FieldVector<Real, dim> forcevec;
+                normal *= -1.0 * ii->geometry().volume(); // Surface normal
+                Dune::FieldVector<Real, dim> evalPos = ii->geometry().center();
+                Dune::FieldMatrix<Real, dim, dim> sigma = maxwelltensor(sysParams, gfs, it, evalPos, u);
+                //sigma.umv(normal, F);
+                sigma.mv(normal, forcevec);
+                if (sysParams.get_symmetry() > 0) {
+                  // integration in theta
+                  forcevec *= 2.*sysParams.pi*evalPos[1]; 
+                }
+                F += forcevec;
+                if (vector_force_file)
+                  *vector_force_file << evalPos << " " << forcevec << std::endl;
+              }
+            }
+          }
+        }
+      }
+      // Sum up force of all nodes
+      communicator.barrier();
+      communicator.sum(&F[0], F.dim());
+      return F;
+    }
+
     // ------------------------------------------------------------------------
     /// Average surface potential (useful for many testcases)
     // ------------------------------------------------------------------------
     
     void surfacepot(const U& u, std::string filename) const
     {
-      std::ofstream pot_file;
-
+      const std::vector<double> potentials = surfacePotentials(u);
       if (gv.comm().rank() ==0) {
-        pot_file.open( filename.c_str() );
-        
-        typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
-        DGF udgf(gfs,u);
-        
-        typedef typename DGF::Traits::RangeType RT;
-  
-        for (unsigned int i = 0; i < sysParams.get_npart(); i++)
-        {
-          int nElems = 0;
-          double sum = 0.;
-          for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
-                 	it!=gv.template end<0,Dune::Interior_Partition>(); ++it) {
-            if(it->hasBoundaryIntersections() == true) {
-              for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii) {
-                if(ii->boundary() == true) {
-                  if (pgmap[ii->boundarySegmentIndex()] == int(i)) {
-                    Dune::FieldVector<Real, dim> evalPos = ii->geometry().center();
-                    Dune::FieldVector<double,GFS::Traits::GridViewType::dimension> local =
-                      it->geometry().local(evalPos);
-                    RT value;
-                    // evaluate the potential
-                    udgf.evaluate(*it, local, value);
-                    sum += value;
-                    nElems++;
-                  }
-                }
+        std::ofstream pot_file(filename.c_str());
+        for (unsigned int i = 0; i < potentials.size(); i++)
+          pot_file << i << " " << potentials[i] << std::endl;
+      }
+    }
+
+    /// Surface potential of each particle, averaged over its boundary elements on all nodes
+    std::vector<double> surfacePotentials(const U& u) const
+    {
+      typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+      DGF udgf(gfs,u);
+      typedef typename DGF::Traits::RangeType RT;
+
+      // sums and numbers of elements of all particles, reduced at once
+      const size_t n = sysParams.get_npart();
+      std::vector<double> sums(2*n, 0.);
+      for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+             	it!=gv.template end<0,Dune::Interior_Partition>(); ++it) {
+        if(it->hasBoundaryIntersections() == true) {
+          for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii) {
+            if(ii->boundary() == true) {
+              const int i = pgmap[ii->boundarySegmentIndex()];
+              if (i >= 0 && size_t(i) < n) {
+                Dune::FieldVector<Real, dim> evalPos = ii->geometry().center();
+                Dune::FieldVector<double,GFS::Traits::GridViewType::dimension> local =
+                  it->geometry().local(evalPos);
+                RT value;
+                // evaluate the potential
+                udgf.evaluate(*it, local, value);
+                sums[i] += value;
+                sums[n+i] += 1.;
               }
             }
           }
-          sum /= nElems;
-          //boundary[i]->set_res_surface_pot(sum);
-          pot_file << i << " " << sum << std::endl;
         }
       }
+      if (n > 0)
+        communicator.sum(&sums[0], 2*n);
+      std::vector<double> potentials(n);
+      for (size_t i = 0; i < n; i++)
+        potentials[i] = sums[i] / sums[n+i];
+      return potentials;
     }
 
     // ------------------------------------------------------------------------
-    /// Determine the system's electrostatic energy
+    /// Determine the system's electrostatic energy, written to filename unless it is empty
     // ------------------------------------------------------------------------
     double energy(const U&u, std::string filename) const {
 
       std::ofstream en_file;
 
-      if (gv.comm().rank() ==0) {
+      if (gv.comm().rank() ==0 && !filename.empty()) {
         en_file.open( filename.c_str() );
       }
       
@@ -214,7 +232,6 @@ class IpbsAnalysis
 
         local_energy = -(sysParams.get_lambda2i()/8./sysParams.pi/sysParams.get_bjerrum() ) // c_0
                               * (-sinh(value)*value + 2*(cosh(value)-1) )*it->geometry().volume();
-        std::cout << "local energy " << local_energy << std::endl;
         if (sysParams.get_symmetry() > 0) {
           local_energy *= 2. * sysParams.pi * evalPos[1];
         }
@@ -222,20 +239,25 @@ class IpbsAnalysis
 
       }
       communicator.sum(&energy,1);
-      if (communicator.rank() == 0) {
+      if (communicator.rank() == 0 && !filename.empty()) {
         en_file << energy << std::endl;
         en_file.close();
       }
+      return energy;
     }
     
     // ------------------------------------------------------------------------
     /// Print the external field at IPBS boundaries to file
     // ------------------------------------------------------------------------
     void E_ext(const U& u, std::string filename) const {
+        std::vector<double> field;
+        ipbsolver.gatherField(field);
+        if (communicator.rank() != 0)
+            return;
         std::ofstream E_ext_file;
         E_ext_file.open( filename.c_str() );
         for (unsigned int i=0; i<ipbsolver.ipbsPositions.size(); i++) {
-            E_ext_file << ipbsolver.ipbsPositions[i] << " " << ipbsolver.E_ext[i] << std::endl;
+            E_ext_file << ipbsolver.ipbsPositions[i] << " " << field[i] << std::endl;
         }
     }
     
@@ -354,6 +376,8 @@ class IpbsAnalysis
       return pieceName.str();
     }
 
+    SysParams& sysParams;
+    std::vector<Boundary*>& boundary;
     const GV& gv;
     /// The grid function space
     const GFS& gfs;
@@ -364,7 +388,7 @@ class IpbsAnalysis
     typedef typename GV::Traits::CollectiveCommunication CollectiveCommunication;
     const CollectiveCommunication & communicator;
 
-    const IPBSolver ipbsolver;
+    const IPBSolver& ipbsolver;
 };
 
 
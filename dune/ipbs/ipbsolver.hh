@@ -3,20 +3,39 @@
 
 #include <dune/grid/common/scsgmapper.hh> // Single Geometry Single Codim Mapper
 #include <dune/common/fvector.hh>
+#include <dune/common/timer.hh>
 #include <dune/geometry/quadraturerules.hh>
 
-#include "sysparams.hh"
-#include "boundary.hh"
+#include "context.hh"
 #include "e_field.hh"
+#include "ipbsstate.hh"
+#include "reduction.hh"
 
 #include <time.h>
 #include <dune/ipbs/ipbsanalysis.hh>
-extern SysParams sysParams;
-extern std::vector<Boundary*> boundary;
 
 //template <class GV, class GFS, typename PGMap, class IPBSolver>
 //class IpbsAnalysis;
 
+/// Values of one solution, the same for all problems of an update in Ipbsolver
+template<class DGF>
+class SolutionValues
+{
+  public:
+    SolutionValues(const DGF& dgf_) : dgf(dgf_) {}
+
+    template<class E, class X>
+    void evaluate(const E& e, const X& x, std::vector<double>& values) const
+    {
+      typename DGF::Traits::RangeType y;
+      dgf.evaluate(e, x, y);
+      values.assign(values.size(), y);
+    }
+
+  private:
+    const DGF& dgf;
+};
+
 template <class GV, class GFS>
 class Ipbsolver
 
@@ -36,14 +55,20 @@ class Ipbsolver
   typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
 
   public:
-    Ipbsolver(const GV& gv_, const GFS& gfs_,
+    /// Snapshot of the iterated boundary data
+    typedef IpbsState<ctype,dim> State;
+
+    Ipbsolver(IpbsContext& context, const GV& gv_, const GFS& gfs_,
         const std::vector<int>& boundaryIndexToEntity_, const int intorder_=1,
         const bool use_guess=true) :
+      sysParams(context.sysParams), boundary(context.boundary),
       gv(gv_), gfs(gfs_), boundaryIndexToEntity(boundaryIndexToEntity_),
       boundaryElemMapper(gv), communicator(gv.comm()), 
-      my_offset(0), my_len(0), iterationCounter(0), fluxError(0), intorder(intorder_)
+      my_offset(0), my_len(0), work_offset(0), work_len(0), reduction(gv_.comm()),
+      iterationCounter(0), fluxError(0), intorder(intorder_)
      
     /*!
+       \param context parameters and particles of the problem
        \param gv the view on the leaf grid
        \param boundaryIndexToEntity physical property of boundary elements
     */
@@ -57,9 +82,10 @@ class Ipbsolver
       init(); // Detect iterative elements
       communicateIpbsData(); 
 
-      bContainer.resize(ipbsPositions.size(),0);
+      bContainer.resize(my_len,0);
+      workFlux.resize(work_len,0);
       inducedChargeDensity.resize(ipbsPositions.size(),0);
-      E_ext.resize(ipbsPositions.size(),0);
+      E_ext.resize(work_len,0);
       /// Prepare container for storing the potential at each intersection
       regulatedChargeDensity.resize(ipbsPositions.size(), 0.);
 
@@ -76,8 +102,10 @@ class Ipbsolver
       iterationCounter++;
       if (communicator.rank() == 0) {
         std::cout << "in iteration " << iterationCounter << " the relative fluxError is " << fluxError
-          << " relative error in induced charge density is " << icError << std::endl;
+          << " relative error in induced charge density is " << icError
+          << " communication time " << reduction.time() << " s" << std::endl;
         }
+      reduction.resetTime();
       if ( std::max(fluxError, icError) < sysParams.get_tolerance() ) {
         return true;
       }
@@ -98,8 +126,10 @@ class Ipbsolver
       _iterations = iterationCounter;
       if (communicator.rank() == 0) {
         std::cout << "in iteration " << iterationCounter << " the relative fluxError is " << fluxError
-          << " relative error in induced charge density is " << icError << std::endl;
+          << " relative error in induced charge density is " << icError
+          << " communication time " << reduction.time() << " s" << std::endl;
       }
+      reduction.resetTime();
       if ( std::max(fluxError, icError) < sysParams.get_tolerance() ) {
         return true;
       }
@@ -110,8 +140,9 @@ class Ipbsolver
     template <typename I>
     double get_flux(const I& i) const
     {
-      int mappedIndex = indexLookupMap.find(boundaryElemMapper.map(*i.inside()))->second + my_offset;
-      double y = bContainer[mappedIndex];
+      // the values are stored by the owners of the elements only
+      int localIndex = indexLookupMap.find(boundaryElemMapper.map(*i.inside()))->second;
+      double y = bContainer[localIndex];
       return y;
     }
 
@@ -121,135 +152,450 @@ class Ipbsolver
 
     void updateBC(const U& u)
     {
+      /// Construct a discrete grid function space for access to solution
+      typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+      DGF udgf(gfs,u);
 
-      double d = sysParams.get_integration_d();
-      double l = sysParams.get_integration_l();
+      std::vector<Ipbsolver*> members(1, this);
+      updateBC(members, SolutionValues<DGF>(udgf));
+    }
 
-      ContainerType nearFieldCharge(ipbsPositions.size(), 0);
-      ContainerType nearFieldChargeArea(ipbsPositions.size(), 0);
+    // ------------------------------------------------------------------------
+    /// Update the boundary conditions of several problems on the same mesh
+    // ------------------------------------------------------------------------
+    /*!
+       The members differ only in their parameters (charges, salt), so the
+       grid is traversed and the kernel is evaluated once for all of them.
 
-      fluxError = 0;  // reset the fluxError for next iteration step
-      
-      /// Construct a discrete grid function space for access to solution
-      typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
-      typedef typename DGF::Traits::RangeType RT;
-      typedef typename DGF::Traits::DomainFieldType DF;
+       \param members boundary iterations set up on the same grid view
+       \param values provides evaluate(element, local, v), the solutions of
+                     all members at a point
+    */
+    template<class Values>
+    static void updateBC(const std::vector<Ipbsolver*>& members, const Values& values)
+    {
+      const Ipbsolver& mesh = *members[0];
+      SysParams& sysParams = mesh.sysParams;
 
-      DGF udgf(gfs,u);
+      for (size_t m = 0; m < members.size(); m++)
+        members[m]->beginUpdate();
+      std::vector<double> value(members.size());
 
       typedef typename GV::template Codim<0>::template Partition
               <Dune::Interior_Partition>::Iterator LeafIterator;
 
-      /// Store the new calculated values
-      ContainerType fluxes(ipbsPositions.size(),0.);
-
-      for (size_t i =0; i<E_ext.size(); i++) {
-          E_ext[i] = 0;
-      }
-      for (size_t i = 0; i < sysParams.get_npart(); i++){
-          physQIpbs[i] = 0;
-          efieldShift[i] = 0;
-      }
-
       // Loop over all elements and calculate the volume integral contribution
-      for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
-               	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+      for (LeafIterator it = mesh.gv.template begin<0,Dune::Interior_Partition>();
+               	it!=mesh.gv.template end<0,Dune::Interior_Partition>(); ++it)
       {
+        Dune::GeometryType gt = it->geometry().type();
 
         // For each element on this processor calculate the contribution to volume integral part of the flux
-        for (size_t i = 0; i < ipbsPositions.size(); i++)
+        for (size_t i = 0; i < mesh.ipbsPositions.size(); i++)
         {
-
           // select quadrature rule
-          Dune::GeometryType gt = it->geometry().type();
-          unsigned int io = (int) ceil( sysParams.get_integration_maxintorder()*pow(ipbsVolumes[i], 1./(dim-1)) / sqrt( (ipbsPositions[i]-it->geometry().center())*(ipbsPositions[i]-it->geometry().center())));
-          if (io>51)
-              io=51;
-          const Dune::QuadratureRule<DF,dim>& 
-            rule = Dune::QuadratureRules<DF,dim>::rule(gt,io);
+          const Dune::QuadratureRule<ctype,dim>& rule = Dune::QuadratureRules<ctype,dim>::rule(gt,
+              mesh.quadratureOrder(i, it->geometry().center()));
+
+          Dune::FieldVector<ctype,dim> r (mesh.ipbsPositions[i]);
+          Dune::FieldVector<ctype, dim> unitNormal(mesh.ipbsNormals[i]);
+          unitNormal *= -1.;
 
           // loop over quadrature points
-          for (typename Dune::QuadratureRule<DF,dim>::const_iterator 
+          for (typename Dune::QuadratureRule<ctype,dim>::const_iterator
                      q_it=rule.begin(); q_it!=rule.end(); ++q_it)
           {
-            double E_ext_ions = 0.;
             // Get the position vector of the this element's center
             Dune::FieldVector<ctype,dim> r_prime = it->geometry().global(q_it->position());
-            //Dune::FieldVector<ctype,dim> r_prime = it->geometry().center();
-                      
-            RT value;
-            udgf.evaluate(*it,q_it->position(),value);
-            //udgf.evaluate(*it,it->geometry().local(r_prime),value);
-            
-            double weight = q_it->weight() * it->geometry().integrationElement(q_it->position());
-            //double weight = it->geometry().volume();
+            values.evaluate(*it, q_it->position(), value);
 
-            Dune::FieldVector<ctype,dim> r (ipbsPositions[i]);
-            Dune::FieldVector<ctype, dim> unitNormal(ipbsNormals[i]);
-            unitNormal *= -1.;
+            double weight = q_it->weight() * it->geometry().integrationElement(q_it->position());
 
             Dune::FieldVector<ctype,dim> e_field(0.);
 
-            e_field = E_field<Dune::FieldVector<ctype,dim> ,Dune::FieldVector<ctype,dim> > 
+            e_field = E_field<Dune::FieldVector<ctype,dim> ,Dune::FieldVector<ctype,dim> >
                         (r, r_prime, sysParams.get_symmetry());
 
             e_field *= weight;
-            E_ext_ions = e_field * unitNormal;
-            E_ext_ions *= 1./ (4.0*sysParams.pi) * sysParams.get_lambda2i();
-
+            double kernel = e_field * unitNormal / (4.0*sysParams.pi);
             if ( sysParams.get_symmetry() > 0) {
-                E_ext_ions *= r_prime[1];
+                kernel *= r_prime[1];
             }
 
-            // Now get the counterion distribution and calculate flux
-            switch (sysParams.get_salt())
-            {
-                case 0:
-                    E_ext_ions *= -std::sinh(value);
-
-                    break;
-                case 1:
-                    E_ext_ions *= std::exp(value); // Counterions have opposite sign!
-                    break;
-            }
             double normaldist = (r_prime-r)*unitNormal;
             double scalardistsq =  (r_prime-r)* (r_prime-r);
-            if (normaldist < d && scalardistsq - normaldist*normaldist < l*l) {
-//            if (r_prime[0] < d && abs(r[1]-r_prime[1])<l) {
-                if (i==0 && sysParams.get_verbose() > 3)
-                    std::cout << "innerboxpoint " << l << " " << r_prime << std::endl;
-                E_ext_ions = 0;
-//                double nf =  sysParams.get_lambda2i()*0.0001*4*sysParams.pi*exp(-r_prime[0])*weight;
-                double nf =  sysParams.get_lambda2i()*std::sinh(value)*weight;
-                if ( sysParams.get_symmetry() > 0) {
-//                  nf *= r_prime[1];
-                }
-                nearFieldCharge[i] += nf;
-                nearFieldChargeArea[i] += weight;
-            } else {
-                if (i==0 && sysParams.get_verbose() > 3)
-                    std::cout << "integrationpoint " << r_prime << std::endl;
-            }
-            E_ext[i] += E_ext_ions;
-            if (sysParams.get_symmetry() == 0)
-              efieldShift[ ipbsType[i] ] -= E_ext_ions*ipbsVolumes[i];
-            else
-              efieldShift[ ipbsType[i] ] -= E_ext_ions*ipbsVolumes[i]*2*sysParams.pi*r[1];
+            for (size_t m = 0; m < members.size(); m++)
+              members[m]->volumeFlux(i, r_prime, kernel, weight, normaldist,
+                  scalardistsq - normaldist*normaldist, value[m]);
           }
         }
       }
 
-      communicator.sum( &nearFieldChargeArea[0], nearFieldChargeArea.size() );
-      communicator.sum( &nearFieldCharge[0], nearFieldCharge.size() );
+      for (size_t m = 0; m < members.size(); m++)
+        members[m]->finishUpdate();
+    }
+
+
+    // ------------------------------------------------------------------------
+    /// Cost of the volume integral of updateBC() over one element
+    // ------------------------------------------------------------------------
+    /*!
+       \param measured wall time of the kernel evaluations in seconds instead
+                       of their number
+    */
+    template<class E>
+    double elementCost(const E& e, bool measured) const
+    {
+      Dune::GeometryType gt = e.geometry().type();
+      const Dune::FieldVector<ctype,dim> center = e.geometry().center();
+      if (!measured)
+      {
+        double evaluations = 0;
+        for (size_t i = 0; i < ipbsPositions.size(); i++)
+          evaluations += Dune::QuadratureRules<ctype,dim>::rule(gt,
+              quadratureOrder(i, center)).size();
+        return evaluations;
+      }
+
+      Dune::Timer timer;
+      double sum = 0;
+      for (size_t i = 0; i < ipbsPositions.size(); i++)
+      {
+        const Dune::QuadratureRule<ctype,dim>& rule = Dune::QuadratureRules<ctype,dim>::rule(gt,
+            quadratureOrder(i, center));
+        for (typename Dune::QuadratureRule<ctype,dim>::const_iterator
+                   q_it=rule.begin(); q_it!=rule.end(); ++q_it)
+        {
+          Dune::FieldVector<ctype,dim> r_prime = e.geometry().global(q_it->position());
+          Dune::FieldVector<ctype,dim> e_field = E_field<Dune::FieldVector<ctype,dim>,
+            Dune::FieldVector<ctype,dim> >(ipbsPositions[i], r_prime, sysParams.get_symmetry());
+          sum += e_field * ipbsNormals[i] * q_it->weight()
+            * e.geometry().integrationElement(q_it->position());
+        }
+      }
+      // keep the evaluations from being optimized away
+      volatile double result = sum;
+      (void) result;
+      return timer.elapsed();
+    }
+
+    // ------------------------------------------------------------------------
+    /// Store the iterated boundary data
+    // ------------------------------------------------------------------------
+    /*!
+       Collective, the boundary values of all processes are collected into
+       the state.
+    */
+    void saveState(State& state) const
+    {
+      state.positions = ipbsPositions;
+      state.types = ipbsType;
+      state.bContainer.assign(ipbsPositions.size(), 0.);
+      std::copy(bContainer.begin(), bContainer.end(), state.bContainer.begin() + my_offset);
+      reduction.gatherRows(state.bContainer, ownedCounts);
+      state.inducedChargeDensity = inducedChargeDensity;
+      state.regulatedChargeDensity = regulatedChargeDensity;
+      state.efieldShift = efieldShift;
+      state.iterationCounter = iterationCounter;
+      state.invalidate();
+    }
+
+    // ------------------------------------------------------------------------
+    /// Load the iterated boundary data
+    // ------------------------------------------------------------------------
+    /*!
+       If the state was stored for a different boundary discretization, each
+       iterated boundary element takes the values of the nearest stored element
+       of the same physical group.
+    */
+    void restoreState(const State& state)
+    {
+      if (state.size() == ipbsPositions.size() && state.types == ipbsType) {
+        for (size_t i = 0; i < ipbsPositions.size(); i++)
+          setFlux(i, state.bContainer[i]);
+        inducedChargeDensity = state.inducedChargeDensity;
+        regulatedChargeDensity = state.regulatedChargeDensity;
+      }
+      else {
+        for (size_t i = 0; i < ipbsPositions.size(); i++) {
+          int n = state.nearest(ipbsPositions[i], ipbsType[i]);
+          if (n < 0)
+            continue;
+          setFlux(i, state.bContainer[n]);
+          inducedChargeDensity[i] = state.inducedChargeDensity[n];
+          regulatedChargeDensity[i] = state.regulatedChargeDensity[n];
+        }
+      }
+      if (state.efieldShift.size() == efieldShift.size())
+        efieldShift = state.efieldShift;
+      iterationCounter = state.iterationCounter;
+    }
+
+    // ------------------------------------------------------------------------
+    /// Area weighted centers and areas of the iterated physical groups
+    // ------------------------------------------------------------------------
+    void groupGeometry(std::vector<Dune::FieldVector<ctype,dim> >& centers,
+                       std::vector<double>& areas) const
+    {
+      centers.assign( sysParams.get_npart(), Dune::FieldVector<ctype,dim>(0.) );
+      areas.assign( sysParams.get_npart(), 0. );
+      for (size_t i = 0; i < ipbsPositions.size(); i++) {
+        double area = ipbsVolumes[i];
+        if (sysParams.get_symmetry() > 0)
+          area *= 2. * sysParams.pi * ipbsPositions[i][1];
+        centers[ipbsType[i]].axpy(area, ipbsPositions[i]);
+        areas[ipbsType[i]] += area;
+      }
+      for (size_t p = 0; p < centers.size(); p++) {
+        if (areas[p] > 0)
+          centers[p] /= areas[p];
+        // rotationally symmetric particles are centered on the axis
+        if (sysParams.get_symmetry() > 0)
+          centers[p][1] = 0;
+      }
+    }
+
+    // ------------------------------------------------------------------------
+    /// Initial guess for the iterative boundaries from a model of the field
+    // ------------------------------------------------------------------------
+    /*!
+       \param model provides flux(position, normal, type), the boundary
+                    flux at the center of an iterated boundary element
+    */
+    template<class Model>
+    void initial_guess(const Model& model)
+    {
+      for (size_t i = 0; i < ipbsPositions.size(); i++)
+        if (holdsFlux(i))
+          setFlux(i, model.flux(ipbsPositions[i], ipbsNormals[i], ipbsType[i]));
+    }
 
-      unsigned int target = my_offset + my_len;
-      // For each element on this processor calculate the contribution to surface integral part of the flux
-      for (unsigned int i = my_offset; i < target; i++)
+    // ------------------------------------------------------------------------
+    /// External field at all iterated boundary elements, on rank 0 only
+    // ------------------------------------------------------------------------
+    /*!
+       Collective, each process holds the field of the rows it updates.
+    */
+    void gatherField(std::vector<double>& field) const
+    {
+      reduction.gatherRowsToRoot(E_ext, field, workCounts);
+    }
+
+    // ------------------------------------------------------------------------
+    /// Rebuild the boundary data after the grid has been modified
+    // ------------------------------------------------------------------------
+    /*!
+       Detects the iterated boundary elements of the current leaf grid again and
+       transfers the iteration state from the old to the new boundary elements.
+       If only the geometry changed (mesh morphing) the state is kept per element.
+    */
+    void reinit()
+    {
+      State state;
+      saveState(state);
+
+      ipbsPositions.clear();
+      ipbsNormals.clear();
+      ipbsVolumes.clear();
+      ipbsType.clear();
+      ipbsElemPointers.clear();
+      indexLookupMap.clear();
+      physArea.assign( sysParams.get_npart(), 0 );
+      physQTot.assign( sysParams.get_npart(), 0 );
+      my_offset = 0;
+      my_len = 0;
+
+      init();
+      communicateIpbsData();
+
+      bContainer.assign(my_len,0);
+      workFlux.assign(work_len,0);
+      inducedChargeDensity.assign(ipbsPositions.size(),0);
+      E_ext.assign(work_len,0);
+      regulatedChargeDensity.assign(ipbsPositions.size(), 0.);
+
+      restoreState(state);
+    }
+
+    // ------------------------------------------------------------------------
+    /// Charge regulation calculation
+    // ------------------------------------------------------------------------
+    void updateChargeRegulation(const U& u)
+    { 
+      /// Construct a discrete grid function space for access to solution
+      typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+      DGF udgf(gfs,u);
+
+      std::vector<Ipbsolver*> members(1, this);
+      updateChargeRegulation(members, SolutionValues<DGF>(udgf));
+    }
+
+    /// Charge regulation of several problems on the same mesh, see updateBC(members, values)
+    template<class Values>
+    static void updateChargeRegulation(const std::vector<Ipbsolver*>& members,
+        const Values& values)
+    {
+      const Ipbsolver& mesh = *members[0];
+      std::vector<double> value(members.size());
+
+      for ( size_t i = 0; i < mesh.ipbsElemPointers.size(); i++)
+      {
+        // Calculate regulated charge density
+        ElemPointer it = mesh.ipbsElemPointers[i];
+        const size_t row = mesh.my_offset + i;
+        Dune::FieldVector<ctype, dim> local = it->geometry().local( mesh.ipbsPositions[row] );
+        values.evaluate(*it, local, value);
+        for (size_t m = 0; m < members.size(); m++)
+          members[m]->regulate(row, value[m]);
+      }
+      // the surface loop needs the charges of all elements
+      for (size_t m = 0; m < members.size(); m++)
+        members[m]->reduction.gatherRows(members[m]->regulatedChargeDensity, mesh.ownedCounts);
+    }
+
+
+
+   // ------------------------------------------------------------------------
+  
+  protected:
+    template <typename I>
+    double get_lcd(const I& i) const
+    {
+      int mappedIndex = indexLookupMap.find(boundaryElemMapper.map(*i.inside()))->second + my_offset;
+      double lcd = 0;
+      if ( boundary[ boundaryIndexToEntity[i.boundarySegmentIndex()] ]->get_type() == 2) {
+        lcd = boundary[ipbsType[mappedIndex]]->get_charge_density() 
+                        + inducedChargeDensity[mappedIndex];
+                        + regulatedChargeDensity[mappedIndex]; /**< The local charge density 
+                                                     on this particular surface element */
+      }
+      return lcd;
+    }
+
+  // ------------------------------------------------------------------------ 
+
+
+  private:
+
+    // ------------------------------------------------------------------------
+    /// Reset the quantities accumulated in updateBC()
+    // ------------------------------------------------------------------------
+    void beginUpdate()
+    {
+      fluxError = 0;  // reset the fluxError for next iteration step
+      nearFieldCharge.assign(ipbsPositions.size(), 0);
+      nearFieldChargeArea.assign(ipbsPositions.size(), 0);
+      volumeField.assign(ipbsPositions.size(), 0);
+      for (size_t i = 0; i < sysParams.get_npart(); i++){
+          physQIpbs[i] = 0;
+          efieldShift[i] = 0;
+      }
+    }
+
+    // ------------------------------------------------------------------------
+    /// Contribution of the ions at one quadrature point to the field on boundary element i
+    // ------------------------------------------------------------------------
+    /*!
+       \param kernel normal component of the field of a unit charge at r_prime,
+                     including the quadrature weight and the metric
+       \param lateraldistsq squared distance of r_prime from the normal through element i
+       \param value the potential at r_prime
+    */
+    void volumeFlux(size_t i, const Dune::FieldVector<ctype,dim>& r_prime, double kernel,
+        double weight, double normaldist, double lateraldistsq, double value)
+    {
+      double d = sysParams.get_integration_d();
+      double l = sysParams.get_integration_l();
+
+      double E_ext_ions = kernel * sysParams.get_lambda2i();
+
+      // Now get the counterion distribution and calculate flux
+      switch (sysParams.get_salt())
+      {
+          case 0:
+              E_ext_ions *= -std::sinh(value);
+
+              break;
+          case 1:
+              E_ext_ions *= std::exp(value); // Counterions have opposite sign!
+              break;
+          case 2:
+              E_ext_ions *= -value;   // linearized, as the PB equation
+              break;
+      }
+      if (normaldist < d && lateraldistsq < l*l) {
+          if (i==0 && sysParams.get_verbose() > 3)
+              std::cout << "innerboxpoint " << l << " " << r_prime << std::endl;
+          E_ext_ions = 0;
+          double nf =  sysParams.get_lambda2i()*weight
+              * (sysParams.get_salt() == 2 ? value : std::sinh(value));
+          nearFieldCharge[i] += nf;
+          nearFieldChargeArea[i] += weight;
+      } else {
+          if (i==0 && sysParams.get_verbose() > 3)
+              std::cout << "integrationpoint " << r_prime << std::endl;
+      }
+      volumeField[i] += E_ext_ions;
+      if (sysParams.get_symmetry() == 0)
+        efieldShift[ ipbsType[i] ] -= E_ext_ions*ipbsVolumes[i];
+      else
+        efieldShift[ ipbsType[i] ] -= E_ext_ions*ipbsVolumes[i]*2*sysParams.pi*ipbsPositions[i][1];
+    }
+
+    // ------------------------------------------------------------------------
+    /// Surface contributions, induced charges and the new boundary values
+    // ------------------------------------------------------------------------
+    void finishUpdate()
+    {
+      double d = sysParams.get_integration_d();
+      const size_t n = ipbsPositions.size();
+      const size_t npart = sysParams.get_npart();
+
+      // The rows are split evenly over the processes, independent of who owns the elements
+      unsigned int target = work_offset + work_len;
+
+      /// Store the new calculated values of the rows
+      ContainerType fluxes(work_len,0.);
+
+      // precalculate the shift for the induced charges 
+      for (unsigned int i = work_offset; i < target; i++) 
+      {
+        double thisChargeDensity = boundary[ipbsType[i]]->get_charge_density() 
+                                  + inducedChargeDensity[i] + regulatedChargeDensity[i];
+        double thisCharge = 0;
+        if (sysParams.get_symmetry() > 0)
+          thisCharge = 2 * sysParams.pi * ipbsPositions[i][1] * ipbsVolumes[i] * thisChargeDensity;
+        else
+          thisCharge = ipbsVolumes[i] * thisChargeDensity;
+
+        physQIpbs[ ipbsType[i] ] += thisCharge;
+
+        // This assumes we can use the induced charges of the previous iteration
+        efieldShift[ ipbsType[i] ] += 2. * sysParams.get_bjerrum()* sysParams.pi * thisCharge; 
+      }
+
+      // Collect the volume integrals of the rows and the charges from all nodes,
+      // while the surface integrals are calculated
+      ContainerType volume(3*n), volumeRows;
+      for (size_t i = 0; i < n; i++) {
+        volume[3*i] = volumeField[i];
+        volume[3*i+1] = nearFieldCharge[i];
+        volume[3*i+2] = nearFieldChargeArea[i];
+      }
+      reduction.startSumRows(volume, volumeRows, workCounts, 3);
+      ContainerType charges(physQIpbs.begin(), physQIpbs.end());
+      charges.insert(charges.end(), efieldShift.begin(), efieldShift.end());
+      reduction.startSum(charges);
+
+      ContainerType surfaceFlux(work_len, 0.);
+      ContainerType surfaceShift(npart, 0.);
+      // For each row of this processor calculate the contribution to surface integral part of the flux
+      for (unsigned int i = work_offset; i < target; i++)
       {
         Dune::FieldVector<ctype,dim> r (ipbsPositions[i]);
         Dune::FieldVector<ctype, dim> unitNormal(ipbsNormals[i]);
         unitNormal *= -1.;
-        for (size_t j = 0; j < ipbsPositions.size(); j++)
+        for (size_t j = 0; j < n; j++)
         {
           double surfaceElem_flux = 0.;
           double lcd = boundary[ipbsType[j]]->get_charge_density() 
@@ -285,62 +631,46 @@ class Ipbsolver
               surfaceElem_flux *= r_prime2[1];
               surfaceElem_flux *= lcd;
           }
-          E_ext[i] += surfaceElem_flux;
+          surfaceFlux[i-work_offset] += surfaceElem_flux;
           if (sysParams.get_symmetry() == 0)
-            efieldShift[ ipbsType[i] ] -= surfaceElem_flux*ipbsVolumes[i];
+            surfaceShift[ ipbsType[i] ] -= surfaceElem_flux*ipbsVolumes[i];
           else
-            efieldShift[ ipbsType[i] ] -= surfaceElem_flux*ipbsVolumes[i]*2*sysParams.pi*r[1];
+            surfaceShift[ ipbsType[i] ] -= surfaceElem_flux*ipbsVolumes[i]*2*sysParams.pi*r[1];
         } // end of j loop
       } // end of i loop
 
-      communicator.barrier();
-      for (unsigned int i = my_offset; i<target; i++) {
+      reduction.wait();
+      std::copy(charges.begin(), charges.begin()+npart, physQIpbs.begin());
+      std::copy(charges.begin()+npart, charges.end(), efieldShift.begin());
+      // updateIC() needs the complete shift
+      reduction.sum(surfaceShift);
+      for (size_t p = 0; p < npart; p++)
+        efieldShift[p] += surfaceShift[p];
+
+      for (unsigned int i = work_offset; i<target; i++) {
+        const size_t k = i - work_offset;
+        nearFieldCharge[i] = volumeRows[3*k+1];
+        nearFieldChargeArea[i] = volumeRows[3*k+2];
+        E_ext[k] = volumeRows[3*k] + surfaceFlux[k];
         if (nearFieldChargeArea[i] > 0) 
         {
-          E_ext[i] += sysParams.pi/sysParams.get_bjerrum()
+          E_ext[k] += sysParams.pi/sysParams.get_bjerrum()
                  *nearFieldCharge[i]*d/(2*sysParams.pi)/nearFieldChargeArea[i];
         }
       }
-
-      // Collect results from all nodes
-      communicator.barrier();
-      communicator.sum(&E_ext[0], fluxes.size());
-     
-      // precalculate the shift for the induced charges 
-      for (unsigned int i = my_offset; i < target; i++) 
-      {
-        double thisChargeDensity = boundary[ipbsType[i]]->get_charge_density() 
-                                  + inducedChargeDensity[i] + regulatedChargeDensity[i];
-        double thisCharge = 0;
-        if (sysParams.get_symmetry() > 0)
-          thisCharge = 2 * sysParams.pi * ipbsPositions[i][1] * ipbsVolumes[i] * thisChargeDensity;
-        else
-          thisCharge = ipbsVolumes[i] * thisChargeDensity;
-
-        physQIpbs[ ipbsType[i] ] += thisCharge;
-
-        // This assumes we can use the induced charges of the previous iteration
-        efieldShift[ ipbsType[i] ] += 2. * sysParams.get_bjerrum()* sysParams.pi * thisCharge; 
-      }
       
       // update the induced charge
       updateIC();
         
-      for (unsigned int i = my_offset; i < target; i++) {
+      for (unsigned int i = work_offset; i < target; i++) {
 
         double thisChargeDensity = boundary[ipbsType[i]]->get_charge_density() 
                                   + inducedChargeDensity[i] + regulatedChargeDensity[i];
 
         /* Equation 3.4.4 DA Schlaich */
-        fluxes[i] = E_ext[i] + 2. * sysParams.pi*sysParams.get_bjerrum() * thisChargeDensity;
+        fluxes[i-work_offset] = E_ext[i-work_offset] + 2. * sysParams.pi*sysParams.get_bjerrum() * thisChargeDensity;
       }
 
-        
-      // Collect results from all nodes
-      communicator.barrier();
-      communicator.sum( &physQIpbs[0], physQIpbs.size() );
-      communicator.sum( &efieldShift[0], efieldShift.size() );
-
       if (communicator.rank() == 0 && sysParams.get_verbose() > 0) {
         for (size_t i = 0; i < sysParams.get_npart(); i++) {
           if (boundary[i]->get_type() == 2)
@@ -349,84 +679,62 @@ class Ipbsolver
       }
       
       // Do the SOR 
-      for (unsigned int i = my_offset; i < target; i++) {
+      for (unsigned int i = work_offset; i < target; i++) {
 
         // do the shift
-        fluxes[i] += efieldShift[ ipbsType[i] ] / physArea[ ipbsType[i] ];
+        const size_t k = i - work_offset;
+        double flux = fluxes[k] + efieldShift[ ipbsType[i] ] / physArea[ ipbsType[i] ];
 
-        bContainer[i] = sysParams.get_alpha_ipbs() * fluxes[i]
-                        + ( 1 - sysParams.get_alpha_ipbs()) * bContainer[i];
-        double local_fluxError = fabs(2.0*(fluxes[i]-bContainer[i])
-                                  /(fluxes[i]+bContainer[i]));
+        workFlux[k] = sysParams.get_alpha_ipbs() * flux
+                        + ( 1 - sysParams.get_alpha_ipbs()) * workFlux[k];
+        double local_fluxError = fabs(2.0*(flux-workFlux[k])
+                                  /(flux+workFlux[k]));
         fluxError = std::max(fluxError, local_fluxError);
       }
-      communicator.barrier();
-      communicator.max(&fluxError, 1);
-    }
 
+      // all nodes need the new charges for the surface loop, only the owners
+      // of the elements the new values
+      reduction.gatherRows(inducedChargeDensity, workCounts);
+      reduction.moveRows(workFlux, workCounts, bContainer, ownedCounts);
+      ContainerType errors(2);
+      errors[0] = fluxError;
+      errors[1] = icError;
+      reduction.max(errors);
+      fluxError = errors[0];
+      icError = errors[1];
+    }
 
     // ------------------------------------------------------------------------
-    /// Charge regulation calculation
+    /// Regulated charge density of boundary element i at the potential value
     // ------------------------------------------------------------------------
-    void updateChargeRegulation(const U& u)
-    { 
-      /// Construct a discrete grid function space for access to solution
-      typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
-      typedef typename DGF::Traits::RangeType RT;
-      typedef typename DGF::Traits::DomainFieldType DF;
-
-      DGF udgf(gfs,u);
-
-      for ( size_t i = 0; i < ipbsElemPointers.size(); i++)
-      {
-        // Calculate regulated charge density
-        RT value;
-        ElemPointer it = ipbsElemPointers[i];
-        Dune::FieldVector<ctype, dim> local = it->geometry().local( ipbsPositions[i] );
-        udgf.evaluate(*it, local,value);
-        double pK = boundary[ ipbsType[i] ]->get_pK();
-        double pH = sysParams.get_pH();
-        double exponential = std::exp ( std::log10(10)*( pH - pK ) - value );
-        regulatedChargeDensity[i] = boundary[ ipbsType[i] ]->get_sigma_max() * exponential / ( 1. + exponential);
-        //std::cout << "i: " << i << " pH " << pH << " pK " << pK << " Value: " << value << " exponential: " << exponential << " regulatedChargeDensity: " << regulatedChargeDensity[i] << std::endl;
-      }
+    void regulate(size_t i, double value)
+    {
+      double pK = boundary[ ipbsType[i] ]->get_pK();
+      double pH = sysParams.get_pH();
+      double exponential = std::exp ( std::log10(10)*( pH - pK ) - value );
+      regulatedChargeDensity[i] = boundary[ ipbsType[i] ]->get_sigma_max() * exponential / ( 1. + exponential);
     }
 
-
-
-   // ------------------------------------------------------------------------
-  
-  protected:
-    template <typename I>
-    double get_lcd(const I& i) const
+    /// Quadrature order for the field at boundary element i of an element centered at center
+    unsigned int quadratureOrder(size_t i, const Dune::FieldVector<ctype,dim>& center) const
     {
-      int mappedIndex = indexLookupMap.find(boundaryElemMapper.map(*i.inside()))->second + my_offset;
-      double lcd = 0;
-      if ( boundary[ boundaryIndexToEntity[i.boundarySegmentIndex()] ]->get_type() == 2) {
-        lcd = boundary[ipbsType[mappedIndex]]->get_charge_density() 
-                        + inducedChargeDensity[mappedIndex];
-                        + regulatedChargeDensity[mappedIndex]; /**< The local charge density 
-                                                     on this particular surface element */
-      }
-      return lcd;
+      Dune::FieldVector<ctype,dim> dist = ipbsPositions[i] - center;
+      unsigned int io = (int) ceil( sysParams.get_integration_maxintorder()*pow(ipbsVolumes[i], 1./(dim-1)) / sqrt( dist*dist ));
+      if (io>51)
+          io=51;
+      return io;
     }
 
-  // ------------------------------------------------------------------------ 
-
-
-  private:
-
     // ------------------------------------------------------------------------
     /// Induced charge computation
     // ------------------------------------------------------------------------
     void updateIC()
     {
       icError = 0;  // reset the fluxError for next iteration step
-      //std::cout << "in updateIC() my_offset = " << my_offset << " my_len = " << my_len << std::endl;
-      ContainerType ic(inducedChargeDensity.size(), 0.);
+      ContainerType ic(work_len, 0.);
       double eps_out = sysParams.get_epsilon();  
-      unsigned int target = my_offset + my_len;
-      for (unsigned int i = my_offset; i < target; i++) {
+      unsigned int target = work_offset + work_len;
+      for (unsigned int i = work_offset; i < target; i++) {
         double eps_in = boundary[ipbsType[i]]->get_epsilon();
 
         // include charge regulation
@@ -437,22 +745,20 @@ class Ipbsolver
         double shift = 0;
         if (boundary[ ipbsType[i] ]->doShift() == true)
           shift =  efieldShift[ ipbsType[i] ] / physArea [ ipbsType[i] ];
-        ic[i] = delta * ( my_charge - eps_out/(2.*sysParams.pi*sysParams.get_bjerrum())
-                * ( E_ext[i] + shift ) ); // Include neutrality constraint
+        ic[i-work_offset] = delta * ( my_charge - eps_out/(2.*sysParams.pi*sysParams.get_bjerrum())
+                * ( E_ext[i-work_offset] + shift ) ); // Include neutrality constraint
       }
-      communicator.barrier();
-      communicator.sum(&ic[0], ic.size());
 
       // Do the SOR 
-      for (unsigned int i = 0; i < inducedChargeDensity.size(); i++) {
-        inducedChargeDensity[i] = sysParams.get_alpha_ic() * ic[i]
+      for (unsigned int i = work_offset; i < target; i++) {
+        const double new_ic = ic[i-work_offset];
+        inducedChargeDensity[i] = sysParams.get_alpha_ic() * new_ic
                           + ( 1 - sysParams.get_alpha_ic()) * inducedChargeDensity[i];
-        double local_icError = fabs(2.0*(ic[i]-inducedChargeDensity[i])
-                      /(ic[i]+inducedChargeDensity[i]));
+        double local_icError = fabs(2.0*(new_ic-inducedChargeDensity[i])
+                      /(new_ic+inducedChargeDensity[i]));
         icError = std::max(icError, local_icError);
       }
-      communicator.barrier();
-      communicator.max(&icError, 1);
+      // the rows are collected at the end of finishUpdate()
     }
 
 
@@ -463,15 +769,53 @@ class Ipbsolver
       /** \brief Get an inital guess for the iterative boundaries */
 
       srand ( time(NULL) );
-      unsigned int target = my_offset + my_len;
-      // For each element on this processor calculate the contribution to surface integral part of the flux
-      for (unsigned int i = my_offset; i < target; i++)
+      for (size_t i = 0; i < ipbsPositions.size(); i++)
       {
         // initialize with constant surface charge density
-        bContainer[i] = 4. * sysParams.get_bjerrum() * sysParams.pi * boundary[ipbsType[i]]->get_charge_density();
+        if (holdsFlux(i))
+          setFlux(i, 4. * sysParams.get_bjerrum() * sysParams.pi * boundary[ipbsType[i]]->get_charge_density());
         //bContainer[i] = 4. * sysParams.get_bjerrum() * sysParams.pi * boundary[ipbsType[i]]->get_charge_density() * ( rand()/RAND_MAX*.4 + .8);
       }
     }
+
+    /// Whether this process stores the boundary value of row i, as owner or for the update
+    bool holdsFlux(size_t i) const
+    {
+      return (i >= my_offset && i < my_offset + my_len)
+        || (i >= work_offset && i < work_offset + work_len);
+    }
+
+    /// Set the boundary value of row i where this process stores it
+    void setFlux(size_t i, double value)
+    {
+      if (i >= my_offset && i < my_offset + my_len)
+        bContainer[i - my_offset] = value;
+      if (i >= work_offset && i < work_offset + work_len)
+        workFlux[i - work_offset] = value;
+    }
+
+    // ------------------------------------------------------------------------
+    /// Split the rows of the surface loop evenly over the processes
+    // ------------------------------------------------------------------------
+    /*!
+       The geometry and the charges of the boundary elements are replicated,
+       so the O(M^2) surface loop and the updates of the induced charges and
+       boundary values can be done by any process for any row. Owning the
+       elements follows the partition of the grid instead, and leaves
+       processes without particle surface idle. The boundary values and the
+       field are stored for the own rows of each layout only.
+    */
+    void distributeRows()
+    {
+      const int size = communicator.size();
+      const size_t rows = ipbsPositions.size();
+      workCounts.resize(size);
+      for (int p = 0; p < size; p++)
+        workCounts[p] = rows*(p+1)/size - rows*p/size;
+      work_offset = rows*communicator.rank()/size;
+      work_len = workCounts[communicator.rank()];
+    }
+
  
     // ------------------------------------------------------------------------
     /// This method executes everything related to initialization
@@ -534,133 +878,65 @@ class Ipbsolver
                                  Collect the information into one container that is distributed on all processors.*/
     {
 #if HAVE_MPI
-      std::vector<unsigned int> length_on_processor;
-      length_on_processor.resize(communicator.size(),0);
-      // Collect on rank 0  - we seem to have to use the standard MPI calls, this is why we NEED to check isFake() before
-      MPI_Status status;
-      if (communicator.rank() == 0)
-      {
-        length_on_processor[0] = ipbsVolumes.size();
-        for (int i = 1; i < communicator.size(); i++)
-        {
-          int temp;
-          MPI_Recv(&temp,1,MPI_INT,i,i,MPI_COMM_WORLD,&status);
-          length_on_processor[i]=temp;
-        }
-      }
-      else
-      {
-        int temp = ipbsVolumes.size();
-        MPI_Send(&temp,1,MPI_INT,0,communicator.rank(),MPI_COMM_WORLD); // Ensures we recover the correct order
-      }
+      // The kernels of the volume and surface integrals need the geometry of all
+      // elements. Every process contributes its part in one collective call
+      // instead of sending it to rank 0, which broadcasts it again.
+      std::vector<int> length_on_processor(communicator.size(), 0);
+      int my_count = ipbsVolumes.size();
+      communicator.allgather(&my_count, 1, &length_on_processor[0]);
       int countBoundElems = 0;
-      if (communicator.rank() == 0)
-      {
-         for (std::vector<unsigned int>::iterator i=length_on_processor.begin(); i != length_on_processor.end(); ++i)
-         {
-           // std::cout << std::endl << *i;
-           countBoundElems += *i;
-         }
-         std::cout << "Detected " << countBoundElems << " boundary elements." << std::endl;
-      }
-      communicator.broadcast(&countBoundElems, 1, 0);
-      communicator.broadcast(&length_on_processor[0], communicator.size(), 0);
-      // Calculate the offset and length of data for each property-vector on each node
-      for (int i = 0; i < communicator.rank(); i++) {
-        my_offset += length_on_processor[i];
-      }
-      my_len = length_on_processor[communicator.rank()]; 
-      // Now we send/receive the boundary data
-      ipbsVolumes.resize(countBoundElems,0.);
-      ipbsType.resize(countBoundElems,0.);
-      ipbsNormals.resize(countBoundElems,Dune::FieldVector<ctype,dim>(0.));
-      ipbsPositions.resize(countBoundElems,Dune::FieldVector<ctype,dim>(0.));
-  
-      // for communicating position-vectors we temporally store into arrays
-      int indexcounter; // Count how many position-vectors we already got
-      double* all_positions = (double*) malloc(dim*countBoundElems*sizeof(double)); // allocate on all processors
-      double* all_normals = (double*) malloc(dim*countBoundElems*sizeof(double)); // allocate on all processors
-      if( communicator.rank() !=0) // other nodes send their positions to master node
-      {
-        double* my_positions = (double*) malloc(dim*length_on_processor[communicator.rank()]*sizeof(double));
-        double* my_normals = (double*) malloc(dim*length_on_processor[communicator.rank()]*sizeof(double));
-        for (unsigned int i = 0; i<length_on_processor[communicator.rank()]; i++){
-          for (int j = 0; j<dim; j++)
-          {
-            my_positions[i*dim+j] = ipbsPositions.at(i).vec_access(j);
-            my_normals[i*dim+j] = ipbsNormals.at(i).vec_access(j);
-          }
-        }
-        MPI_Send(my_positions,dim*length_on_processor[communicator.rank()],MPI_DOUBLE,0,0,MPI_COMM_WORLD); // pos sent on slot 0
-        MPI_Send(my_normals,dim*length_on_processor[communicator.rank()],MPI_DOUBLE,0,1,MPI_COMM_WORLD); // normals sent on slot 1
-      }
-      else
-      {   // Write positions of master node
-        for (unsigned int i = 0; i<length_on_processor[communicator.rank()]; i++){
-          for (int j = 0; j<dim; j++)
-          {
-            all_positions[i*dim+j] = ipbsPositions[i][j];
-            all_normals[i*dim+j] = ipbsNormals[i][j];
-          }
-        }
-        // get the right offset
-        indexcounter = dim*length_on_processor[communicator.rank()];
-        // get positions from other nodes
-        for (int i = 1; i < communicator.size(); i++) {
-          MPI_Recv(&all_positions[indexcounter],dim*length_on_processor[i],MPI_DOUBLE,i,0,MPI_COMM_WORLD,&status);
-          MPI_Recv(&all_normals[indexcounter],dim*length_on_processor[i],MPI_DOUBLE,i,1,MPI_COMM_WORLD,&status);
-          indexcounter += dim*length_on_processor[i];
-        }
+      for (int i = 0; i < communicator.size(); i++) {
+        if (i < communicator.rank())
+          my_offset += length_on_processor[i];
+        countBoundElems += length_on_processor[i];
       }
-      communicator.broadcast(all_positions,countBoundElems*dim,0); // communicate array
-      communicator.broadcast(all_normals,countBoundElems*dim,0); // communicate array
-      for(int i = 0; i < countBoundElems; i++) {
-        for(int j=0; j<dim; j++)
-        {
-          ipbsNormals[i][j] = all_normals[i*dim+j];
-          ipbsPositions[i][j] = all_positions[i*dim+j];
+      my_len = my_count;
+      ownedCounts = length_on_processor;
+      if (communicator.rank() == 0)
+        std::cout << "Detected " << countBoundElems << " boundary elements." << std::endl;
+
+      // position, normal, volume and type of each element packed in one record
+      const int width = 2*dim + 2;
+      std::vector<double> records(width*countBoundElems, 0.);
+      for (int i = 0; i < my_count; i++) {
+        double* record = &records[width*(my_offset+i)];
+        for (int j = 0; j < dim; j++) {
+          record[j] = ipbsPositions[i][j];
+          record[dim+j] = ipbsNormals[i][j];
         }
+        record[2*dim] = ipbsVolumes[i];
+        record[2*dim+1] = ipbsType[i];
       }
-
-      // Commicate everything else
-      /// determine the offset in the boundary proerty vectors on each node
-      int offset = 0;
-      for (int i = 1; i < communicator.rank(); i++) {
-        offset += length_on_processor[i];
-      }
-      
-      if( communicator.rank() !=0) // other nodes send their positions to master node
-      {
-        MPI_Send(&ipbsType[0],length_on_processor[communicator.rank()],MPI_INT,0,1,MPI_COMM_WORLD);
-        MPI_Send(&ipbsVolumes[0],length_on_processor[communicator.rank()],MPI_DOUBLE,0,2,MPI_COMM_WORLD);
-      }
-      else
-      {
-        int tmpcounter = length_on_processor[0];
-        // get positions from other nodes
-        for (int i = 1; i < communicator.size(); i++) {
-          MPI_Recv(&ipbsType[tmpcounter],length_on_processor[i],MPI_INT,i,1,MPI_COMM_WORLD,&status);
-          MPI_Recv(&ipbsVolumes[tmpcounter],length_on_processor[i],MPI_DOUBLE,i,2,MPI_COMM_WORLD,&status);
-          tmpcounter += length_on_processor[i];
+      reduction.gatherRows(records, ownedCounts, width);
+
+      ipbsPositions.resize(countBoundElems);
+      ipbsNormals.resize(countBoundElems);
+      ipbsVolumes.resize(countBoundElems);
+      ipbsType.resize(countBoundElems);
+      for (int i = 0; i < countBoundElems; i++) {
+        const double* record = &records[width*i];
+        for (int j = 0; j < dim; j++) {
+          ipbsPositions[i][j] = record[j];
+          ipbsNormals[i][j] = record[dim+j];
         }
+        ipbsVolumes[i] = record[2*dim];
+        ipbsType[i] = int(record[2*dim+1]);
       }
-
-      //if (communicator.rank() == 0)
-      //{  for(unsigned int i=0;i<ipbsType.size();i++)
-      //    std::cout << ipbsType[i] << " " << ipbsVolumes[i] << " " << ipbsPositions[i] << std::endl;
-      //}
-      communicator.broadcast(&ipbsType[0], countBoundElems, 0);
-      communicator.broadcast(&ipbsVolumes[0], countBoundElems, 0);
-      communicator.barrier();
       std::cout << "Myrank: " << communicator.rank() << " Mylen: " << my_len << std::endl;
+      distributeRows();
       return 0;
 #else
       my_len = ipbsType.size();
       my_offset = 0;
+      ownedCounts.assign(1, my_len);
+      distributeRows();
       return -1;
 #endif
     }
  
+    /// Parameters and particles of the problem
+    SysParams& sysParams;
+    std::vector<Boundary*>& boundary;
     const GV& gv;
     /// The grid function space
     const GFS& gfs;
@@ -689,14 +965,19 @@ class Ipbsolver
     IndexLookupMap indexLookupMap;
 
     typedef std::vector<double> ContainerType;
-    ContainerType bContainer;  /// Store the flux on the surface elements
+    ContainerType bContainer;  /// Store the flux on the surface elements owned by this node
+    ContainerType workFlux;  /// The flux on the rows updated by this node
     ContainerType inducedChargeDensity;  // Store the induced charge density
-    ContainerType E_ext;   /**< Store the electric field on boundary elements, 
+    /// Partial sums of the volume integrals of all rows over the elements of this node
+    ContainerType volumeField;
+    ContainerType E_ext;   /**< Store the electric field on the rows updated by this node,
                                  which is calculated during updateBC(),
                                  \f[ \vec{E}(\vec{r}) \propto \int_V \sinh(\Phi(\vec{r}))
                                  \textnormal{d}\vec{r} \f] */
-    ContainerType regulatedChargeDensity;  /**< Store the regulatedChargeDensity
-                                                CAVE: Only local on each node! */
+    ContainerType regulatedChargeDensity;  /**< Store the regulatedChargeDensity,
+                                                computed by the owner of each element */
+    /// Ion charge and volume in the box in front of each element, summed in updateBC()
+    ContainerType nearFieldCharge, nearFieldChargeArea;
     
     /// Charge neutrallity constraint
     ContainerType physArea, physQTot, physQIpbs;
@@ -706,6 +987,12 @@ class Ipbsolver
     
     /// Offset and length of data stream on each node
     unsigned int my_offset, my_len;
+    /// Offset and length of the rows updated on each node, and both layouts on all nodes
+    unsigned int work_offset, work_len;
+    std::vector<int> ownedCounts, workCounts;
+    /// Fused reductions of the boundary update and the time spent in them,
+    /// also used by the collective const accessors
+    mutable Reduction reduction;
     unsigned int iterationCounter;
     double fluxError,  icError;
 
@@ -0,0 +1,191 @@
+#ifndef _IPBSSTATE_HH
+#define _IPBSSTATE_HH
+
+/** \file
+    \brief Snapshot of the iterated boundary data held by the Ipbsolver
+
+    The state is stored together with the centers and physical groups of the
+    boundary elements it belongs to, so it can be mapped onto a different
+    boundary discretization (after grid adaptation or on another mesh) by
+    looking up the nearest stored element of the same physical group.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include <dune/common/fvector.hh>
+
+template<typename ctype, int dim>
+struct IpbsState
+{
+  typedef Dune::FieldVector<ctype,dim> Position;
+
+  IpbsState() : iterationCounter(0), continuationPoint(0), pointStart(0), cellSize(0) {}
+
+  /// Centers of the iterated boundary elements
+  std::vector<Position> positions;
+  /// Physical group of each iterated boundary element
+  std::vector<int> types;
+
+  std::vector<double> bContainer;
+  std::vector<double> inducedChargeDensity;
+  std::vector<double> regulatedChargeDensity;
+  /// Field shift per physical group
+  std::vector<double> efieldShift;
+  unsigned int iterationCounter;
+  /// Parameter continuation: index of the value being solved and the iteration it started in
+  unsigned int continuationPoint;
+  unsigned int pointStart;
+
+  size_t size() const { return positions.size(); }
+
+  /// Index of the stored element of physical group type closest to pos, -1 if there is none
+  int nearest(const Position& pos, int type) const
+  {
+    if (positions.empty())
+      return -1;
+    if (cells.empty())
+      buildLookup();
+
+    Key c = key(pos);
+    int best = -1;
+    double bestDist = 0;
+    for (int ring = 0; ring <= searchRings; ring++)
+    {
+      // once we found a candidate, all other candidates lie within bestDist
+      if (best >= 0 && (ring-1)*cellSize > std::sqrt(bestDist))
+        return best;
+      visitRing(c, ring, 0, Key(), pos, type, best, bestDist);
+    }
+    // nothing close by, fall back to checking all elements
+    if (best < 0 || searchRings*cellSize < std::sqrt(bestDist))
+      for (size_t i = 0; i < positions.size(); i++)
+        check(i, pos, type, best, bestDist);
+    return best;
+  }
+
+  /** \brief Add a times the boundary data of y
+
+      Both states have to belong to the same boundary elements, an empty
+      state is taken as zero. Used to superpose linear responses.
+  */
+  void axpy(double a, const IpbsState& y)
+  {
+    if (positions.empty()) {
+      positions = y.positions;
+      types = y.types;
+      bContainer.assign(y.bContainer.size(), 0.);
+      inducedChargeDensity.assign(y.inducedChargeDensity.size(), 0.);
+      regulatedChargeDensity.assign(y.regulatedChargeDensity.size(), 0.);
+      efieldShift.assign(y.efieldShift.size(), 0.);
+      invalidate();
+    }
+    for (size_t i = 0; i < bContainer.size(); i++) {
+      bContainer[i] += a * y.bContainer[i];
+      inducedChargeDensity[i] += a * y.inducedChargeDensity[i];
+      regulatedChargeDensity[i] += a * y.regulatedChargeDensity[i];
+    }
+    for (size_t i = 0; i < efieldShift.size(); i++)
+      efieldShift[i] += a * y.efieldShift[i];
+  }
+
+  /// Drop the lookup structure, needed after positions have been changed
+  void invalidate() const
+  {
+    cells.clear();
+  }
+
+private:
+  typedef Dune::FieldVector<int,dim> Key;
+
+  struct KeyCompare
+  {
+    bool operator() (const Key& a, const Key& b) const
+    {
+      for (int d = 0; d < dim; d++) {
+        if (a[d] < b[d]) return true;
+        if (a[d] > b[d]) return false;
+      }
+      return false;
+    }
+  };
+  typedef std::map<Key, std::vector<int>, KeyCompare> Cells;
+
+  /// Number of cell rings searched before falling back to a linear search
+  static const int searchRings = 3;
+
+  Key key(const Position& pos) const
+  {
+    Key k;
+    for (int d = 0; d < dim; d++)
+      k[d] = (int) std::floor((pos[d]-lower[d])/cellSize);
+    return k;
+  }
+
+  // bucket the surface elements in cells of roughly constant occupation
+  void buildLookup() const
+  {
+    lower = positions[0];
+    Position upper = positions[0];
+    for (size_t i = 1; i < positions.size(); i++)
+      for (int d = 0; d < dim; d++) {
+        lower[d] = std::min(lower[d], positions[i][d]);
+        upper[d] = std::max(upper[d], positions[i][d]);
+      }
+    double extent = 0;
+    for (int d = 0; d < dim; d++)
+      extent = std::max(extent, (double) (upper[d]-lower[d]));
+    // the elements live on a (dim-1)-dimensional surface
+    int maxCells = (int) std::ceil(std::pow((double) positions.size(), 1./std::max(dim-1,1)));
+    cellSize = extent > 0 ? extent / maxCells : 1.;
+    for (size_t i = 0; i < positions.size(); i++)
+      cells[key(positions[i])].push_back(i);
+  }
+
+  void check(int i, const Position& pos, int type, int& best, double& bestDist) const
+  {
+    if (types[i] != type)
+      return;
+    Position diff = positions[i];
+    diff -= pos;
+    double dist = diff.two_norm2();
+    if (best < 0 || dist < bestDist) {
+      best = i;
+      bestDist = dist;
+    }
+  }
+
+  // check all cells with maximum norm distance ring from center
+  void visitRing(const Key& center, int ring, int d, Key offset, const Position& pos,
+                 int type, int& best, double& bestDist) const
+  {
+    if (d == dim) {
+      int norm = 0;
+      for (int e = 0; e < dim; e++)
+        norm = std::max(norm, std::abs(offset[e]));
+      if (norm != ring)
+        return;
+      Key k = center;
+      k += offset;
+      typename Cells::const_iterator cell = cells.find(k);
+      if (cell == cells.end())
+        return;
+      for (size_t n = 0; n < cell->second.size(); n++)
+        check(cell->second[n], pos, type, best, bestDist);
+      return;
+    }
+    for (int o = -ring; o <= ring; o++) {
+      offset[d] = o;
+      visitRing(center, ring, d+1, offset, pos, type, best, bestDist);
+    }
+  }
+
+  mutable Cells cells;
+  mutable Position lower;
+  mutable double cellSize;
+};
+
+#endif  // _IPBSSTATE_HH
@@ -0,0 +1,265 @@
+#ifndef _LOADBALANCE_HH
+#define _LOADBALANCE_HH
+
+/** \file
+    \brief Repartition of the grid by the cost of the boundary integration
+
+    loadBalance() of the grid managers balances the number of elements. The
+    volume integral of Ipbsolver::updateBC() over an element however costs one
+    kernel evaluation per quadrature point and iterated boundary element, and
+    the quadrature order rises up to 51 close to the particles. The processes
+    owning the particle surfaces are then the stragglers every reduction of
+    the boundary iteration waits for.
+
+    The cost of each element is taken either from the number of kernel
+    evaluations (cost model) or from their measured wall time. Rank 0 splits
+    the weighted element centers by recursive coordinate bisection and sends
+    every element its target process. Only grid managers taking target
+    processes, like UG, can migrate the elements; for the others the
+    imbalance is only reported.
+
+    The grid is repartitioned before the problem is set up. The iterated
+    boundary data of Ipbsolver are replicated on all processes, so the
+    solver built on the balanced grid starts from the same state.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <dune/common/fvector.hh>
+#include <dune/common/mpihelper.hh>
+#include <dune/grid/common/gridenums.hh>
+#if GRIDDIM == 2
+#include <dune/pdelab/finiteelementmap/pk2dfem.hh>
+#elif GRIDDIM == 3
+#include <dune/pdelab/finiteelementmap/pk3dfem.hh>
+#endif
+#include <dune/pdelab/gridfunctionspace/gridfunctionspace.hh>
+
+#include "context.hh"
+#include "ipbsolver.hh"
+#include "physicalgroups.hh"
+#include "processgroup.hh"
+
+// ------------------------------------------------------------------------
+/// Whether a grid can be balanced to given target processes
+// ------------------------------------------------------------------------
+/*!
+   Detects bool GridType::loadBalance(const std::vector<Rank>&, unsigned int).
+*/
+template<class GridType, typename Rank>
+class HasTargetLoadBalance
+{
+  typedef char Yes;
+  typedef char No[2];
+  template<typename Signature, Signature> struct Check;
+  template<class G>
+  static Yes& test(Check<bool (G::*)(const std::vector<Rank>&, unsigned int),
+                         &G::loadBalance>*);
+  template<class G>
+  static No& test(...);
+
+  public:
+    static const bool value = sizeof(test<GridType>(0)) == sizeof(Yes);
+};
+
+/// Migrate the level 0 elements to targets, false if the grid can not do that
+template<class GridType, bool unsignedRanks = HasTargetLoadBalance<GridType,unsigned int>::value,
+         bool intRanks = HasTargetLoadBalance<GridType,int>::value>
+struct Repartition
+{
+  static const bool supported = false;
+  static bool apply(GridType&, const std::vector<int>&)
+  {
+    return false;
+  }
+};
+
+template<class GridType, bool unsignedRanks>
+struct Repartition<GridType, unsignedRanks, true>
+{
+  static const bool supported = true;
+  static bool apply(GridType& grid, const std::vector<int>& targets)
+  {
+    return grid.loadBalance(targets, 0);
+  }
+};
+
+template<class GridType>
+struct Repartition<GridType, true, false>
+{
+  static const bool supported = true;
+  static bool apply(GridType& grid, const std::vector<int>& targets)
+  {
+    return grid.loadBalance(std::vector<unsigned int>(targets.begin(), targets.end()), 0);
+  }
+};
+
+// ------------------------------------------------------------------------
+/// Weighted recursive coordinate bisection of points onto processes [first, last)
+// ------------------------------------------------------------------------
+/*!
+   \param elements indices of the points to split, reordered on return
+   \param targets process of each point on return
+*/
+template<int dim>
+void weighted_bisection(const std::vector<Dune::FieldVector<double,dim> >& points,
+    const std::vector<double>& weights, std::vector<int>::iterator begin,
+    std::vector<int>::iterator end, int first, int last, std::vector<int>& targets)
+{
+  if (last - first == 1 || end - begin <= 1)
+  {
+    for (std::vector<int>::iterator it = begin; it != end; ++it)
+      targets[*it] = first;
+    return;
+  }
+
+  // cut along the longest extension of the points
+  Dune::FieldVector<double,dim> lower(points[*begin]), upper(points[*begin]);
+  double total = 0;
+  for (std::vector<int>::iterator it = begin; it != end; ++it)
+  {
+    for (int d = 0; d < dim; d++) {
+      lower[d] = std::min(lower[d], points[*it][d]);
+      upper[d] = std::max(upper[d], points[*it][d]);
+    }
+    total += weights[*it];
+  }
+  int axis = 0;
+  for (int d = 1; d < dim; d++)
+    if (upper[d] - lower[d] > upper[axis] - lower[axis])
+      axis = d;
+  std::vector<std::pair<double,int> > order;
+  for (std::vector<int>::iterator it = begin; it != end; ++it)
+    order.push_back(std::make_pair(points[*it][axis], *it));
+  std::sort(order.begin(), order.end());
+
+  // the first half of the processes gets its share of the weight
+  const int middle = first + (last - first) / 2;
+  const double share = total * (middle - first) / (last - first);
+  double sum = 0;
+  size_t cut = 0;
+  while (cut < order.size()-1 && sum + .5*weights[order[cut].second] < share)
+    sum += weights[order[cut++].second];
+  // every process keeps a point as long as there are enough of them
+  if (order.size() >= size_t(last - first))
+    cut = std::min(std::max(cut, size_t(middle - first)), order.size() - (last - middle));
+  else
+    cut = std::max(cut, size_t(1));
+  for (size_t k = 0; k < order.size(); k++)
+    *(begin + k) = order[k].second;
+  weighted_bisection(points, weights, begin, begin + cut, first, middle, targets);
+  weighted_bisection(points, weights, begin + cut, end, middle, last, targets);
+}
+
+// ------------------------------------------------------------------------
+/// Repartition a distributed grid by the cost of the boundary integration
+// ------------------------------------------------------------------------
+/*!
+   Does nothing unless mesh.load_balance is set and the grid is distributed.
+
+   \param elementIndexToEntity, boundaryIndexToEntity physical groups as
+          returned by ipbs_read_mesh(), updated if elements were migrated
+*/
+template<class GridType, typename PGMap>
+void ipbs_balance_grid(IpbsContext& context, const ProcessGroup& helper, GridType& grid,
+                       PGMap& elementIndexToEntity, PGMap& boundaryIndexToEntity)
+{
+  const int mode = context.sysParams.get_loadBalance();
+  if (mode == 0 || helper.size() == 1)
+    return;
+
+  typedef typename GridType::LeafGridView GV;
+  typedef typename GV::template Codim<0>::template Partition<Dune::Interior_Partition>::Iterator
+    ElementIterator;
+  typedef typename GV::Grid::ctype ctype;
+  const int dim = GV::dimension;
+  typedef Dune::FieldVector<double,dim> Point;
+
+  // costs of the interior elements, the grid is not refined yet
+  std::vector<Point> centers;
+  std::vector<double> costs;
+  std::vector<int> targets;
+  double localCost = 0;
+  {
+    const GV gv = grid.leafView();
+#if GRIDDIM == 2
+    typedef Dune::PDELab::Pk2DLocalFiniteElementMap<GV, ctype, double, 1> FEM;
+#elif GRIDDIM == 3
+    typedef Dune::PDELab::Pk3DLocalFiniteElementMap<GV, ctype, double, 1> FEM;
+#endif
+    FEM fem(gv);
+    typedef Dune::PDELab::GridFunctionSpace<GV,FEM> GFS;
+    GFS gfs(gv,fem);
+    const Ipbsolver<GV,GFS> ipbs(context, gv, gfs, boundaryIndexToEntity, 1, false);
+
+    targets.assign(gv.size(0), helper.rank());
+    for (ElementIterator it = gv.template begin<0,Dune::Interior_Partition>();
+         it != gv.template end<0,Dune::Interior_Partition>(); ++it)
+    {
+      const Point center = it->geometry().center();
+      centers.push_back(center);
+      costs.push_back(ipbs.elementCost(*it, mode == 2));
+      localCost += costs.back();
+    }
+  }
+
+  const double maxCost = grid.comm().max(localCost);
+  const double meanCost = grid.comm().sum(localCost) / helper.size();
+  const double imbalance = meanCost > 0 ? maxCost / meanCost : 1.;
+  if (helper.rank() == 0)
+    std::cout << "Cost of the boundary integration: imbalance " << imbalance
+              << " (maximum / mean over the processes)" << std::endl;
+  if (imbalance < 1.1)
+    return;
+  if (!Repartition<GridType>::supported) {
+    if (helper.rank() == 0)
+      std::cout << "The grid manager can not migrate elements to given processes, "
+                << "the partition is kept" << std::endl;
+    return;
+  }
+
+#if HAVE_MPI
+  const MPI_Comm communicator = helper.getCommunicator();
+  std::vector<Point> allCenters;
+  std::vector<double> allCosts;
+  std::vector<int> counts, allTargets, elementTargets;
+  root_gather(communicator, centers, allCenters, counts);
+  root_gather(communicator, costs, allCosts, counts);
+  if (helper.rank() == 0)
+  {
+    std::vector<int> elements(allCenters.size());
+    for (size_t k = 0; k < elements.size(); k++)
+      elements[k] = k;
+    allTargets.resize(elements.size());
+    weighted_bisection(allCenters, allCosts, elements.begin(), elements.end(),
+        0, helper.size(), allTargets);
+    std::vector<double> load(helper.size(), 0.);
+    for (size_t k = 0; k < allTargets.size(); k++)
+      load[allTargets[k]] += allCosts[k];
+    std::cout << "Imbalance of the weighted partition: "
+              << *std::max_element(load.begin(), load.end()) / meanCost << std::endl;
+  }
+  root_scatter(communicator, allTargets, counts, elementTargets, centers.size());
+
+  // targets by the leaf index, ghosts stay where they are
+  {
+    const GV gv = grid.leafView();
+    size_t k = 0;
+    for (ElementIterator it = gv.template begin<0,Dune::Interior_Partition>();
+         it != gv.template end<0,Dune::Interior_Partition>(); ++it)
+      targets[gv.indexSet().index(*it)] = elementTargets[k++];
+  }
+
+  // the physical groups move with the elements, as in ipbs_read_mesh()
+  const PhysicalGroups<GridType> groups(grid, communicator, elementIndexToEntity,
+                                        boundaryIndexToEntity);
+  std::cout << "Grid has been modified by load balancing: "
+            << Repartition<GridType>::apply(grid, targets) << std::endl;
+  groups.distribute(grid, communicator, elementIndexToEntity, boundaryIndexToEntity);
+#endif
+}
+
+#endif  // _LOADBALANCE_HH
@@ -0,0 +1,289 @@
+#ifndef _LOCKSTEP_HH
+#define _LOCKSTEP_HH
+
+/** \file
+    \brief Solving K parameter sets on one mesh in lock-step
+
+    The members of a lock-step ensemble share the mesh, the finite element
+    space and the types of the boundary conditions, and differ in parameters
+    like charge densities or the salt concentration. Their solutions are the
+    components of a power grid function space with blockwise ordering and an
+    ISTLVectorBackend<K>, so each degree of freedom stores the K values next
+    to each other and the Jacobian has K x K blocks. Assembly evaluates the
+    geometry and the basis functions once per quadrature point for all
+    members, and the boundary update (Ipbsolver::updateBC) traverses the grid
+    and evaluates the kernel once for all members.
+*/
+
+#include <vector>
+
+#include <dune/common/fvector.hh>
+#include <dune/geometry/quadraturerules.hh>
+#include <dune/pdelab/gridfunctionspace/localfunctionspace.hh>
+#include <dune/pdelab/localoperator/flags.hh>
+
+// ------------------------------------------------------------------------
+/// Local operator of K members, each given by its own PBLocalOperator
+// ------------------------------------------------------------------------
+/*!
+   Member c acts on component c of the power function space only, so the
+   off-diagonal entries of the blocks stay zero. The volume terms keep the
+   values of the members next to each other and loop over them innermost,
+   in loops of the fixed length K the compiler can vectorize.
+*/
+template<class LOP, int K>
+class LockstepLocalOperator :
+  public Dune::PDELab::LocalOperatorDefaultFlags
+{
+public:
+  // pattern assembly flags
+  enum { doPatternVolume = true };
+
+  // residual assembly flags
+  enum { doAlphaVolume = true };
+  enum { doAlphaBoundary = true };
+
+  /// \param members_ the operators of the K members
+  LockstepLocalOperator(const std::vector<LOP*>& members_) : members(members_)
+  {}
+
+  template<typename LFSU, typename LFSV, typename LocalPattern>
+  void pattern_volume (const LFSU& lfsu, const LFSV& lfsv, LocalPattern& pattern) const
+  {
+    for (int c=0; c<K; c++)
+      members[c]->pattern_volume(lfsu.child(c), lfsv.child(c), pattern);
+  }
+
+  template<typename EG, typename LFSU, typename X, typename LFSV, typename R>
+  void alpha_volume (const EG& eg, const LFSU& lfsu, const X& x, const LFSV& lfsv, R& r) const
+  {
+    typedef typename LFSU::template Child<0>::Type ChildLFSU;
+    typedef typename ChildLFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::DomainFieldType DF;
+    typedef typename ChildLFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::RangeFieldType RF;
+    typedef typename ChildLFSU::Traits::SizeType size_type;
+
+    const int dim = EG::Geometry::dimension;
+    const LOP& first = *members[0];
+
+    Dune::GeometryType gt = eg.geometry().type();
+    const Dune::QuadratureRule<DF,dim>&
+      rule = Dune::QuadratureRules<DF,dim>::rule(gt,first.intorder);
+
+    // all components use the same finite element
+    const size_type n = lfsu.child(0).size();
+    const std::vector<double>& tab = first.tabulate(lfsu.child(0).finiteElement(), rule);
+    std::vector<Dune::FieldVector<RF,dim> > gradphi(n);
+
+    // coefficients and residuals of basis function i and member c at [i*K+c]
+    std::vector<RF> xk(n*K), rk(n*K, 0.0);
+    for (size_type i=0; i<n; i++)
+      for (int c=0; c<K; c++)
+        xk[i*K+c] = x(lfsu.child(c),i);
+
+    size_type q = 0;
+    for (typename Dune::QuadratureRule<DF,dim>::const_iterator
+           it=rule.begin(); it!=rule.end(); ++it, ++q)
+      {
+        const double* phi = &tab[q*n*(dim+1)];
+        const double* js = phi + n;
+
+        first.transformGradients(eg.geometry().jacobianInverseTransposed(it->position()), js, gradphi);
+        RF factor = it->weight()*eg.geometry().integrationElement(it->position())
+                    * first.metric(eg.geometry().global(it->position()));
+
+        RF u[K], f[K], gradu[dim][K];
+        for (int c=0; c<K; c++)
+        {
+          u[c] = 0.0;
+          for (int d=0; d<dim; d++)
+            gradu[d][c] = 0.0;
+        }
+        for (size_type i=0; i<n; i++)
+        {
+          const RF* xi = &xk[i*K];
+          for (int c=0; c<K; c++)
+            u[c] += xi[c]*phi[i];
+          for (int d=0; d<dim; d++)
+            for (int c=0; c<K; c++)
+              gradu[d][c] += xi[c]*gradphi[i][d];
+        }
+        for (int c=0; c<K; c++)
+          f[c] = members[c]->source(u[c]);
+
+        for (size_type i=0; i<n; i++)
+        {
+          RF* ri = &rk[i*K];
+          for (int c=0; c<K; c++)
+          {
+            RF flux = 0.0;
+            for (int d=0; d<dim; d++)
+              flux += gradu[d][c]*gradphi[i][d];
+            ri[c] += (flux - f[c]*phi[i]) * factor;
+          }
+        }
+      }
+
+    for (size_type i=0; i<n; i++)
+      for (int c=0; c<K; c++)
+        r.accumulate(lfsv.child(c),i,rk[i*K+c]);
+  }
+
+  template<typename EG, typename LFSU, typename X, typename LFSV, typename Mat>
+  void jacobian_volume (const EG& eg, const LFSU& lfsu, const X& x, const LFSV& lfsv,
+                        Mat& mat) const
+  {
+    typedef typename LFSU::template Child<0>::Type ChildLFSU;
+    typedef typename ChildLFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::DomainFieldType DF;
+    typedef typename ChildLFSU::Traits::FiniteElementType::
+      Traits::LocalBasisType::Traits::RangeFieldType RF;
+    typedef typename ChildLFSU::Traits::SizeType size_type;
+
+    const int dim = EG::Geometry::dimension;
+    const LOP& first = *members[0];
+
+    Dune::GeometryType gt = eg.geometry().type();
+    const Dune::QuadratureRule<DF,dim>&
+      rule = Dune::QuadratureRules<DF,dim>::rule(gt,first.intorder);
+
+    const size_type n = lfsu.child(0).size();
+    const std::vector<double>& tab = first.tabulate(lfsu.child(0).finiteElement(), rule);
+    std::vector<Dune::FieldVector<RF,dim> > gradphi(n);
+
+    // entry (i,j) of the block of member c at [(i*n+j)*K+c]
+    std::vector<RF> xk(n*K), mk(n*n*K, 0.0);
+    for (size_type i=0; i<n; i++)
+      for (int c=0; c<K; c++)
+        xk[i*K+c] = x(lfsu.child(c),i);
+
+    size_type q = 0;
+    for (typename Dune::QuadratureRule<DF,dim>::const_iterator
+           it=rule.begin(); it!=rule.end(); ++it, ++q)
+      {
+        const double* phi = &tab[q*n*(dim+1)];
+        const double* js = phi + n;
+
+        first.transformGradients(eg.geometry().jacobianInverseTransposed(it->position()), js, gradphi);
+        RF factor = it->weight()*eg.geometry().integrationElement(it->position())
+                    * first.metric(eg.geometry().global(it->position()));
+
+        RF u[K], df[K];
+        for (int c=0; c<K; c++)
+          u[c] = 0.0;
+        for (size_type i=0; i<n; i++)
+          for (int c=0; c<K; c++)
+            u[c] += xk[i*K+c]*phi[i];
+        for (int c=0; c<K; c++)
+          df[c] = members[c]->sourceDerivative(u[c]);
+
+        // the stiffness and mass terms are the same for all members
+        for (size_type i=0; i<n; i++)
+          for (size_type j=0; j<n; j++)
+          {
+            const RF stiffness = (gradphi[j]*gradphi[i]) * factor;
+            const RF mass = phi[j]*phi[i] * factor;
+            RF* mij = &mk[(i*n+j)*K];
+            for (int c=0; c<K; c++)
+              mij[c] += stiffness - df[c]*mass;
+          }
+      }
+
+    for (size_type i=0; i<n; i++)
+      for (size_type j=0; j<n; j++)
+        for (int c=0; c<K; c++)
+          mat.accumulate(lfsv.child(c),i,lfsu.child(c),j,mk[(i*n+j)*K+c]);
+  }
+
+  template<typename EG, typename LFSU, typename X, typename LFSV, typename Y>
+  void jacobian_apply_volume (const EG& eg, const LFSU& lfsu, const X& x,
+                              const LFSV& lfsv, Y& y) const
+  {
+    for (int c=0; c<K; c++)
+      members[c]->jacobian_apply_volume(eg, lfsu.child(c), x, lfsv.child(c), y);
+  }
+
+  // the boundary fluxes are those of the member's own IPBS iteration
+  template<typename IG, typename LFSU, typename X, typename LFSV, typename R>
+  void alpha_boundary (const IG& ig, const LFSU& lfsu_s, const X& x_s,
+                       const LFSV& lfsv_s, R& r_s) const
+  {
+    for (int c=0; c<K; c++)
+      members[c]->alpha_boundary(ig, lfsu_s.child(c), x_s, lfsv_s.child(c), r_s);
+  }
+
+  template<typename IG, typename LFSU, typename X, typename LFSV, typename Mat>
+  void jacobian_boundary (const IG& ig, const LFSU& lfsu_s, const X& x_s,
+                          const LFSV& lfsv_s, Mat& mat_ss) const
+  {}
+
+  template<typename IG, typename LFSU, typename X, typename LFSV, typename Y>
+  void jacobian_apply_boundary (const IG& ig, const LFSU& lfsu_s, const X& x_s,
+                                const LFSV& lfsv_s, Y& y_s) const
+  {}
+
+private:
+  const std::vector<LOP*>& members;
+};
+
+// ------------------------------------------------------------------------
+/// Values of all members at a point, for the updates of several Ipbsolvers
+// ------------------------------------------------------------------------
+template<class PGFS, class PU>
+class LockstepValues
+{
+  typedef Dune::PDELab::LocalFunctionSpace<PGFS> LFS;
+  typedef typename LFS::template Child<0>::Type ChildLFS;
+  typedef typename ChildLFS::Traits::FiniteElementType::
+    Traits::LocalBasisType::Traits::RangeType RangeType;
+
+  public:
+    LockstepValues(const PGFS& pgfs, const PU& u_) : lfs(pgfs), u(u_) {}
+
+    template<class E, class X>
+    void evaluate(const E& e, const X& x, std::vector<double>& values) const
+    {
+      lfs.bind(e);
+      lfs.vread(u, ul);
+      phi.resize(lfs.child(0).size());
+      lfs.child(0).finiteElement().localBasis().evaluateFunction(x, phi);
+      for (size_t c = 0; c < values.size(); c++)
+      {
+        const ChildLFS& child = lfs.child(c);
+        values[c] = 0;
+        for (size_t i = 0; i < child.size(); i++)
+          values[c] += ul[child.localIndex(i)] * phi[i];
+      }
+    }
+
+  private:
+    mutable LFS lfs;
+    const PU& u;
+    mutable std::vector<Real> ul;
+    mutable std::vector<RangeType> phi;
+};
+
+// ------------------------------------------------------------------------
+/// Copy component c of a blocked coefficient vector to a scalar one
+// ------------------------------------------------------------------------
+/*!
+   The blockwise ordering puts degree of freedom j of all components into
+   block j, in the same order as the scalar space on the same finite elements.
+*/
+template<class PU, class U>
+void lockstep_component(const PU& pu, int c, U& u)
+{
+  for (size_t j = 0; j < u.base().N(); j++)
+    u.base()[j][0] = pu.base()[j][c];
+}
+
+/// Set component c of a blocked coefficient vector from a scalar one
+template<class PU, class U>
+void lockstep_set_component(PU& pu, int c, const U& u)
+{
+  for (size_t j = 0; j < u.base().N(); j++)
+    pu.base()[j][c] = u.base()[j][0];
+}
+
+#endif  // _LOCKSTEP_HH
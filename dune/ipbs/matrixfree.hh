@@ -0,0 +1,626 @@
+#ifndef _MATRIXFREE_HH
+#define _MATRIXFREE_HH
+
+/** \file
+    \brief Newton solver applying the PB Jacobian without assembling it
+
+    For P2 and P3, in 3d in particular, the assembled Jacobian is the largest
+    object of a run and the Krylov iterations are bound by the memory
+    bandwidth of its sparse product. MatrixFreeJacobian applies the Jacobian
+    linearized at the Newton iterate element by element with
+    PBLocalOperator::jacobian_apply_volume(). The affine geometry, the finite
+    element and the indices of each element are cached at construction, the
+    basis functions at the quadrature points are tabulated by the local
+    operator. The boundary terms do not depend on the iterate.
+
+    The Krylov solver is preconditioned with P1CoarsePreconditioner: the
+    Jacobian of the same problem with P1 elements on the same grid is
+    assembled, one AMG cycle on it gives the coarse correction, followed by
+    a damped Jacobi step with the diagonal of the high order Jacobian.
+
+    Built with -DMATRIXFREE=1 (see ipbs_Pk()), for runs on one process.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fmatrix.hh>
+#include <dune/common/fvector.hh>
+#include <dune/geometry/type.hh>
+#include <dune/istl/operators.hh>
+#include <dune/istl/preconditioner.hh>
+#include <dune/istl/preconditioners.hh>
+#include <dune/istl/solvers.hh>
+#include <dune/istl/paamg/amg.hh>
+#if GRIDDIM == 2
+#include <dune/pdelab/finiteelementmap/pk2dfem.hh>
+#elif GRIDDIM == 3
+#include <dune/pdelab/finiteelementmap/pk3dfem.hh>
+#endif
+#include <dune/pdelab/finiteelementmap/conformingconstraints.hh>
+#include <dune/pdelab/gridfunctionspace/gridfunctionspace.hh>
+#include <dune/pdelab/gridfunctionspace/gridfunctionspaceutilities.hh>
+#include <dune/pdelab/gridfunctionspace/interpolate.hh>
+#include <dune/pdelab/gridfunctionspace/localfunctionspace.hh>
+#include <dune/pdelab/gridoperator/gridoperator.hh>
+#include <dune/pdelab/backend/istlmatrixbackend.hh>
+#include <dune/pdelab/backend/istlvectorbackend.hh>
+#include <dune/pdelab/newton/newton.hh>
+
+// ------------------------------------------------------------------------
+/// Geometry of an affine element, evaluated once
+// ------------------------------------------------------------------------
+/*!
+   Provides the part of the geometry interface used by PBLocalOperator.
+*/
+template<typename ctype, int dim>
+class AffineElementGeometry
+{
+  public:
+    static const int dimension = dim;
+    static const int mydimension = dim;
+    typedef Dune::FieldVector<ctype,dim> LocalCoordinate;
+    typedef Dune::FieldVector<ctype,dim> GlobalCoordinate;
+    typedef Dune::FieldMatrix<ctype,dim,dim> Jacobian;
+
+    AffineElementGeometry() {}
+
+    template<class Geometry>
+    AffineElementGeometry(const Geometry& geometry) :
+      gt(geometry.type()), origin(geometry.corner(0)),
+      jt(geometry.jacobianTransposed(LocalCoordinate(0.))),
+      jit(geometry.jacobianInverseTransposed(LocalCoordinate(0.))),
+      determinant(geometry.integrationElement(LocalCoordinate(0.)))
+    {}
+
+    Dune::GeometryType type() const { return gt; }
+
+    GlobalCoordinate global(const LocalCoordinate& local) const
+    {
+      GlobalCoordinate y(origin);
+      jt.umtv(local, y);
+      return y;
+    }
+
+    const Jacobian& jacobianInverseTransposed(const LocalCoordinate&) const { return jit; }
+    ctype integrationElement(const LocalCoordinate&) const { return determinant; }
+
+  private:
+    Dune::GeometryType gt;
+    GlobalCoordinate origin;
+    Jacobian jt, jit;
+    ctype determinant;
+};
+
+/// Cached element, stands in for the element geometry of the local operators
+template<class FE, typename ctype, int dim>
+struct MatrixFreeElement
+{
+  typedef AffineElementGeometry<ctype,dim> Geometry;
+  const Geometry& geometry() const { return geo; }
+
+  Geometry geo;
+  const FE* fe;
+  size_t offset;    // of the first of its indices
+};
+
+/// Local function space of a cached element
+template<class FE>
+class CachedLocalSpace
+{
+  public:
+    struct Traits
+    {
+      typedef FE FiniteElementType;
+      typedef size_t SizeType;
+    };
+
+    CachedLocalSpace(const FE& fe_) : fe(fe_) {}
+    size_t size() const { return fe.localBasis().size(); }
+    const FE& finiteElement() const { return fe; }
+
+  private:
+    const FE& fe;
+};
+
+/// Local coefficients with the access x(lfs,i) of the local operators
+class LocalCoefficients
+{
+  public:
+    LocalCoefficients(const std::vector<double>& v_) : v(v_) {}
+    template<class LFS>
+    double operator()(const LFS&, size_t i) const { return v[i]; }
+
+  private:
+    const std::vector<double>& v;
+};
+
+/// Local residual with the access r.accumulate(lfs,i,value) of the local operators
+class LocalAccumulator
+{
+  public:
+    LocalAccumulator(std::vector<double>& v_) : v(v_) {}
+    template<class LFS>
+    void accumulate(const LFS&, size_t i, double value) { v[i] += value; }
+
+  private:
+    std::vector<double>& v;
+};
+
+/// Local matrix keeping its diagonal only
+class LocalDiagonal
+{
+  public:
+    LocalDiagonal(std::vector<double>& v_) : v(v_) {}
+    template<class LFSV, class LFSU>
+    void accumulate(const LFSV&, size_t i, const LFSU&, size_t j, double value)
+    {
+      if (i == j)
+        v[i] += value;
+    }
+
+  private:
+    std::vector<double>& v;
+};
+
+// ------------------------------------------------------------------------
+/// Jacobian of a PBLocalOperator applied element by element
+// ------------------------------------------------------------------------
+/*!
+   Acts on the ISTL vectors of the coefficient vectors U. The rows and
+   columns of the Dirichlet values are those of the identity, as in the
+   Jacobian assembled by the grid operator.
+*/
+template<class GV, class GFS, class LOP, class CC, class U>
+class MatrixFreeJacobian :
+  public Dune::LinearOperator<typename U::BaseT, typename U::BaseT>
+{
+  typedef Dune::PDELab::LocalFunctionSpace<GFS> LFS;
+  typedef typename LFS::Traits::FiniteElementType FE;
+  typedef typename GV::Grid::ctype ctype;
+  static const int dim = GV::dimension;
+  typedef MatrixFreeElement<FE,ctype,dim> Element;
+  typedef CachedLocalSpace<FE> Space;
+  typedef typename GV::template Codim<0>::Iterator ElementIterator;
+
+  public:
+    typedef typename U::BaseT V;
+    typedef V domain_type;
+    typedef V range_type;
+    typedef typename V::field_type field_type;
+    enum {category=Dune::SolverCategory::sequential};
+
+    MatrixFreeJacobian(const GV& gv, const GFS& gfs, const LOP& lop_, const CC& cc) :
+      lop(lop_), x(gfs.globalSize())
+    {
+      if (gv.comm().size() > 1)
+        DUNE_THROW(Dune::NotImplemented, "The matrix-free Jacobian runs on one process");
+      LFS lfs(gfs);
+      for (ElementIterator it = gv.template begin<0>(); it != gv.template end<0>(); ++it)
+      {
+        if (!it->geometry().affine())
+          DUNE_THROW(Dune::NotImplemented, "The matrix-free Jacobian needs affine elements");
+        lfs.bind(*it);
+        Element element;
+        element.geo = typename Element::Geometry(it->geometry());
+        // the finite element maps hand out a fixed set of elements
+        element.fe = &lfs.finiteElement();
+        element.offset = indices.size();
+        for (size_t i = 0; i < lfs.size(); i++)
+          indices.push_back(lfs.globalIndex(i));
+        elements.push_back(element);
+      }
+      constrained.assign(gfs.globalSize(), false);
+      for (typename CC::const_iterator it = cc.begin(); it != cc.end(); ++it)
+        constrained[it->first] = true;
+      x = 0.0;
+    }
+
+    /// Linearize at the coefficients u
+    void setLinearizationPoint(const U& u)
+    {
+      x = u.base();
+    }
+
+    virtual void apply(const V& z, V& y) const
+    {
+      y = 0.0;
+      applyscaleadd(1.0, z, y);
+    }
+
+    virtual void applyscaleadd(field_type alpha, const V& z, V& y) const
+    {
+      std::vector<double> xl, zl, yl;
+      for (size_t e = 0; e < elements.size(); e++)
+      {
+        const Element& element = elements[e];
+        const Space space(*element.fe);
+        const size_t n = space.size();
+        const size_t* index = &indices[element.offset];
+        xl.resize(n);
+        zl.resize(n);
+        yl.assign(n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+          xl[i] = x[index[i]][0];
+          zl[i] = constrained[index[i]] ? 0.0 : z[index[i]][0];
+        }
+        LocalAccumulator accumulator(yl);
+        lop.jacobian_apply_volume(element, space, LocalCoefficients(xl), LocalCoefficients(zl),
+            space, accumulator);
+        for (size_t i = 0; i < n; i++)
+          if (!constrained[index[i]])
+            y[index[i]][0] += alpha * yl[i];
+      }
+      for (size_t g = 0; g < constrained.size(); g++)
+        if (constrained[g])
+          y[g][0] += alpha * z[g][0];
+    }
+
+    /// Diagonal of the Jacobian at the linearization point
+    void diagonal(V& d) const
+    {
+      d = 0.0;
+      std::vector<double> xl, dl;
+      for (size_t e = 0; e < elements.size(); e++)
+      {
+        const Element& element = elements[e];
+        const Space space(*element.fe);
+        const size_t n = space.size();
+        const size_t* index = &indices[element.offset];
+        xl.resize(n);
+        dl.assign(n, 0.0);
+        for (size_t i = 0; i < n; i++)
+          xl[i] = x[index[i]][0];
+        LocalDiagonal diagonal(dl);
+        lop.jacobian_volume(element, space, LocalCoefficients(xl), space, diagonal);
+        for (size_t i = 0; i < n; i++)
+          d[index[i]][0] += dl[i];
+      }
+      for (size_t g = 0; g < constrained.size(); g++)
+        if (constrained[g])
+          d[g][0] = 1.0;
+    }
+
+    bool isConstrained(size_t g) const { return constrained[g]; }
+
+  private:
+    const LOP& lop;
+    V x;
+    std::vector<Element> elements;
+    std::vector<size_t> indices;
+    std::vector<bool> constrained;
+};
+
+/// Basis function i of a local basis as a local function for the interpolation
+template<class LB>
+class LocalBasisFunction
+{
+  typedef typename LB::Traits::DomainType DomainType;
+  typedef typename LB::Traits::RangeType RangeType;
+
+  public:
+    LocalBasisFunction(const LB& basis_, size_t i_) :
+      basis(basis_), i(i_), values(basis_.size()) {}
+
+    void evaluate(const DomainType& x, RangeType& y) const
+    {
+      basis.evaluateFunction(x, values);
+      y = values[i];
+    }
+
+  private:
+    const LB& basis;
+    const size_t i;
+    mutable std::vector<RangeType> values;
+};
+
+// ------------------------------------------------------------------------
+/// Two level preconditioner with P1 on the same grid as the coarse space
+// ------------------------------------------------------------------------
+/*!
+   The coarse correction uses one AMG cycle on the Jacobian of the P1
+   problem, linearized at the interpolant of the iterate. The P1 functions
+   are interpolated into the high order space to transfer between the two.
+
+   \param LOP the local operator, the P1 one is given with its own
+              integration order
+*/
+template<class GV, class GFS, class B, class LOP, class Jacobian, class U>
+class P1CoarsePreconditioner :
+  public Dune::Preconditioner<typename U::BaseT, typename U::BaseT>
+{
+  typedef typename GV::Grid::ctype ctype;
+  static const int dim = GV::dimension;
+#if GRIDDIM == 2
+  typedef Dune::PDELab::Pk2DLocalFiniteElementMap<GV, ctype, Real, 1> FEM1;
+#elif GRIDDIM == 3
+  typedef Dune::PDELab::Pk3DLocalFiniteElementMap<GV, ctype, Real, 1> FEM1;
+#endif
+  typedef Dune::PDELab::ISTLVectorBackend<1> VBE;
+#if HAVE_MPI
+  typedef Dune::PDELab::NonoverlappingConformingDirichletConstraints CON;
+#else
+  typedef Dune::PDELab::ConformingDirichletConstraints CON;
+#endif
+  typedef Dune::PDELab::GridFunctionSpace<GV,FEM1,CON,VBE> GFS1;
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS1,Real>::Type U1;
+  typedef typename GFS1::template ConstraintsContainer<Real>::Type CC1;
+  typedef Dune::PDELab::ISTLBCRSMatrixBackend<1,1> MBE;
+#if HAVE_MPI
+  typedef Dune::PDELab::GridOperator<GFS1,GFS1,LOP,MBE,Real,Real,Real,CC1,CC1,true> GO1;
+#else
+  typedef Dune::PDELab::GridOperator<GFS1,GFS1,LOP,MBE,Real,Real,Real,CC1,CC1> GO1;
+#endif
+  typedef typename GO1::Traits::Jacobian M1;
+  typedef typename M1::BaseT Matrix;
+  typedef typename U1::BaseT V1;
+  typedef Dune::MatrixAdapter<Matrix,V1,V1> Operator;
+  typedef Dune::SeqSSOR<Matrix,V1,V1> Smoother;
+  typedef Dune::Amg::AMG<Operator,V1,Smoother> AMG;
+  typedef Dune::Amg::CoarsenCriterion<
+    Dune::Amg::SymmetricCriterion<Matrix,Dune::Amg::FirstDiagonal> > Criterion;
+
+  typedef Dune::PDELab::LocalFunctionSpace<GFS> LFS;
+  typedef Dune::PDELab::LocalFunctionSpace<GFS1> LFS1;
+  typedef typename LFS1::Traits::FiniteElementType::Traits::LocalBasisType LB1;
+  typedef typename GV::template Codim<0>::Iterator ElementIterator;
+
+  public:
+    typedef typename U::BaseT V;
+    typedef V domain_type;
+    typedef V range_type;
+    typedef typename V::field_type field_type;
+    enum {category=Dune::SolverCategory::sequential};
+
+    P1CoarsePreconditioner(const GV& gv, const GFS& gfs_, const B& b, const LOP& lop,
+        const Jacobian& jacobian_, double omega_ = 2./3.) :
+      gfs(gfs_), jacobian(jacobian_), omega(omega_), fem1(gv), gfs1(gv,fem1,con),
+      d(gfs_.globalSize()), r(gfs_.globalSize())
+    {
+#if HAVE_MPI
+      con.compute_ghosts(gfs1);
+#endif
+      Dune::PDELab::constraints(b,gfs1,cc1);
+      go1.reset(new GO1(gfs1,cc1,gfs1,cc1,lop));
+      u1.reset(new U1(gfs1,0.0));
+      A1.reset(new M1(*go1));
+      constrained1.assign(gfs1.globalSize(), false);
+      for (typename CC1::const_iterator it = cc1.begin(); it != cc1.end(); ++it)
+        constrained1[it->first] = true;
+
+      // coefficients of the P1 basis functions in the high order basis
+      std::vector<std::map<size_t,double> > rows(gfs.globalSize());
+      LFS lfs(gfs);
+      LFS1 lfs1(gfs1);
+      std::vector<Real> coefficients;
+      for (ElementIterator it = gv.template begin<0>(); it != gv.template end<0>(); ++it)
+      {
+        lfs.bind(*it);
+        lfs1.bind(*it);
+        for (size_t j = 0; j < lfs1.size(); j++)
+        {
+          const LocalBasisFunction<LB1> f(lfs1.finiteElement().localBasis(), j);
+          lfs.finiteElement().localInterpolation().interpolate(f, coefficients);
+          for (size_t i = 0; i < lfs.size(); i++)
+            if (std::abs(coefficients[i]) > 1e-12 && !jacobian.isConstrained(lfs.globalIndex(i)))
+              rows[lfs.globalIndex(i)][lfs1.globalIndex(j)] = coefficients[i];
+        }
+      }
+      rowStart.push_back(0);
+      for (size_t g = 0; g < rows.size(); g++)
+      {
+        for (std::map<size_t,double>::const_iterator it = rows[g].begin(); it != rows[g].end(); ++it)
+        {
+          columns.push_back(it->first);
+          weights.push_back(it->second);
+        }
+        rowStart.push_back(columns.size());
+      }
+    }
+
+    /// Linearize at the coefficients u, after MatrixFreeJacobian::setLinearizationPoint()
+    void update(const U& u)
+    {
+      typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+      const DGF dgf(gfs,u);
+      Dune::PDELab::interpolate(dgf,gfs1,*u1);
+      *A1 = 0.0;
+      go1->jacobian(*u1,*A1);
+      jacobian.diagonal(d);
+
+      amg.reset();
+      op.reset(new Operator(A1->base()));
+      Criterion criterion(15,2000);
+      criterion.setDefaultValuesIsotropic(dim);
+      criterion.setDebugLevel(0);
+      typename Dune::Amg::SmootherTraits<Smoother>::Arguments smootherArgs;
+      smootherArgs.iterations = 1;
+      smootherArgs.relaxationFactor = 1.0;
+      amg.reset(new AMG(*op,criterion,smootherArgs));
+    }
+
+    virtual void pre(V& x, V& b)
+    {
+      ec.reset(new V1(u1->base()));
+      rc.reset(new V1(u1->base()));
+      *ec = 0.0;
+      *rc = 0.0;
+      amg->pre(*ec,*rc);
+    }
+
+    virtual void apply(V& v, const V& defect)
+    {
+      // coarse correction
+      *rc = 0.0;
+      for (size_t g = 0; g+1 < rowStart.size(); g++)
+        for (size_t k = rowStart[g]; k < rowStart[g+1]; k++)
+          (*rc)[columns[k]][0] += weights[k] * defect[g][0];
+      for (size_t g = 0; g < constrained1.size(); g++)
+        if (constrained1[g])
+          (*rc)[g][0] = 0.0;
+      *ec = 0.0;
+      amg->apply(*ec,*rc);
+      for (size_t g = 0; g+1 < rowStart.size(); g++)
+      {
+        v[g][0] = 0.0;
+        for (size_t k = rowStart[g]; k < rowStart[g+1]; k++)
+          v[g][0] += weights[k] * (*ec)[columns[k]][0];
+      }
+
+      // damped Jacobi step with the high order Jacobian
+      r = defect;
+      jacobian.applyscaleadd(-1.0, v, r);
+      for (size_t g = 0; g < d.N(); g++)
+        v[g][0] += omega * r[g][0] / d[g][0];
+    }
+
+    virtual void post(V& x)
+    {
+      amg->post(*ec);
+    }
+
+  private:
+    const GFS& gfs;
+    const Jacobian& jacobian;
+    const double omega;
+    FEM1 fem1;
+    CON con;
+    GFS1 gfs1;
+    CC1 cc1;
+    std::auto_ptr<GO1> go1;
+    std::auto_ptr<U1> u1;
+    std::auto_ptr<M1> A1;
+    std::auto_ptr<Operator> op;
+    std::auto_ptr<AMG> amg;
+    std::auto_ptr<V1> ec, rc;
+    std::vector<bool> constrained1;
+    V d, r;
+    // transfer from P1, row g holds the P1 functions at the high order node g
+    std::vector<size_t> rowStart, columns;
+    std::vector<double> weights;
+};
+
+// ------------------------------------------------------------------------
+/// Newton solver with a matrix-free Jacobian
+// ------------------------------------------------------------------------
+/*!
+   Follows Dune::PDELab::Newton as the driver configures it: the linear
+   reduction is adapted to the quadratic convergence and the line search
+   is the one of Hackbusch and Reusken, accepting the best step if none
+   reduces the defect enough. The linear systems are solved with BiCGSTAB.
+*/
+template<class GO, class CC, class Jacobian, class Preconditioner, class U>
+class MatrixFreeNewton
+{
+  typedef typename U::BaseT V;
+
+  public:
+    MatrixFreeNewton(const GO& go_, const CC& cc_, Jacobian& jacobian_,
+        Preconditioner& preconditioner_, U& u_) :
+      go(go_), cc(cc_), jacobian(jacobian_), preconditioner(preconditioner_), u(u_),
+      verbosity(0), reduction(1e-8), absoluteLimit(1e-12), minLinearReduction(1e-3),
+      maxIterations(40), lineSearchMaxIterations(10)
+    {}
+
+    void setVerbosityLevel(unsigned int verbosity_) { verbosity = verbosity_; }
+    void setReduction(double reduction_) { reduction = reduction_; }
+    void setAbsoluteLimit(double absoluteLimit_) { absoluteLimit = absoluteLimit_; }
+    void setMinLinearReduction(double minLinearReduction_) { minLinearReduction = minLinearReduction_; }
+    void setMaxIterations(unsigned int maxIterations_) { maxIterations = maxIterations_; }
+    void setLineSearchMaxIterations(unsigned int lineSearchMaxIterations_)
+    {
+      lineSearchMaxIterations = lineSearchMaxIterations_;
+    }
+
+    void apply()
+    {
+      U r(u), z(u), b(u), trial(u);
+      double defect = residual(u, r);
+      const double firstDefect = defect;
+      double previousDefect = defect;
+      const double stopDefect = std::max(firstDefect * reduction, absoluteLimit);
+      if (verbosity > 0)
+        std::cout << "  Initial defect: " << defect << std::endl;
+
+      for (unsigned int iteration = 1; defect > stopDefect; iteration++)
+      {
+        if (iteration > maxIterations)
+          DUNE_THROW(Dune::PDELab::NewtonNotConverged, "MatrixFreeNewton::apply(): maximum "
+              "number of iterations (" << maxIterations << ") reached");
+
+        // a linear reduction of defect^2/previous^2 keeps the convergence quadratic
+        double linearReduction = defect*defect / (previousDefect*previousDefect);
+        if (stopDefect / (10*defect) > linearReduction)
+          linearReduction = stopDefect / (10*defect);
+        else
+          linearReduction = std::min(minLinearReduction, linearReduction);
+
+        jacobian.setLinearizationPoint(u);
+        preconditioner.update(u);
+        z = 0.0;
+        b = r;
+        Dune::BiCGSTABSolver<V> solver(jacobian, preconditioner, linearReduction, 5000,
+            verbosity > 1 ? 1 : 0);
+        Dune::InverseOperatorResult stat;
+        solver.apply(z.base(), b.base(), stat);
+        if (!stat.converged)
+          DUNE_THROW(Dune::PDELab::NewtonLinearSolverError, "MatrixFreeNewton::apply(): "
+              "linear solver did not converge in " << stat.iterations << " iterations");
+
+        // line search, keeping the best step
+        double lambda = 1.0, best = 0.0, bestDefect = defect;
+        for (unsigned int k = 0; k < lineSearchMaxIterations; k++, lambda *= 0.5)
+        {
+          trial = u;
+          trial.axpy(-lambda, z);
+          const double trialDefect = residual(trial, r);
+          if (trialDefect < bestDefect) {
+            best = lambda;
+            bestDefect = trialDefect;
+          }
+          if (trialDefect <= (1.0 - 0.25*lambda) * defect)
+            break;
+        }
+        if (best == 0.0)
+          DUNE_THROW(Dune::PDELab::NewtonLineSearchError, "MatrixFreeNewton::apply(): "
+              "line search did not reduce the defect");
+        u.axpy(-best, z);
+        // r holds the residual of the last step tried
+        if (best != lambda)
+          residual(u, r);
+
+        previousDefect = defect;
+        defect = bestDefect;
+        if (verbosity > 0)
+          std::cout << "  Newton iteration " << iteration << ": defect " << defect
+                    << ", step " << best << ", " << stat.iterations
+                    << " linear iterations" << std::endl;
+      }
+    }
+
+  private:
+    /// Residual at x without the Dirichlet values, returns its norm
+    double residual(const U& x, U& r) const
+    {
+      r = 0.0;
+      go.residual(x, r);
+      Dune::PDELab::set_constrained_dofs(cc, 0.0, r);
+      return r.base().two_norm();
+    }
+
+    const GO& go;
+    const CC& cc;
+    Jacobian& jacobian;
+    Preconditioner& preconditioner;
+    U& u;
+    unsigned int verbosity;
+    double reduction, absoluteLimit, minLinearReduction;
+    unsigned int maxIterations, lineSearchMaxIterations;
+};
+
+#endif  // _MATRIXFREE_HH
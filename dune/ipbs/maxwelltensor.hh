@@ -6,14 +6,13 @@
 //#include "gradient.hh"
 #include "sysparams.hh"
 
-extern SysParams sysParams;
-
 /** \brief Get the Maxwell stress tensor
  
     Some more description :-)
 */
 
 /*!
+   \param sysParams the system parameters of the problem
    \param gfs the grid function space
    \param it iterator refering to the element where the evaluation should be done
    \param u solution vector
@@ -23,7 +22,7 @@ extern SysParams sysParams;
 template <typename GFS, typename Iterator, typename U>
 Dune::FieldMatrix<Real, GFS::Traits::GridViewType::dimension,
   GFS::Traits::GridViewType::dimension>
-  maxwelltensor(const GFS& gfs, const Iterator& it, 
+  maxwelltensor(SysParams& sysParams, const GFS& gfs, const Iterator& it, 
       const Dune::FieldVector<double,GFS::Traits::GridViewType::dimension>& global, const U& u)
 {
   const int dim = GFS::Traits::GridViewType::dimension;
@@ -55,10 +54,12 @@ Dune::FieldMatrix<Real, GFS::Traits::GridViewType::dimension,
 
   // for the correct force on the particles not only electrostatic but also osmotic pressure has to be included!
   // this is in principle proportional to n_+ + n_- - 2c_s = 2 * ( cosh (phi) - 1 )
+  // (linearized to phi^2 / 2 for salt = 2)
+  const double osmotic = sysParams.get_salt() == 2 ? .5 * value * value : std::cosh(value) - 1.0;
   for (int i = 0; i < dim; i++)
   {
     //res[i][i] -= 1.0/(4.0 * sysParams.pi * sysParams.get_bjerrum()) * .5 * gradphi.two_norm2();
-    res[i][i] -= 1.0/(4.0 * sysParams.pi * sysParams.get_bjerrum()) * ( sysParams.get_lambda2i() * (std::cosh(value) - 1.0) + .5 * gradphi.two_norm2());
+    res[i][i] -= 1.0/(4.0 * sysParams.pi * sysParams.get_bjerrum()) * ( sysParams.get_lambda2i() * osmotic + .5 * gradphi.two_norm2());
   }
   return res;
 }
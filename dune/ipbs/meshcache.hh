@@ -0,0 +1,346 @@
+#ifndef _MESHCACHE_HH
+#define _MESHCACHE_HH
+
+/** \file
+    \brief Binary cache of meshes read from gmsh files
+
+    Parsing a large ASCII .msh file takes much longer than building the grid
+    from it. The first run on a mesh records the vertices, elements and
+    boundary segments the GmshReader inserts into the grid factory, together
+    with the physical groups of elements and boundary segments, in a binary
+    file named after a hash (64 bit FNV-1a) of the .msh content. Later runs,
+    and the other members of an ensemble or a sweep, map this file into
+    memory and insert its arrays into the factory without parsing. Editing
+    the mesh changes the hash, so a stale cache is never used.
+
+    Meshes with curved boundary segments (second order gmsh elements) are
+    not cached.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fvector.hh>
+#include <dune/common/shared_ptr.hh>
+#include <dune/geometry/type.hh>
+#include <dune/grid/common/gridfactory.hh>
+#include <dune/grid/common/boundarysegment.hh>
+
+// ------------------------------------------------------------------------
+/// Read-only memory mapping of a file
+// ------------------------------------------------------------------------
+class MappedFile
+{
+  public:
+    MappedFile(const std::string& filename) : bytes(0), length(0)
+    {
+      const int fd = open(filename.c_str(), O_RDONLY);
+      if (fd < 0)
+        return;
+      struct stat info;
+      if (fstat(fd, &info) == 0 && info.st_size > 0)
+      {
+        void* p = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          bytes = static_cast<const char*>(p);
+          length = info.st_size;
+        }
+      }
+      close(fd);
+    }
+
+    ~MappedFile()
+    {
+      if (bytes)
+        munmap(const_cast<char*>(bytes), length);
+    }
+
+    bool valid() const { return bytes != 0; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* bytes;
+    size_t length;
+};
+
+// ------------------------------------------------------------------------
+/// 64 bit FNV-1a hash of the content of a file, 0 if it can not be read
+// ------------------------------------------------------------------------
+inline uint64_t file_hash(const std::string& filename)
+{
+  const MappedFile file(filename);
+  if (!file.valid())
+    return 0;
+  uint64_t hash = 14695981039346656037ULL;
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(file.data());
+  for (size_t i = 0; i < file.size(); i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// Name of the cache file of a mesh in directory cache, empty if the mesh can not be read
+inline std::string mesh_cache_filename(const std::string& cache, const std::string& meshfile)
+{
+  const uint64_t hash = file_hash(meshfile);
+  if (hash == 0)
+    return "";
+  std::ostringstream filename;
+  filename << cache << "/mesh_" << std::hex << std::setw(16) << std::setfill('0')
+           << hash << ".cache";
+  return filename.str();
+}
+
+namespace MeshCacheIO
+{
+  const char magic[8] = {'I','P','B','S','M','S','H','1'};
+
+  struct Header
+  {
+    char magic[8];
+    int dim;
+    int dimworld;
+    unsigned long nvertices;
+    unsigned long nelements;
+    unsigned long ncorners;	// of all elements
+    unsigned long nsegments;
+    unsigned long nsegmentCorners;
+    unsigned long nelementEntities;
+    unsigned long nboundaryEntities;
+  };
+
+  template<typename T>
+  void write(std::ofstream& out, const std::vector<T>& v)
+  {
+    if (!v.empty())
+      out.write(reinterpret_cast<const char*>(&v[0]), v.size()*sizeof(T));
+  }
+
+  /// Array of n values at offset, which is advanced
+  template<typename T>
+  const T* array(const char* data, size_t& offset, size_t n)
+  {
+    const T* p = reinterpret_cast<const T*>(data + offset);
+    offset += n * sizeof(T);
+    return p;
+  }
+}
+
+// ------------------------------------------------------------------------
+/// Grid factory recording what a reader inserts, for writing it to the cache
+// ------------------------------------------------------------------------
+template<class GridType>
+class RecordingGridFactory : public Dune::GridFactory<GridType>
+{
+  typedef Dune::GridFactory<GridType> Base;
+  typedef typename GridType::ctype ctype;
+  static const int dim = GridType::dimension;
+  static const int dimworld = GridType::dimensionworld;
+
+  public:
+    RecordingGridFactory() : recording(false), cacheable(true) {}
+
+    /// Factory creating the grid on a communicator, for the grid managers supporting it
+    template<class Communicator>
+    explicit RecordingGridFactory(const Communicator& communicator) :
+      Base(communicator), recording(false), cacheable(true)
+    {}
+
+    /// Start recording the inserted entities
+    void record()
+    {
+      recording = true;
+    }
+
+    virtual void insertVertex(const Dune::FieldVector<ctype,dimworld>& pos)
+    {
+      if (recording)
+        for (int d = 0; d < dimworld; d++)
+          vertices.push_back(pos[d]);
+      Base::insertVertex(pos);
+    }
+
+    virtual void insertElement(const Dune::GeometryType& type,
+                               const std::vector<unsigned int>& corners)
+    {
+      if (recording) {
+        elementTypes.push_back(type.id());
+        elementTypes.push_back(type.dim());
+        elementCorners.insert(elementCorners.end(), corners.begin(), corners.end());
+        elementOffsets.push_back(elementCorners.size());
+      }
+      Base::insertElement(type, corners);
+    }
+
+    virtual void insertBoundarySegment(const std::vector<unsigned int>& corners)
+    {
+      if (recording) {
+        segmentCorners.insert(segmentCorners.end(), corners.begin(), corners.end());
+        segmentOffsets.push_back(segmentCorners.size());
+      }
+      Base::insertBoundarySegment(corners);
+    }
+
+    virtual void insertBoundarySegment(const std::vector<unsigned int>& corners,
+        const Dune::shared_ptr<Dune::BoundarySegment<dim,dimworld> > segment)
+    {
+      // the parametrization of a curved segment can not be stored
+      cacheable = false;
+      Base::insertBoundarySegment(corners, segment);
+    }
+
+    // ------------------------------------------------------------------------
+    /// Write the recorded mesh and the physical groups to filename
+    // ------------------------------------------------------------------------
+    /*!
+       The file is written under a temporary name and moved afterwards, so
+       runs reading the cache at the same time never see a partial file.
+
+       \return false if nothing cacheable was recorded or the file could not be
+               written
+    */
+    template<typename PGMap>
+    bool write(const std::string& filename, const PGMap& elementIndexToEntity,
+               const PGMap& boundaryIndexToEntity) const
+    {
+      if (!recording || !cacheable || elementTypes.empty())
+        return false;
+
+      MeshCacheIO::Header header;
+      std::copy(MeshCacheIO::magic, MeshCacheIO::magic+8, header.magic);
+      header.dim = dim;
+      header.dimworld = dimworld;
+      header.nvertices = vertices.size() / dimworld;
+      header.nelements = elementTypes.size() / 2;
+      header.ncorners = elementCorners.size();
+      header.nsegments = segmentOffsets.size();
+      header.nsegmentCorners = segmentCorners.size();
+      header.nelementEntities = elementIndexToEntity.size();
+      header.nboundaryEntities = boundaryIndexToEntity.size();
+
+      const std::vector<int> elementEntities(elementIndexToEntity.begin(),
+                                             elementIndexToEntity.end());
+      const std::vector<int> boundaryEntities(boundaryIndexToEntity.begin(),
+                                              boundaryIndexToEntity.end());
+      std::vector<unsigned int> elementStarts(1, 0), segmentStarts(1, 0);
+      elementStarts.insert(elementStarts.end(), elementOffsets.begin(), elementOffsets.end());
+      segmentStarts.insert(segmentStarts.end(), segmentOffsets.begin(), segmentOffsets.end());
+
+      std::ostringstream tmpname;
+      tmpname << filename << ".tmp" << getpid();
+      std::ofstream out(tmpname.str().c_str(), std::ios::binary);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      MeshCacheIO::write(out, vertices);
+      MeshCacheIO::write(out, elementTypes);
+      MeshCacheIO::write(out, elementStarts);
+      MeshCacheIO::write(out, elementCorners);
+      MeshCacheIO::write(out, segmentStarts);
+      MeshCacheIO::write(out, segmentCorners);
+      MeshCacheIO::write(out, elementEntities);
+      MeshCacheIO::write(out, boundaryEntities);
+      out.close();
+      if (!out || std::rename(tmpname.str().c_str(), filename.c_str()) != 0) {
+        std::remove(tmpname.str().c_str());
+        return false;
+      }
+      return true;
+    }
+
+  private:
+    bool recording;
+    bool cacheable;
+    std::vector<double> vertices;
+    std::vector<unsigned int> elementTypes;	// topology id and dimension
+    std::vector<unsigned int> elementOffsets;	// end of the corners of each element
+    std::vector<unsigned int> elementCorners;
+    std::vector<unsigned int> segmentOffsets;
+    std::vector<unsigned int> segmentCorners;
+};
+
+// ------------------------------------------------------------------------
+/// Insert a cached mesh into a grid factory and read its physical groups
+// ------------------------------------------------------------------------
+/*!
+   \return false if the cache does not exist or does not fit the grid type,
+           nothing is inserted then
+*/
+template<class GridType, typename PGMap>
+bool read_mesh_cache(const std::string& filename, Dune::GridFactory<GridType>& factory,
+                     PGMap& elementIndexToEntity, PGMap& boundaryIndexToEntity)
+{
+  typedef typename GridType::ctype ctype;
+  const int dim = GridType::dimension;
+  const int dimworld = GridType::dimensionworld;
+
+  const MappedFile file(filename);
+  if (!file.valid() || file.size() < sizeof(MeshCacheIO::Header))
+    return false;
+  const MeshCacheIO::Header& header =
+    *reinterpret_cast<const MeshCacheIO::Header*>(file.data());
+  if (std::string(header.magic, 8) != std::string(MeshCacheIO::magic, 8)
+      || header.dim != dim || header.dimworld != dimworld)
+    return false;
+  const size_t expected = sizeof(header)
+    + header.nvertices * dimworld * sizeof(double)
+    + (2*header.nelements + header.nelements+1 + header.ncorners
+       + header.nsegments+1 + header.nsegmentCorners) * sizeof(unsigned int)
+    + (header.nelementEntities + header.nboundaryEntities) * sizeof(int);
+  if (file.size() != expected)
+    return false;
+
+  size_t offset = sizeof(header);
+  const double* vertices =
+    MeshCacheIO::array<double>(file.data(), offset, header.nvertices * dimworld);
+  const unsigned int* types =
+    MeshCacheIO::array<unsigned int>(file.data(), offset, 2*header.nelements);
+  const unsigned int* elementStarts =
+    MeshCacheIO::array<unsigned int>(file.data(), offset, header.nelements+1);
+  const unsigned int* elementCorners =
+    MeshCacheIO::array<unsigned int>(file.data(), offset, header.ncorners);
+  const unsigned int* segmentStarts =
+    MeshCacheIO::array<unsigned int>(file.data(), offset, header.nsegments+1);
+  const unsigned int* segmentCorners =
+    MeshCacheIO::array<unsigned int>(file.data(), offset, header.nsegmentCorners);
+  const int* elementEntities =
+    MeshCacheIO::array<int>(file.data(), offset, header.nelementEntities);
+  const int* boundaryEntities =
+    MeshCacheIO::array<int>(file.data(), offset, header.nboundaryEntities);
+
+  Dune::FieldVector<ctype,dimworld> pos;
+  for (size_t v = 0; v < header.nvertices; v++) {
+    for (int d = 0; d < dimworld; d++)
+      pos[d] = vertices[v*dimworld + d];
+    factory.insertVertex(pos);
+  }
+  std::vector<unsigned int> corners;
+  for (size_t e = 0; e < header.nelements; e++) {
+    corners.assign(elementCorners + elementStarts[e], elementCorners + elementStarts[e+1]);
+    factory.insertElement(Dune::GeometryType(types[2*e], types[2*e+1]), corners);
+  }
+  for (size_t s = 0; s < header.nsegments; s++) {
+    corners.assign(segmentCorners + segmentStarts[s], segmentCorners + segmentStarts[s+1]);
+    factory.insertBoundarySegment(corners);
+  }
+  elementIndexToEntity.assign(elementEntities, elementEntities + header.nelementEntities);
+  boundaryIndexToEntity.assign(boundaryEntities, boundaryEntities + header.nboundaryEntities);
+  return true;
+}
+
+#endif  // _MESHCACHE_HH
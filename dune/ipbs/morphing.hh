@@ -0,0 +1,90 @@
+#ifndef _MORPHING_HH
+#define _MORPHING_HH
+
+/** \file
+    \brief Coordinate function moving one particle by deforming the mesh
+
+    Used as coordinate function of a Dune::GeometryGrid on top of the grid
+    read from the mesh file (build with -DMORPHING). The vertices within
+    innerRadius of the particle center are translated rigidly by the
+    displacement, beyond outerRadius they stay fixed, and in between the
+    displacement is blended smoothly:
+    \f[ x \mapsto x + s \, w(|x-c|) \, e, \qquad
+        w(r) = 1 - 3t^2 + 2t^3, \quad t = \frac{r-r_i}{r_o-r_i} \f]
+    The topology, and with it all index sets and the function space, stays
+    the same, only the geometry changes. The mesh stays valid as long as the
+    displacement is small compared to the width of the blending shell.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include <dune/common/fvector.hh>
+#include <dune/grid/geometrygrid.hh>
+#include <dune/grid/geometrygrid/coordfunction.hh>
+
+template<typename ctype, int dim>
+class MorphingCoordinates
+  : public Dune::AnalyticalCoordFunction<ctype, dim, dim, MorphingCoordinates<ctype,dim> >
+{
+  typedef Dune::AnalyticalCoordFunction<ctype, dim, dim, MorphingCoordinates<ctype,dim> > Base;
+
+public:
+  typedef typename Base::DomainVector DomainVector;
+  typedef typename Base::RangeVector RangeVector;
+
+  /// \param direction_ coordinate axis along which the particle is moved
+  MorphingCoordinates(const int direction_) :
+    direction(direction_), center(0.), innerRadius(0.), outerRadius(1.), shift(0.)
+  {}
+
+  /// Region that is moved, in the coordinates of the mesh file
+  void setRegion(const DomainVector& center_, double innerRadius_, double outerRadius_)
+  {
+    center = center_;
+    innerRadius = innerRadius_;
+    outerRadius = outerRadius_;
+  }
+
+  /// Displacement relative to the mesh file
+  void setDisplacement(double shift_)
+  {
+    shift = shift_;
+  }
+
+  double displacement() const
+  {
+    return shift;
+  }
+
+  /// Largest relative stretching of the blending shell, should stay well below 1
+  double maxStrain() const
+  {
+    return 1.5 * std::abs(shift) / (outerRadius - innerRadius);
+  }
+
+  void evaluate(const DomainVector& x, RangeVector& y) const
+  {
+    y = x;
+    DomainVector d = x;
+    d -= center;
+    const double r = d.two_norm();
+    double w = 0.;
+    if (r <= innerRadius)
+      w = 1.;
+    else if (r < outerRadius) {
+      const double t = (r - innerRadius) / (outerRadius - innerRadius);
+      w = 1. - t*t*(3. - 2.*t);
+    }
+    y[direction] += shift * w;
+  }
+
+private:
+  const int direction;
+  DomainVector center;
+  double innerRadius;
+  double outerRadius;
+  double shift;
+};
+
+#endif  // _MORPHING_HH
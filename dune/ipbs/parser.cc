@@ -10,16 +10,122 @@
 */
 
 #include<string>
+#include<sstream>
+#include<vector>
+#include<dune/common/exceptions.hh>
 #include<dune/common/parametertree.hh>
 #include<dune/common/parametertreeparser.hh>
-#include "sysparams.hh"
-#include "boundary.hh"
+#include "context.hh"
 
-extern SysParams sysParams;
-extern std::vector<Boundary*> boundary;
+/** \brief Values of a key that may hold a list of values for parameter continuation
+ *
+ *  Only one key of a configuration may hold more than one value, it is
+ *  registered in sysParams and the first value is returned.
+ */
+static double parameter_list(SysParams& sysParams, const Dune::ParameterTree& configuration,
+    const std::string& key, double defaultValue)
+{
+  if (!configuration.hasKey(key))
+    return defaultValue;
+  std::istringstream in(configuration.get<std::string>(key));
+  std::vector<double> values;
+  double value;
+  while (in >> value)
+    values.push_back(value);
+  if (values.empty() || !in.eof())
+    DUNE_THROW(Dune::Exception, "Could not read value(s) of \"" << key << "\"!");
+  if (values.size() > 1) {
+    if (!sysParams.get_continuationKey().empty())
+      DUNE_THROW(Dune::Exception, "Only one parameter can be continued, found lists for \""
+                 << sysParams.get_continuationKey() << "\" and \"" << key << "\"!");
+    sysParams.set_continuation(key, values);
+  }
+  return values[0];
+}
+
+/// Index and field of a key "boundary_<i>.<field>", false for other keys
+static bool boundary_key(const std::string& key, size_t& i, std::string& field)
+{
+  if (key.compare(0, 9, "boundary_") != 0)
+    return false;
+  std::istringstream in(key.substr(9));
+  return in >> i && std::getline(in, field);
+}
+
+bool set_parameter(IpbsContext& context, std::string key, double value)
+{
+  SysParams& sysParams = context.sysParams;
+  std::vector<Boundary*>& boundary = context.boundary;
+
+  size_t i;
+  std::string field;
+  if (key == "system.lambda") {
+    if (sysParams.get_integrationScaled()) {
+      sysParams.set_integration_l(0.15*value);
+      sysParams.set_integration_d(0.075*value);
+    }
+    sysParams.set_lambda(value);
+  }
+  else if (key == "system.pH")
+    sysParams.set_pH(value);
+  else if (key == "system.epsilon") {
+    sysParams.set_epsilon(value);
+    for (size_t j = 0; j < boundary.size(); j++)
+      boundary[j]->set_epsilons(boundary[j]->get_epsilon(), value);
+  }
+  else if (key == "system.salt")
+    sysParams.set_salt(int(value));
+  else if (boundary_key(key, i, field) && i < boundary.size()
+      && (field == ".charge_density" || field == ".pK" || field == ".potential")) {
+    if (field == ".charge_density")
+      boundary[i]->set_charge_density(value);
+    else if (field == ".pK")
+      boundary[i]->set_pK(value);
+    else
+      boundary[i]->set_potential(value);
+  }
+  else
+    return false;
+  return true;
+}
+
+void apply_parameter(IpbsContext& context, std::string key, double value)
+{
+  if (!set_parameter(context, key, value))
+    DUNE_THROW(Dune::Exception, "Parameter \"" << key << "\" can not be continued!");
+}
+
+double parameter_value(IpbsContext& context, std::string key)
+{
+  SysParams& sysParams = context.sysParams;
+  std::vector<Boundary*>& boundary = context.boundary;
+
+  size_t i;
+  std::string field;
+  if (key == "system.lambda")
+    return sysParams.get_lambda();
+  if (key == "system.pH")
+    return sysParams.get_pH();
+  if (key == "system.epsilon")
+    return sysParams.get_epsilon();
+  if (key == "system.salt")
+    return sysParams.get_salt();
+  if (boundary_key(key, i, field) && i < boundary.size()) {
+    if (field == ".charge_density")
+      return boundary[i]->get_charge_density();
+    if (field == ".pK")
+      return boundary[i]->get_pK();
+    if (field == ".potential")
+      return boundary[i]->get_potential();
+  }
+  DUNE_THROW(Dune::Exception, "Parameter \"" << key << "\" is unknown!");
+}
 
-void parser(std::string config_file)
+void parser(std::string config_file, IpbsContext& context)
 {
+  SysParams& sysParams = context.sysParams;
+  std::vector<Boundary*>& boundary = context.boundary;
+
   Dune::ParameterTree configuration;
   Dune::ParameterTreeParser parser;
   
@@ -27,9 +133,8 @@ void parser(std::string config_file)
       parser.readINITree( config_file, configuration );
   }
   catch(...){
-      std::cerr << "Could not read config file \"" 
-                << config_file << "\"!" << std::endl;
-      exit(1);
+      DUNE_THROW(Dune::IOError, "Could not read config file \""
+                 << config_file << "\"!");
   }
  
   /// default values
@@ -47,9 +152,21 @@ void parser(std::string config_file)
   
   // Mesh file must be specified
   sysParams.set_meshfile(configuration.get<std::string>("mesh.filename"));
+  // binary copy of the parsed mesh, reused by later runs on the same file
+  sysParams.set_meshCache(configuration.get<std::string>("mesh.cache",""));
+  // repartition by the cost of the boundary integration instead of element counts
+  sysParams.set_loadBalance(configuration.get<int>("mesh.load_balance",0));
   /** set the symmetry of the system
    * PARAMS */
   sysParams.set_symmetry(configuration.get<double>("mesh.symmetry"));
+  // adaptive refinement of the mesh using the residual error estimator
+  sysParams.set_refinementSteps(configuration.get<int>("mesh.adaptive_refinement_steps",0));
+  sysParams.set_refinementFraction(configuration.get<double>("mesh.adaptive_refinement_fraction",0.1));
+  sysParams.set_coarsenFraction(configuration.get<double>("mesh.adaptive_coarsening_fraction",0.));
+  // goal oriented refinement for the force on one particle instead of the global error
+  sysParams.set_adaptiveStrategy(configuration.get<int>("mesh.adaptive_strategy",0));
+  sysParams.set_goalParticle(configuration.get<int>("mesh.goal_particle",0));
+  sysParams.set_goalDirection(configuration.get<int>("mesh.goal_direction",0));
   
 
   // Parse other options
@@ -57,13 +174,30 @@ void parser(std::string config_file)
   sysParams.set_alpha_ipbs(configuration.get<double>("solver.alpha_ipbs",alpha_sor));
   sysParams.set_alpha_ic(configuration.get<double>("solver.alpha_ic",alpha_sor));
   sysParams.set_bjerrum(configuration.get<double>("system.bjerrum",bjerrum));
-  sysParams.set_lambda(configuration.get<double>("system.lambda",lambda));
+  sysParams.set_lambda(parameter_list(sysParams,configuration,"system.lambda",lambda));
   sysParams.set_tolerance(configuration.get<double>("solver.tolerance"));
+  // nested iteration: solve on the given mesh and nested_levels uniform refinements of it
+  sysParams.set_nestedLevels(configuration.get<int>("mesh.nested_levels",0));
+  sysParams.set_nestedTolerance(configuration.get<double>("solver.nested_tolerance",
+        10.*sysParams.get_tolerance()));
+  // polynomial degree (up to PDEGREE), optionally approached from P1 on
+  sysParams.set_degree(configuration.get<int>("solver.degree",0));
+  sysParams.set_pContinuation(configuration.get<bool>("solver.p_continuation",false));
+  // start from u = 0 and the flux of the bare surface charge or a Debye-Hueckel solution
+  sysParams.set_initialGuess(configuration.get<int>("solver.initial_guess",0));
+  // snapshot of a previous run (e.g. at a neighboring distance) used as initial guess
+  sysParams.set_warmStart(configuration.get<std::string>("solver.warm_start",""));
   sysParams.set_verbose(configuration.get<int>("system.verbose",verbose));
   sysParams.set_salt(configuration.get<int>("system.salt"));
-  sysParams.set_pH(configuration.get<double>("system.pH", 7.));
-  double epsilonOut = configuration.get<double>("system.epsilon");
+  sysParams.set_pH(parameter_list(sysParams,configuration,"system.pH", 7.));
+  if (!configuration.hasKey("system.epsilon"))
+    DUNE_THROW(Dune::Exception, "Key \"system.epsilon\" is missing!");
+  double epsilonOut = parameter_list(sysParams,configuration,"system.epsilon",1.);
+  sysParams.set_epsilon(epsilonOut);
   
+  // integration lengths follow the Debye length unless given explicitly
+  sysParams.set_integrationScaled(!configuration.hasKey("solver.l")
+      && !configuration.hasKey("solver.d"));
   sysParams.set_integration_l(configuration.get<double>("solver.l", 0.15*sysParams.get_lambda()));
   sysParams.set_integration_d(configuration.get<double>("solver.d", 0.075*sysParams.get_lambda()));
   sysParams.set_integration_maxintorder(configuration.get<double>("solver.maxintorder", 10));
@@ -71,6 +205,45 @@ void parser(std::string config_file)
   // Output
   sysParams.set_outStep(configuration.get<int>("output.steps",0));
   sysParams.set_outname(configuration.get<std::string>("output.name",defaultOutput));
+  sysParams.set_writeSnapshot(configuration.get<bool>("output.snapshot",false));
+  // forces, surface potentials, energy, iterations and timings in one line
+  sysParams.set_writeSummary(configuration.get<bool>("output.summary",false));
+  // derivatives of the forces with respect to the physical parameters
+  sysParams.set_sensitivities(configuration.get<bool>("output.sensitivities",false));
+
+  // Checkpoints of the iteration and restart from them
+  sysParams.set_checkpointName(configuration.get<std::string>("checkpoint.name",
+        sysParams.get_outname() + "_checkpoint"));
+  sysParams.set_checkpointInterval(configuration.get<int>("checkpoint.interval",0));
+  sysParams.set_checkpointWalltime(configuration.get<double>("checkpoint.walltime",0));
+  sysParams.set_checkpointOnSignal(configuration.get<bool>("checkpoint.on_signal",false));
+  sysParams.set_restart(configuration.get<bool>("checkpoint.restart",false));
+  sysParams.set_checkpointFinal(configuration.get<bool>("checkpoint.final",false));
+
+  // Distance sweep by moving one particle (only in executables built with MORPHING)
+  sysParams.set_morphParticle(configuration.get<int>("morph.particle",0));
+  sysParams.set_morphDirection(configuration.get<int>("morph.direction",0));
+  sysParams.set_morphIncrement(configuration.get<double>("morph.increment",0.));
+  sysParams.set_morphSteps(configuration.get<int>("morph.steps",0));
+  sysParams.set_morphInnerRadius(configuration.get<double>("morph.inner_radius",0.));
+  sysParams.set_morphOuterRadius(configuration.get<double>("morph.outer_radius",0.));
+
+  // Solve the values of the list instead as independent members on one mesh
+  sysParams.set_ensemble(configuration.get<bool>("ensemble.members",false));
+  // or all together in lock-step on blocked vectors (only in executables built with LOCKSTEP)
+  sysParams.set_lockstep(configuration.get<bool>("ensemble.lockstep",false));
+
+  // Charge combinations evaluated by superposition of unit charge solutions (salt = 2)
+  sysParams.set_superposition(configuration.get<std::string>("superposition.charges",""));
+
+  // Reduced basis model built from one table of parameter sets and evaluated for another
+  sysParams.set_reducedTraining(configuration.get<std::string>("reduced.training",""));
+  sysParams.set_reducedQueries(configuration.get<std::string>("reduced.queries",""));
+  sysParams.set_reducedTolerance(configuration.get<double>("reduced.tolerance",1e-3));
+  sysParams.set_podTolerance(configuration.get<double>("reduced.pod_tolerance",1e-8));
+
+  // Parameter updates of ipbs --serve on a UNIX socket instead of stdin and stdout
+  sysParams.set_serviceSocket(configuration.get<std::string>("service.socket",""));
 
   // Create particles
   size_t n_particle = configuration.get<size_t>("system.NPart");
@@ -85,14 +258,14 @@ void parser(std::string config_file)
     s << p_name << i; 
                         
     p_name = s.str();
-    boundary[i]->set_charge_density(configuration.get<double>(p_name+".charge_density",0));
+    boundary[i]->set_charge_density(parameter_list(sysParams,configuration,p_name+".charge_density",0));
     double epsilonIn = configuration.get<double>(p_name+".epsilon",1); 
     boundary[i]->set_epsilons(epsilonIn, epsilonOut);
     boundary[i]->set_type(configuration.get<int>(p_name+".type",0));
     boundary[i]->set_potential(configuration.get<double>(p_name+".potential",0));
     boundary[i]->set_sigma_max(configuration.get<double>(p_name+".sigma_max",0));
     boundary[i]->set_Y(configuration.get<double>(p_name+".Y",0));
-    boundary[i]->set_pK(configuration.get<double>(p_name+".pK",0));
+    boundary[i]->set_pK(parameter_list(sysParams,configuration,p_name+".pK",0));
     boundary[i]->set_ifShift(configuration.get<bool>(p_name+".shifted",true));
   }
 
@@ -5,5 +5,18 @@
     \todo Doc me!
 */
 
-void parser(std::string config_file);
+#include <string>
 
+class IpbsContext;
+
+/// Read the parameters and particles of a problem into context
+void parser(std::string config_file, IpbsContext& context);
+
+/// Set a parameter that was given as a list (see SysParams::get_continuationKey)
+void apply_parameter(IpbsContext& context, std::string key, double value);
+
+/// Set a parameter as apply_parameter() does, false if it can not be changed
+bool set_parameter(IpbsContext& context, std::string key, double value);
+
+/// Value of a parameter given by a key as in apply_parameter()
+double parameter_value(IpbsContext& context, std::string key);
@@ -0,0 +1,225 @@
+#ifndef _PHYSICALGROUPS_HH
+#define _PHYSICALGROUPS_HH
+
+/** \file
+    \brief Physical groups of the elements and boundary segments of a distributed grid
+
+    The grid managers build a parallel grid from the macro grid inserted on
+    rank 0 and distribute it with loadBalance(). The physical groups the
+    GmshReader returns refer to the insertion order on rank 0. Before the
+    load balancing they are attached to the global ids of the elements.
+    Afterwards every process gets the groups of its own level 0 elements and
+    boundary segments from rank 0, in one gather and one scatter, instead of
+    a broadcast of the whole boundary map.
+
+    elementIndexToEntity is then indexed by the level 0 index of an element
+    on its process. boundaryIndexToEntity keeps the indexing by
+    boundarySegmentIndex(), with -1 for segments of other processes.
+*/
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <dune/common/mpihelper.hh>
+#include <dune/grid/common/gridfactory.hh>
+
+#if HAVE_MPI
+// ------------------------------------------------------------------------
+/// Collect the values of all processes on rank 0, as raw bytes
+// ------------------------------------------------------------------------
+/*!
+   \param counts number of values from each process (on rank 0)
+*/
+template<typename T>
+void root_gather(MPI_Comm communicator, const std::vector<T>& local, std::vector<T>& all,
+                 std::vector<int>& counts)
+{
+  int rank, size;
+  MPI_Comm_rank(communicator, &rank);
+  MPI_Comm_size(communicator, &size);
+  int n = local.size() * sizeof(T);
+  std::vector<int> bytes(size, 0), displacements(size, 0);
+  MPI_Gather(&n, 1, MPI_INT, &bytes[0], 1, MPI_INT, 0, communicator);
+  for (int p = 1; p < size; p++)
+    displacements[p] = displacements[p-1] + bytes[p-1];
+  if (rank == 0)
+    all.resize((displacements[size-1] + bytes[size-1]) / sizeof(T));
+  T dummy = T();
+  MPI_Gatherv(local.empty() ? &dummy : const_cast<T*>(&local[0]), n, MPI_BYTE,
+      all.empty() ? &dummy : &all[0], &bytes[0], &displacements[0], MPI_BYTE,
+      0, communicator);
+  counts.resize(size);
+  for (int p = 0; p < size; p++)
+    counts[p] = bytes[p] / sizeof(T);
+}
+
+/// Send each process its part of values computed on rank 0, the reverse of root_gather()
+inline void root_scatter(MPI_Comm communicator, const std::vector<int>& all,
+                         const std::vector<int>& counts, std::vector<int>& local, size_t n)
+{
+  int size;
+  MPI_Comm_size(communicator, &size);
+  std::vector<int> displacements(size, 0);
+  for (int p = 1; p < size; p++)
+    displacements[p] = displacements[p-1] + counts[p-1];
+  local.resize(n);
+  int dummy = 0;
+  MPI_Scatterv(all.empty() ? &dummy : const_cast<int*>(&all[0]),
+      const_cast<int*>(&counts[0]), &displacements[0], MPI_INT,
+      local.empty() ? &dummy : &local[0], n, MPI_INT, 0, communicator);
+}
+#endif
+
+template<class GridType>
+class PhysicalGroups
+{
+  typedef typename GridType::Traits::GlobalIdSet::IdType IdType;
+  typedef std::pair<IdType,int> Entry;
+  typedef typename GridType::LevelGridView GV;
+  typedef typename GV::template Codim<0>::Iterator ElementIterator;
+  typedef typename GV::IntersectionIterator IntersectionIterator;
+  typedef Dune::MPIHelper::MPICommunicator Communicator;
+
+  public:
+    /// Attach the groups of the elements inserted into the factory to their global ids
+    template<typename PGMap>
+    PhysicalGroups(const GridType& grid, const Dune::GridFactory<GridType>& factory,
+                   const PGMap& elementIndexToEntity)
+    {
+      const GV gv = grid.levelView(0);
+      for (ElementIterator it = gv.template begin<0>(); it != gv.template end<0>(); ++it)
+      {
+        const unsigned int index = factory.insertionIndex(*it);
+        groups.push_back(Entry(grid.globalIdSet().id(*it),
+              index < elementIndexToEntity.size() ? elementIndexToEntity[index] : -1));
+      }
+      std::sort(groups.begin(), groups.end());
+    }
+
+    // ------------------------------------------------------------------------
+    /// Collect the groups of a distributed grid on rank 0, before it is balanced again
+    // ------------------------------------------------------------------------
+    /*!
+       \param elementIndexToEntity, boundaryIndexToEntity the groups on this
+              process as returned by distribute(), on return the groups of all
+              boundary segments on rank 0
+    */
+    template<typename PGMap>
+    PhysicalGroups(const GridType& grid, Communicator communicator,
+                   const PGMap& elementIndexToEntity, PGMap& boundaryIndexToEntity)
+    {
+      const GV gv = grid.levelView(0);
+      std::vector<Entry> local;
+      std::vector<int> segments;
+      for (ElementIterator it = gv.template begin<0>(); it != gv.template end<0>(); ++it)
+      {
+        const size_t index = gv.indexSet().index(*it);
+        local.push_back(Entry(grid.globalIdSet().id(*it),
+              index < elementIndexToEntity.size() ? elementIndexToEntity[index] : -1));
+      }
+      for (size_t s = 0; s < boundaryIndexToEntity.size(); s++)
+        if (boundaryIndexToEntity[s] >= 0) {
+          segments.push_back(s);
+          segments.push_back(boundaryIndexToEntity[s]);
+        }
+
+#if HAVE_MPI
+      int size;
+      MPI_Comm_size(communicator, &size);
+      if (size > 1)
+      {
+        std::vector<int> counts, allSegments;
+        root_gather(communicator, local, groups, counts);
+        root_gather(communicator, segments, allSegments, counts);
+        boundaryIndexToEntity.clear();
+        for (size_t k = 0; k < allSegments.size(); k += 2)
+        {
+          if (allSegments[k] >= int(boundaryIndexToEntity.size()))
+            boundaryIndexToEntity.resize(allSegments[k]+1, -1);
+          boundaryIndexToEntity[allSegments[k]] = allSegments[k+1];
+        }
+      }
+      else
+#endif
+        groups = local;
+      std::sort(groups.begin(), groups.end());
+    }
+
+    // ------------------------------------------------------------------------
+    /// Groups of the elements and boundary segments of this process after load balancing
+    // ------------------------------------------------------------------------
+    /*!
+       \param boundaryIndexToEntity on entry the groups of all boundary
+                                    segments on rank 0
+    */
+    template<typename PGMap>
+    void distribute(const GridType& grid, Communicator communicator,
+                    PGMap& elementIndexToEntity, PGMap& boundaryIndexToEntity) const
+    {
+      // ids of the level 0 elements and the boundary segments on this process
+      const GV gv = grid.levelView(0);
+      std::vector<IdType> ids(gv.size(0), IdType());
+      std::vector<int> segments;
+      for (ElementIterator it = gv.template begin<0>(); it != gv.template end<0>(); ++it)
+      {
+        ids[gv.indexSet().index(*it)] = grid.globalIdSet().id(*it);
+        for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii)
+          if (ii->boundary())
+            segments.push_back(ii->boundarySegmentIndex());
+      }
+      std::sort(segments.begin(), segments.end());
+      segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+
+      std::vector<int> elementGroups, segmentGroups;
+#if HAVE_MPI
+      int size;
+      MPI_Comm_size(communicator, &size);
+      if (size > 1)
+      {
+        // rank 0 looks up the groups of all requests
+        std::vector<IdType> allIds;
+        std::vector<int> allSegments;
+        std::vector<int> idCounts, segmentCounts;
+        root_gather(communicator, ids, allIds, idCounts);
+        root_gather(communicator, segments, allSegments, segmentCounts);
+        std::vector<int> allElementGroups(allIds.size()), allSegmentGroups(allSegments.size());
+        for (size_t i = 0; i < allIds.size(); i++)
+          allElementGroups[i] = group(allIds[i]);
+        for (size_t i = 0; i < allSegments.size(); i++)
+          allSegmentGroups[i] = allSegments[i] < int(boundaryIndexToEntity.size()) ?
+            boundaryIndexToEntity[allSegments[i]] : -1;
+        root_scatter(communicator, allElementGroups, idCounts, elementGroups, ids.size());
+        root_scatter(communicator, allSegmentGroups, segmentCounts, segmentGroups,
+            segments.size());
+      }
+      else
+#endif
+      {
+        for (size_t i = 0; i < ids.size(); i++)
+          elementGroups.push_back(group(ids[i]));
+        for (size_t i = 0; i < segments.size(); i++)
+          segmentGroups.push_back(segments[i] < int(boundaryIndexToEntity.size()) ?
+              boundaryIndexToEntity[segments[i]] : -1);
+      }
+
+      elementIndexToEntity.assign(elementGroups.begin(), elementGroups.end());
+      boundaryIndexToEntity.assign(segments.empty() ? 0 : segments.back()+1, -1);
+      for (size_t i = 0; i < segments.size(); i++)
+        boundaryIndexToEntity[segments[i]] = segmentGroups[i];
+    }
+
+  private:
+    /// Group of the element with a global id, -1 if it was not inserted on this process
+    int group(const IdType& id) const
+    {
+      typename std::vector<Entry>::const_iterator it = std::lower_bound(groups.begin(),
+          groups.end(), Entry(id, std::numeric_limits<int>::min()));
+      return (it != groups.end() && it->first == id) ? it->second : -1;
+    }
+
+    std::vector<Entry> groups;	// sorted by id, only on rank 0
+};
+
+#endif  // _PHYSICALGROUPS_HH
@@ -0,0 +1,225 @@
+#ifndef _PROCESSGROUP_HH
+#define _PROCESSGROUP_HH
+
+/** \file
+    \brief Groups of processes solving independent problems in one MPI job
+
+    The drivers run on a ProcessGroup instead of the world communicator of
+    MPIHelper. In the default run the group is the world. The launcher mode
+    of ipbs splits the world into groups of P processes; each group takes the
+    next configuration from a queue shared by all groups until all of them
+    are solved, so a sweep of many small problems runs in one allocation.
+
+    The grid of a group has to live on its communicator. Grid managers
+    whose factory takes a communicator (ALUGrid in 3d) are created on it,
+    see GroupGridFactory. Sequential grid managers (ALUGrid in 2d) work in
+    groups of one process. Parallel ones without a communicator, like UG,
+    always span the world and can only be run with a single group.
+*/
+
+#include <vector>
+
+#include <dune/common/collectivecommunication.hh>
+#include <dune/common/exceptions.hh>
+#include <dune/common/mpihelper.hh>
+#include <dune/common/typetraits.hh>
+#if HAVE_MPI
+#include <dune/common/mpicollectivecommunication.hh>
+#endif
+#include <dune/grid/common/gridfactory.hh>
+#if HAVE_ALUGRID
+#include <dune/grid/alugrid.hh>
+#endif
+
+#include "meshcache.hh"
+
+/// Failure of a problem that all processes of a group agreed on
+/*!
+   The group is left in a consistent state and can go on with the next
+   problem. Any other exception may have been thrown on some processes
+   only, while the others wait in a collective operation.
+*/
+class GroupFailure : public Dune::Exception {};
+
+class ProcessGroup
+{
+  public:
+    typedef Dune::MPIHelper::MPICommunicator Communicator;
+
+    /// All processes of the job
+    ProcessGroup(Dune::MPIHelper& helper) :
+      communicator(helper.getCommunicator()), rank_(helper.rank()), size_(helper.size()),
+      world(true)
+    {}
+
+#if HAVE_MPI
+    /// The processes of a communicator split off the world
+    ProcessGroup(MPI_Comm communicator_) : communicator(communicator_), world(false)
+    {
+      MPI_Comm_rank(communicator, &rank_);
+      MPI_Comm_size(communicator, &size_);
+      int worldSize;
+      MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+      world = (size_ == worldSize);
+    }
+#endif
+
+    int rank() const { return rank_; }
+    int size() const { return size_; }
+    Communicator getCommunicator() const { return communicator; }
+    /// Whether the group spans all processes of the job
+    bool isWorld() const { return world; }
+
+    /// Whether a condition holds on all processes of the group, collective
+    bool agree(bool condition) const
+    {
+      const Dune::CollectiveCommunication<Communicator> collective(communicator);
+      int all = condition;
+      return collective.min(all) != 0;
+    }
+
+  private:
+    Communicator communicator;
+    int rank_, size_;
+    bool world;
+};
+
+/// Whether the grid factory of a grid manager can create the grid on a given communicator
+template<class GridType>
+struct GridOnCommunicator
+{
+  static const bool value = false;
+};
+
+#if HAVE_ALUGRID && HAVE_MPI
+template<>
+struct GridOnCommunicator<Dune::ALUSimplexGrid<3,3> >
+{
+  static const bool value = true;
+};
+
+template<>
+struct GridOnCommunicator<Dune::ALUCubeGrid<3,3> >
+{
+  static const bool value = true;
+};
+#endif
+
+/// Whether the grids of a grid manager live on a single process, without communication
+template<class GridType>
+struct SequentialGrid
+{
+#if HAVE_MPI
+  static const bool value = !Dune::is_same<typename GridType::CollectiveCommunication,
+                                           Dune::CollectiveCommunication<MPI_Comm> >::value;
+#else
+  static const bool value = true;
+#endif
+};
+
+// ------------------------------------------------------------------------
+/// Factory creating the grid on the communicator of a process group
+// ------------------------------------------------------------------------
+template<class GridType, bool onCommunicator = GridOnCommunicator<GridType>::value>
+class GroupGridFactory : public RecordingGridFactory<GridType>
+{
+  public:
+    GroupGridFactory(const ProcessGroup& group)
+    {
+      if (!supported(group.size(), group.isWorld()))
+        DUNE_THROW(Dune::NotImplemented, "The grid manager can only create parallel grids on all "
+            "processes, run the launcher with one group" << (SequentialGrid<GridType>::value ?
+              " or groups of one process" : ""));
+    }
+
+    /// Whether grids can be created in groups of the given size
+    static bool supported(int groupSize, bool world)
+    {
+      return world || (groupSize == 1 && SequentialGrid<GridType>::value);
+    }
+};
+
+template<class GridType>
+class GroupGridFactory<GridType, true> : public RecordingGridFactory<GridType>
+{
+  public:
+    GroupGridFactory(const ProcessGroup& group) :
+      RecordingGridFactory<GridType>(group.getCommunicator())
+    {}
+
+    static bool supported(int groupSize, bool world)
+    {
+      return true;
+    }
+};
+
+// ------------------------------------------------------------------------
+/// Queue of the configurations of a launcher run, shared by all groups
+// ------------------------------------------------------------------------
+/*!
+   The next index is taken from a counter on rank 0 of the world with an
+   atomic MPI_Fetch_and_op (MPI 3), so groups finishing early take more
+   problems. Without MPI 3 the groups take every ngroups-th configuration.
+*/
+class ConfigQueue
+{
+  public:
+    /// Queue of n configurations for group number color of ngroups
+    ConfigQueue(const ProcessGroup& group_, size_t n_, int color_, int ngroups_) :
+      group(group_), n(n_), color(color_), ngroups(ngroups_), taken(0)
+    {
+#if HAVE_MPI && MPI_VERSION >= 3
+      int rank;
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+      // memory of the window allocated by MPI, so the atomics need no progress on rank 0
+      MPI_Win_allocate(rank == 0 ? sizeof(long) : 0, sizeof(long), MPI_INFO_NULL,
+          MPI_COMM_WORLD, &counter, &window);
+      if (rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, window);
+        *counter = 0;
+        MPI_Win_unlock(0, window);
+      }
+      MPI_Barrier(MPI_COMM_WORLD);
+#endif
+    }
+
+    ~ConfigQueue()
+    {
+#if HAVE_MPI && MPI_VERSION >= 3
+      MPI_Win_free(&window);
+#endif
+    }
+
+    /// Index of the next configuration of this group, n if the queue is empty
+    size_t next()
+    {
+      long index;
+#if HAVE_MPI && MPI_VERSION >= 3
+      if (group.rank() == 0) {
+        const long one = 1;
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, window);
+        MPI_Fetch_and_op(&one, &index, MPI_LONG, 0, 0, MPI_SUM, window);
+        MPI_Win_unlock(0, window);
+      }
+      MPI_Bcast(&index, 1, MPI_LONG, 0, group.getCommunicator());
+#else
+      index = color + long(taken++) * ngroups;
+#endif
+      return index < long(n) ? size_t(index) : n;
+    }
+
+  private:
+    ConfigQueue(const ConfigQueue&);
+    ConfigQueue& operator=(const ConfigQueue&);
+
+    const ProcessGroup& group;
+    const size_t n;
+    const int color, ngroups;
+    size_t taken;
+#if HAVE_MPI && MPI_VERSION >= 3
+    long* counter;
+    MPI_Win window;
+#endif
+};
+
+#endif  // _PROCESSGROUP_HH
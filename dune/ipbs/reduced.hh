@@ -0,0 +1,779 @@
+#ifndef _REDUCED_HH
+#define _REDUCED_HH
+
+/** \file
+    \brief Reduced basis model for many parameter sets on one mesh
+
+    The converged solutions of a set of training parameters, minus the
+    Dirichlet extension u_D, span the POD basis V. The ion densities h(u)
+    (sinh(u), or u for salt = 2) of the same solutions span the basis W.
+    For Lagrange elements h of the coefficient vector is the interpolant
+    of the density. It is approximated by empirical interpolation (DEIM)
+    at the degrees of freedom P,
+    \f[ h(u) \approx W (P^T W)^{-1} h(P^T u). \f]
+    Without induced charges and charge regulation the boundary values of
+    the IPBS iteration are affine in the ion density and the surface
+    charges. The Galerkin projection of the residual for u = u_D + V a is
+    therefore
+    \f[ r(a) = K_r a + k_D + \lambda^{-2} E\, h(P^T u_D + P^T V a)
+               + \sum_p \sigma_p s_p, \f]
+    where E includes the response of the iterated boundary values to each
+    column of W. One Ipbsolver::updateBC evaluates the responses for all
+    columns together. The online problem is a Newton iteration of size
+    dim V, independent of the mesh.
+
+    The relative interpolation error of the density at further DEIM points
+    is the error indicator. The near field box of the boundary update is
+    the one of the configured Debye length.
+*/
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <gsl/gsl_eigen.h>
+#include <gsl/gsl_linalg.h>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fvector.hh>
+#include <dune/common/fmatrix.hh>
+#include <dune/pdelab/gridfunctionspace/localfunctionspace.hh>
+#include <dune/pdelab/gridoperator/gridoperator.hh>
+#include <dune/pdelab/backend/istlmatrixbackend.hh>
+
+#include "context.hh"
+#include "ipbsolver.hh"
+#include "boundaries.hh"
+#include "PBLocalOperator.hh"
+
+/// Dense matrix stored row by row
+typedef std::vector<std::vector<double> > DenseMatrix;
+
+/// Copy of a square dense matrix for GSL, to be freed by the caller
+inline gsl_matrix* to_gsl_matrix(const DenseMatrix& A)
+{
+  gsl_matrix* m = gsl_matrix_alloc(A.size(), A.size());
+  for (size_t i = 0; i < A.size(); i++)
+    for (size_t j = 0; j < A.size(); j++)
+      gsl_matrix_set(m, i, j, A[i][j]);
+  return m;
+}
+
+// ------------------------------------------------------------------------
+/// Solve A x = b by the LU decomposition of GSL
+// ------------------------------------------------------------------------
+inline void dense_solve(const DenseMatrix& A, std::vector<double>& x, const std::vector<double>& b)
+{
+  const size_t n = b.size();
+  x.assign(n, 0.);
+  if (n == 0)
+    return;
+  gsl_matrix* LU = to_gsl_matrix(A);
+  gsl_permutation* permutation = gsl_permutation_alloc(n);
+  int signum;
+  gsl_linalg_LU_decomp(LU, permutation, &signum);
+  bool singular = false;
+  for (size_t i = 0; i < n; i++)
+    singular = singular || gsl_matrix_get(LU, i, i) == 0;
+  if (!singular) {
+    gsl_vector_const_view rhs = gsl_vector_const_view_array(&b[0], n);
+    gsl_vector_view solution = gsl_vector_view_array(&x[0], n);
+    gsl_linalg_LU_solve(LU, permutation, &rhs.vector, &solution.vector);
+  }
+  gsl_permutation_free(permutation);
+  gsl_matrix_free(LU);
+  if (singular)
+    DUNE_THROW(Dune::MathError, "Singular reduced matrix");
+}
+
+// ------------------------------------------------------------------------
+/// Eigenvalues in descending order and eigenvectors (columns) of a symmetric matrix
+// ------------------------------------------------------------------------
+inline void symmetric_eigen(const DenseMatrix& A, std::vector<double>& values, DenseMatrix& vectors)
+{
+  const size_t n = A.size();
+  values.resize(n);
+  vectors.assign(n, std::vector<double>(n));
+  if (n == 0)
+    return;
+  gsl_matrix* m = to_gsl_matrix(A);
+  gsl_vector* eval = gsl_vector_alloc(n);
+  gsl_matrix* evec = gsl_matrix_alloc(n, n);
+  gsl_eigen_symmv_workspace* workspace = gsl_eigen_symmv_alloc(n);
+  gsl_eigen_symmv(m, eval, evec, workspace);
+  gsl_eigen_symmv_free(workspace);
+  gsl_eigen_symmv_sort(eval, evec, GSL_EIGEN_SORT_VAL_DESC);
+  for (size_t j = 0; j < n; j++) {
+    values[j] = gsl_vector_get(eval, j);
+    for (size_t i = 0; i < n; i++)
+      vectors[i][j] = gsl_matrix_get(evec, i, j);
+  }
+  gsl_matrix_free(evec);
+  gsl_vector_free(eval);
+  gsl_matrix_free(m);
+}
+
+// ------------------------------------------------------------------------
+/// Orthonormal POD modes of a set of coefficient vectors (method of snapshots)
+// ------------------------------------------------------------------------
+/*!
+   \param tolerance relative energy of the snapshots not captured by the
+                    first n modes
+   \param n number of modes needed for the tolerance
+   \return all modes with a non-negligible singular value, to be deleted by
+           the caller
+*/
+template<class U>
+std::vector<U*> pod_modes(const std::vector<U*>& snapshots, double tolerance, size_t& n)
+{
+  const size_t ns = snapshots.size();
+  DenseMatrix C(ns, std::vector<double>(ns));
+  for (size_t i = 0; i < ns; i++)
+    for (size_t j = 0; j <= i; j++)
+      C[i][j] = C[j][i] = snapshots[i]->base() * snapshots[j]->base();
+
+  std::vector<double> mu;
+  DenseMatrix Y;
+  symmetric_eigen(C, mu, Y);
+  double total = 0;
+  for (size_t k = 0; k < ns; k++)
+    total += std::max(mu[k], 0.);
+
+  std::vector<U*> modes;
+  double captured = 0;
+  n = 0;
+  for (size_t k = 0; k < ns && mu[k] > 1e-14 * mu[0]; k++)
+  {
+    U* mode = new U(*snapshots[0]);
+    *mode = 0.0;
+    for (size_t i = 0; i < ns; i++)
+      mode->axpy(Y[i][k] / std::sqrt(mu[k]), *snapshots[i]);
+    modes.push_back(mode);
+    if (captured < (1. - tolerance) * total)
+      n = modes.size();
+    captured += mu[k];
+  }
+  return modes;
+}
+
+/// Coefficient j of a vector with block size 1
+template<class U>
+double& coefficient(U& u, size_t j)
+{
+  return u.base()[j][0];
+}
+
+template<class U>
+double coefficient(const U& u, size_t j)
+{
+  return u.base()[j][0];
+}
+
+// ------------------------------------------------------------------------
+/// Interpolation points of the discrete empirical interpolation of a basis
+// ------------------------------------------------------------------------
+/*!
+   Point l is where the interpolation of mode l at the points 0, ..., l-1
+   by the modes 0, ..., l-1 has the largest error (greedy DEIM).
+*/
+template<class U>
+std::vector<size_t> deim_points(const std::vector<U*>& basis)
+{
+  std::vector<size_t> points;
+  for (size_t l = 0; l < basis.size(); l++)
+  {
+    U r(*basis[l]);
+    if (l > 0)
+    {
+      DenseMatrix A(l, std::vector<double>(l));
+      std::vector<double> rhs(l), c;
+      for (size_t i = 0; i < l; i++) {
+        for (size_t j = 0; j < l; j++)
+          A[i][j] = coefficient(*basis[j], points[i]);
+        rhs[i] = coefficient(*basis[l], points[i]);
+      }
+      dense_solve(A, c, rhs);
+      for (size_t j = 0; j < l; j++)
+        r.axpy(-c[j], *basis[j]);
+    }
+    size_t best = 0;
+    for (size_t j = 1; j < r.base().N(); j++)
+      if (std::abs(coefficient(r, j)) > std::abs(coefficient(r, best)))
+        best = j;
+    points.push_back(best);
+  }
+  return points;
+}
+
+// ------------------------------------------------------------------------
+/// Values of several coefficient vectors at a point, for Ipbsolver::updateBC
+// ------------------------------------------------------------------------
+/*!
+   A null pointer stands for the zero function.
+*/
+template<class GFS, class U>
+class BasisValues
+{
+  typedef Dune::PDELab::LocalFunctionSpace<GFS> LFS;
+  typedef typename LFS::Traits::FiniteElementType::
+    Traits::LocalBasisType::Traits::RangeType RangeType;
+
+  public:
+    BasisValues(const GFS& gfs, const std::vector<const U*>& vectors_) :
+      lfs(gfs), vectors(vectors_) {}
+
+    template<class E, class X>
+    void evaluate(const E& e, const X& x, std::vector<double>& values) const
+    {
+      lfs.bind(e);
+      phi.resize(lfs.size());
+      lfs.finiteElement().localBasis().evaluateFunction(x, phi);
+      for (size_t c = 0; c < values.size(); c++)
+      {
+        values[c] = 0;
+        if (!vectors[c])
+          continue;
+        lfs.vread(*vectors[c], ul);
+        for (size_t i = 0; i < lfs.size(); i++)
+          values[c] += ul[i] * phi[i];
+      }
+    }
+
+  private:
+    mutable LFS lfs;
+    const std::vector<const U*>& vectors;
+    mutable std::vector<Real> ul;
+    mutable std::vector<RangeType> phi;
+};
+
+// ------------------------------------------------------------------------
+/// Reduced model of the problems of a context differing in the Debye length and the charges
+// ------------------------------------------------------------------------
+/*!
+   Built for the sequential solver, salt = 0 or 2, and iterated boundaries
+   without dielectric contrast or charge regulation.
+*/
+template<class GV, class GFS, typename PGMap, class M, class B>
+class ReducedModel
+{
+  typedef typename GV::Grid::ctype ctype;
+  static const int dim = GV::dimension;
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+  typedef typename GFS::template ConstraintsContainer<Real>::Type CC;
+
+  typedef Ipbsolver<GV,GFS> Ipbs;
+  typedef BoundaryFlux<GV,double,PGMap,Ipbs> J;
+  typedef PBLocalOperator<M,B,J> LOP;
+  typedef Dune::PDELab::ISTLBCRSMatrixBackend<1,1> MBE;
+#if HAVE_MPI
+  typedef Dune::PDELab::GridOperator<GFS,GFS,LOP,MBE,Real,Real,Real,CC,CC,true> GO;
+#else
+  typedef Dune::PDELab::GridOperator<GFS,GFS,LOP,MBE,Real,Real,Real,CC,CC> GO;
+#endif
+
+  typedef typename GV::template Codim<0>::template Partition
+          <Dune::Interior_Partition>::Iterator LeafIterator;
+  typedef typename GV::IntersectionIterator IntersectionIterator;
+  typedef Dune::PDELab::LocalFunctionSpace<GFS> LFS;
+  typedef typename LFS::Traits::FiniteElementType::
+    Traits::LocalBasisType::Traits::RangeType RangeType;
+  typedef typename LFS::Traits::FiniteElementType::
+    Traits::LocalBasisType::Traits::JacobianType JacobianType;
+
+  public:
+    typedef Dune::FieldVector<Real,dim> Force;
+
+    /*!
+       \param uD the Dirichlet extension, zero on the other degrees of freedom
+       \param training converged solutions for the training parameters
+       \param intorder integration order of the local operator
+    */
+    ReducedModel(IpbsContext& context, const GV& gv_, const GFS& gfs_, const PGMap& pgmap_,
+        const M& m, const B& b, const CC& cc, const U& uD, const std::vector<U*>& training,
+        int intorder) :
+      sysParams(context.sysParams), gv(gv_), gfs(gfs_), pgmap(pgmap_)
+    {
+      const std::vector<Boundary*>& boundary = context.boundary;
+      if (sysParams.get_salt() != 0 && sysParams.get_salt() != 2)
+        DUNE_THROW(Dune::NotImplemented, "Reduced models need salt = 0 or 2");
+      for (size_t p = 0; p < boundary.size(); p++)
+      {
+        if (boundary[p]->get_type() == 2 && (boundary[p]->get_sigma_max() != 0
+              || boundary[p]->get_epsilon() != sysParams.get_epsilon()))
+          DUNE_THROW(Dune::NotImplemented, "Reduced models need iterated boundaries without "
+              "charge regulation and dielectric contrast");
+        if (boundary[p]->get_type() == 1 || boundary[p]->get_type() == 2)
+          charged.push_back(p);
+      }
+
+      // <<<1>>> Bases of the solutions and the ion densities
+      std::vector<U*> snapshots, densities;
+      for (size_t t = 0; t < training.size(); t++)
+      {
+        snapshots.push_back(new U(*training[t]));
+        snapshots.back()->axpy(-1.0, uD);
+        densities.push_back(new U(*training[t]));
+        for (size_t j = 0; j < densities.back()->base().N(); j++)
+          coefficient(*densities.back(), j) = density(coefficient(*training[t], j));
+      }
+      size_t r, nw;
+      std::vector<U*> V = pod_modes(snapshots, sysParams.get_podTolerance(), r);
+      for (size_t k = r; k < V.size(); k++)
+        delete V[k];
+      V.resize(r);
+      std::vector<U*> modes = pod_modes(densities, sysParams.get_podTolerance(), nw);
+      // keep modes beyond the interpolation ones for the error indicator
+      if (modes.size() > 1)
+        nw = std::min(nw, modes.size()-1);
+      for (size_t k = std::min(2*nw, modes.size()); k < modes.size(); k++)
+        delete modes[k];
+      modes.resize(std::min(2*nw, modes.size()));
+      if (r == 0 || nw == 0)
+        DUNE_THROW(Dune::Exception, "The training solutions do not span a reduced basis");
+      std::vector<size_t> points = deim_points(modes);
+
+      trainingCoefficients.resize(training.size());
+      for (size_t t = 0; t < training.size(); t++)
+        for (size_t i = 0; i < r; i++)
+          trainingCoefficients[t].push_back(V[i]->base() * snapshots[t]->base());
+      for (size_t t = 0; t < training.size(); t++) {
+        delete snapshots[t];
+        delete densities[t];
+      }
+
+      // interpolation and check points
+      interpolationV.assign(nw, std::vector<double>(r));
+      interpolationD.resize(nw);
+      DenseMatrix PW(nw, std::vector<double>(nw));
+      for (size_t q = 0; q < nw; q++) {
+        for (size_t i = 0; i < r; i++)
+          interpolationV[q][i] = coefficient(*V[i], points[q]);
+        interpolationD[q] = coefficient(uD, points[q]);
+        for (size_t k = 0; k < nw; k++)
+          PW[q][k] = coefficient(*modes[k], points[q]);
+      }
+      const size_t nc = modes.size() - nw;
+      checkV.assign(nc, std::vector<double>(r));
+      checkD.resize(nc);
+      checkW.assign(nc, std::vector<double>(nw));
+      for (size_t q = 0; q < nc; q++) {
+        for (size_t i = 0; i < r; i++)
+          checkV[q][i] = coefficient(*V[i], points[nw+q]);
+        checkD[q] = coefficient(uD, points[nw+q]);
+        for (size_t k = 0; k < nw; k++)
+          checkW[q][k] = coefficient(*modes[k], points[nw+q]);
+      }
+      // (P^T W)^{-1} column by column
+      interpolation.assign(nw, std::vector<double>(nw));
+      for (size_t k = 0; k < nw; k++) {
+        std::vector<double> e(nw, 0.), column;
+        e[k] = 1.;
+        dense_solve(PW, column, e);
+        for (size_t q = 0; q < nw; q++)
+          interpolation[q][k] = column[q];
+      }
+
+      // <<<2>>> Projected operators, from residuals of the linear problem
+      // without charges at lambda^-2 = 1 and 2, which are K u + lambda^-2 M u
+      IpbsContext linear(context);
+      linear.sysParams.set_salt(2);
+      linear.sysParams.set_alpha_ipbs(1.);
+      linear.sysParams.set_alpha_ic(1.);
+      for (size_t p = 0; p < linear.boundary.size(); p++)
+        linear.boundary[p]->set_charge_density(0.);
+      Ipbs noflux(linear, gv, gfs, pgmap, 1, false);
+      const J j0(linear, gv, pgmap, noflux);
+      LOP lop0(linear, m, b, j0, intorder);
+      GO go0(gfs,cc,gfs,cc,lop0);
+
+      U r1(gfs,0.0), r2(gfs,0.0);
+      Kr.assign(r, std::vector<double>(r));
+      kD.resize(r);
+      DenseMatrix C(r, std::vector<double>(nw));	// V^T M W, and below the boundary part
+      for (size_t c = 0; c < r + 1 + nw; c++)
+      {
+        const U& v = c < r ? *V[c] : (c == r ? uD : *modes[c-r-1]);
+        r1 = 0.0;
+        r2 = 0.0;
+        linear.sysParams.set_lambda(1.);
+        go0.residual(v, r1);
+        linear.sysParams.set_lambda(1./std::sqrt(2.));
+        go0.residual(v, r2);
+        if (c <= r) {
+          // K v = 2 r1 - r2
+          r2 *= -1.0;
+          r2.axpy(2.0, r1);
+        }
+        else
+          // M v = r2 - r1
+          r2.axpy(-1.0, r1);
+        for (size_t i = 0; i < r; i++)
+        {
+          const double projection = V[i]->base() * r2.base();
+          if (c < r)
+            Kr[i][c] = projection;
+          else if (c == r)
+            kD[i] = projection;
+          else
+            C[i][c-r-1] = projection;
+        }
+      }
+      linear.sysParams.set_lambda(1.);
+
+      // <<<3>>> Boundary values of the IPBS map for the columns of W (at
+      // lambda^-2 = 1) and for unit charge densities, in one traversal
+      std::vector<IpbsContext*> unit(charged.size());
+      std::vector<Ipbs*> members;
+      std::vector<const U*> densityColumns;
+      for (size_t k = 0; k < nw; k++) {
+        members.push_back(new Ipbs(linear, gv, gfs, pgmap, 1, false));
+        densityColumns.push_back(modes[k]);
+      }
+      for (size_t s = 0; s < charged.size(); s++) {
+        unit[s] = new IpbsContext(linear);
+        unit[s]->boundary[charged[s]]->set_charge_density(1.);
+        members.push_back(new Ipbs(*unit[s], gv, gfs, pgmap, 1, false));
+        densityColumns.push_back(0);
+      }
+      Ipbs::updateBC(members, BasisValues<GFS,U>(gfs, densityColumns));
+
+      // their boundary residuals at u = 0, where the volume terms vanish
+      const U zero(gfs,0.0);
+      chargeResponses.assign(charged.size(), std::vector<double>(r));
+      for (size_t c = 0; c < members.size(); c++)
+      {
+        IpbsContext& memberContext = c < nw ? linear : *unit[c-nw];
+        const J j(memberContext, gv, pgmap, *members[c]);
+        LOP lop(memberContext, m, b, j, intorder);
+        GO go(gfs,cc,gfs,cc,lop);
+        r1 = 0.0;
+        go.residual(zero, r1);
+        for (size_t i = 0; i < r; i++)
+        {
+          const double projection = V[i]->base() * r1.base();
+          if (c < nw)
+            C[i][c] += projection;
+          else
+            chargeResponses[c-nw][i] = projection;
+        }
+        delete members[c];
+      }
+      for (size_t s = 0; s < unit.size(); s++)
+        delete unit[s];
+
+      E.assign(r, std::vector<double>(nw, 0.));
+      for (size_t i = 0; i < r; i++)
+        for (size_t k = 0; k < nw; k++)
+          for (size_t q = 0; q < nw; q++)
+            E[i][q] += C[i][k] * interpolation[k][q];
+
+      // <<<4>>> Values and gradients of u_D and V at the boundary faces
+      std::vector<const U*> vectors(1, &uD);
+      for (size_t i = 0; i < r; i++)
+        vectors.push_back(V[i]);
+      evaluateFaces(vectors, faceValues, faceGradients, &faceNormals, &faceParticles);
+
+      for (size_t i = 0; i < r; i++)
+        delete V[i];
+      for (size_t k = 0; k < modes.size(); k++)
+        delete modes[k];
+    }
+
+    /// Dimension of the reduced basis and number of interpolation points
+    size_t size() const { return Kr.size(); }
+    size_t points() const { return interpolation.size(); }
+
+    /// Reduced coefficients of training solution t
+    const std::vector<double>& coefficients(size_t t) const
+    {
+      return trainingCoefficients[t];
+    }
+
+    // ------------------------------------------------------------------------
+    /// Solve the reduced problem for the parameters of query
+    // ------------------------------------------------------------------------
+    /*!
+       \param a coefficients of the solution, on entry the initial guess
+       \return the error indicator, infinite if the Newton iteration failed
+    */
+    double solve(IpbsContext& query, std::vector<double>& a) const
+    {
+      const size_t r = Kr.size();
+      const double lambda2i = query.sysParams.get_lambda2i();
+      std::vector<double> offset(kD);
+      for (size_t s = 0; s < charged.size(); s++)
+      {
+        const double sigma = query.boundary[charged[s]]->get_charge_density();
+        for (size_t i = 0; i < r; i++)
+          offset[i] += sigma * chargeResponses[s][i];
+      }
+      a.resize(r, 0.);
+
+      std::vector<double> h, dh, res, delta(r), trial(r);
+      double norm = residual(a, lambda2i, offset, h, dh, res);
+      bool converged = false;
+      try {
+        for (int it = 0; it < 50 && !converged && norm == norm; it++)
+        {
+          // Jacobian K_r + lambda^-2 E diag(h') P^T V
+          DenseMatrix A(Kr);
+          for (size_t i = 0; i < r; i++)
+            for (size_t q = 0; q < dh.size(); q++)
+            {
+              const double f = lambda2i * E[i][q] * dh[q];
+              for (size_t j = 0; j < r; j++)
+                A[i][j] += f * interpolationV[q][j];
+            }
+          for (size_t i = 0; i < r; i++)
+            res[i] *= -1.;
+          dense_solve(A, delta, res);
+
+          // damped Newton step
+          double t = 1.;
+          for (;;)
+          {
+            for (size_t i = 0; i < r; i++)
+              trial[i] = a[i] + t * delta[i];
+            const double trialNorm = residual(trial, lambda2i, offset, h, dh, res);
+            if (trialNorm < norm || t < 1e-3) {
+              a = trial;
+              norm = trialNorm;
+              break;
+            }
+            t *= .5;
+          }
+          double step = 0, size = 0;
+          for (size_t i = 0; i < r; i++) {
+            step += t*t * delta[i]*delta[i];
+            size += a[i]*a[i];
+          }
+          converged = std::sqrt(step) <= 1e-10 * (1. + std::sqrt(size));
+        }
+      }
+      catch (Dune::MathError&) {
+        converged = false;
+      }
+      if (!converged || norm != norm)
+        return std::numeric_limits<double>::infinity();
+
+      // interpolation error of the density at the check points
+      std::vector<double> theta(h.size(), 0.);
+      double scale = 0;
+      for (size_t k = 0; k < h.size(); k++) {
+        for (size_t q = 0; q < h.size(); q++)
+          theta[k] += interpolation[k][q] * h[q];
+        scale = std::max(scale, std::abs(h[k]));
+      }
+      double error = 0;
+      for (size_t q = 0; q < checkD.size(); q++)
+      {
+        double u = checkD[q];
+        for (size_t i = 0; i < r; i++)
+          u += checkV[q][i] * a[i];
+        double approximation = 0;
+        for (size_t k = 0; k < theta.size(); k++)
+          approximation += checkW[q][k] * theta[k];
+        error = std::max(error, std::abs(density(u) - approximation));
+        scale = std::max(scale, std::abs(density(u)));
+      }
+      return scale > 0 ? error / scale : 0.;
+    }
+
+    // ------------------------------------------------------------------------
+    /// Average surface potentials and forces on all particles for reduced coefficients
+    // ------------------------------------------------------------------------
+    void outputs(IpbsContext& query, const std::vector<double>& a,
+        std::vector<double>& potentials, std::vector<Force>& forces) const
+    {
+      const size_t stride = a.size() + 1;
+      const size_t nfaces = faceParticles.size();
+      std::vector<double> values(nfaces);
+      std::vector<Force> gradients(nfaces);
+      for (size_t f = 0; f < nfaces; f++)
+      {
+        values[f] = faceValues[f*stride];
+        gradients[f] = faceGradients[f*stride];
+        for (size_t i = 0; i < a.size(); i++) {
+          values[f] += a[i] * faceValues[f*stride+1+i];
+          gradients[f].axpy(a[i], faceGradients[f*stride+1+i]);
+        }
+      }
+      outputs(query.sysParams.get_lambda2i(), values, gradients, potentials, forces);
+    }
+
+    /// Average surface potentials and forces on all particles for a full solution u
+    void outputs(IpbsContext& query, const U& u,
+        std::vector<double>& potentials, std::vector<Force>& forces) const
+    {
+      std::vector<double> values;
+      std::vector<Force> gradients;
+      evaluateFaces(std::vector<const U*>(1, &u), values, gradients, 0, 0);
+      outputs(query.sysParams.get_lambda2i(), values, gradients, potentials, forces);
+    }
+
+  private:
+    /// Ion density h(u) of the PB source term -lambda^-2 h(u)
+    double density(double u) const
+    {
+      return sysParams.get_salt() == 2 ? u : std::sinh(u);
+    }
+
+    double densityDerivative(double u) const
+    {
+      return sysParams.get_salt() == 2 ? 1. : std::cosh(u);
+    }
+
+    /// Reduced residual r(a), and h and h' at the interpolation points
+    double residual(const std::vector<double>& a, double lambda2i,
+        const std::vector<double>& offset, std::vector<double>& h, std::vector<double>& dh,
+        std::vector<double>& res) const
+    {
+      const size_t r = a.size();
+      const size_t nw = interpolationD.size();
+      h.resize(nw);
+      dh.resize(nw);
+      for (size_t q = 0; q < nw; q++)
+      {
+        double u = interpolationD[q];
+        for (size_t i = 0; i < r; i++)
+          u += interpolationV[q][i] * a[i];
+        h[q] = density(u);
+        dh[q] = densityDerivative(u);
+      }
+      res = offset;
+      double norm = 0;
+      for (size_t i = 0; i < r; i++)
+      {
+        for (size_t j = 0; j < r; j++)
+          res[i] += Kr[i][j] * a[j];
+        for (size_t q = 0; q < nw; q++)
+          res[i] += lambda2i * E[i][q] * h[q];
+        norm += res[i]*res[i];
+      }
+      return std::sqrt(norm);
+    }
+
+    /// Values and gradients of the vectors at the centers of the boundary faces
+    /*!
+       The entries of face f are f*vectors.size(), ..., (f+1)*vectors.size()-1.
+       Optionally the weighted normals (as in the force computation) and the
+       physical groups of the faces are stored.
+    */
+    void evaluateFaces(const std::vector<const U*>& vectors, std::vector<double>& values,
+        std::vector<Force>& gradients, std::vector<Force>* normals,
+        std::vector<int>* particles) const
+    {
+      LFS lfs(gfs);
+      std::vector<Real> ul;
+      std::vector<RangeType> phi;
+      std::vector<JacobianType> js;
+      std::vector<Force> gradphi;
+      values.clear();
+      gradients.clear();
+
+      for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+               	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+      {
+        if (it->hasBoundaryIntersections() == false)
+          continue;
+
+        bool bound = false;
+        for (IntersectionIterator ii = gv.ibegin(*it); ii != gv.iend(*it); ++ii)
+        {
+          if (ii->boundary() == false)
+            continue;
+          if (!bound) {
+            lfs.bind(*it);
+            phi.resize(lfs.size());
+            js.resize(lfs.size());
+            gradphi.resize(lfs.size());
+            bound = true;
+          }
+
+          Dune::FieldVector<ctype,dim> evalPos = ii->geometry().center();
+          Dune::FieldVector<ctype,dim> local = it->geometry().local(evalPos);
+          if (normals) {
+            Force nu = ii->centerUnitOuterNormal();
+            nu *= -1.0 * ii->geometry().volume();
+            if (sysParams.get_symmetry() > 0)
+              nu *= 2.*sysParams.pi*evalPos[1];
+            normals->push_back(nu);
+            particles->push_back(pgmap[ii->boundarySegmentIndex()]);
+          }
+
+          lfs.finiteElement().localBasis().evaluateFunction(local,phi);
+          lfs.finiteElement().localBasis().evaluateJacobian(local,js);
+          const Dune::FieldMatrix<ctype,dim,dim>
+            jac = it->geometry().jacobianInverseTransposed(local);
+          for (size_t i=0; i<lfs.size(); i++)
+            jac.mv(js[i][0],gradphi[i]);
+
+          for (size_t c = 0; c < vectors.size(); c++)
+          {
+            lfs.vread(*vectors[c], ul);
+            Real value = 0;
+            Force g(0.);
+            for (size_t i=0; i<lfs.size(); i++) {
+              value += ul[i]*phi[i];
+              g.axpy(ul[i],gradphi[i]);
+            }
+            values.push_back(value);
+            gradients.push_back(g);
+          }
+        }
+      }
+    }
+
+    /// Surface potentials and Maxwell stress forces from the values at the faces
+    void outputs(double lambda2i, const std::vector<double>& values,
+        const std::vector<Force>& gradients, std::vector<double>& potentials,
+        std::vector<Force>& forces) const
+    {
+      const double c = 1.0/(4.0 * sysParams.pi * sysParams.get_bjerrum());
+      const size_t npart = sysParams.get_npart();
+      potentials.assign(npart, 0.);
+      forces.assign(npart, Force(0.));
+      std::vector<int> count(npart, 0);
+      for (size_t f = 0; f < faceParticles.size(); f++)
+      {
+        const size_t p = faceParticles[f];
+        if (faceParticles[f] < 0 || p >= npart)
+          continue;	// outer boundary
+        const double value = values[f];
+        const Force& g = gradients[f];
+        const Force& nu = faceNormals[f];
+        potentials[p] += value;
+        count[p]++;
+        const double osmotic = lambda2i
+          * (sysParams.get_salt() == 2 ? .5 * value * value : std::cosh(value) - 1.0);
+        for (int d = 0; d < dim; d++)
+          forces[p][d] += c * ( g[d] * (g*nu) - nu[d] * (osmotic + .5 * g.two_norm2()) );
+      }
+      for (size_t p = 0; p < npart; p++)
+        if (count[p] > 0)
+          potentials[p] /= count[p];
+    }
+
+    SysParams& sysParams;
+    const GV& gv;
+    const GFS& gfs;
+    const PGMap& pgmap;
+
+    std::vector<size_t> charged;	// boundaries with a charge density
+    std::vector<std::vector<double> > trainingCoefficients;
+    DenseMatrix Kr;
+    std::vector<double> kD;
+    DenseMatrix E;
+    std::vector<std::vector<double> > chargeResponses;	// s_p of the charged boundaries
+    DenseMatrix interpolation;	// (P^T W)^{-1}
+    DenseMatrix interpolationV;	// P^T V
+    std::vector<double> interpolationD;	// P^T u_D
+    DenseMatrix checkV, checkW;	// the same at the check points
+    std::vector<double> checkD;
+    std::vector<double> faceValues;	// u_D and V at the boundary faces
+    std::vector<Force> faceGradients;
+    std::vector<Force> faceNormals;
+    std::vector<int> faceParticles;
+};
+
+#endif  // _REDUCED_HH
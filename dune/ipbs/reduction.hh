@@ -0,0 +1,253 @@
+#ifndef _REDUCTION_HH
+#define _REDUCTION_HH
+
+/** \file
+    \brief Fused reductions of the boundary iteration
+
+    Each update of the iterated boundaries sums several vectors over the
+    processes. Packing them into one buffer needs one reduction instead of
+    one per vector, and with MPI 3 the sum runs in the background while the
+    surface loop is computed. Values only needed for the rows of one process
+    are reduced onto that process alone. The time spent in communication is
+    accumulated for the report of each iteration.
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include <dune/common/mpihelper.hh>
+#include <dune/common/collectivecommunication.hh>
+#if HAVE_MPI
+#include <dune/common/mpicollectivecommunication.hh>
+#endif
+#include <dune/common/timer.hh>
+
+#if HAVE_MPI
+/// MPI communicator of the collective communication of a grid, MPI_COMM_SELF for sequential grids
+template<class C>
+MPI_Comm mpi_communicator(const C&)
+{
+  return MPI_COMM_SELF;
+}
+
+inline MPI_Comm mpi_communicator(const Dune::CollectiveCommunication<MPI_Comm>& collective)
+{
+  return collective;
+}
+#endif
+
+class Reduction
+{
+  public:
+    /// Reductions over the processes of the collective communication of a grid
+    template<class C>
+    explicit Reduction(const C& collective) : size(collective.size()), elapsed(0)
+    {
+#if HAVE_MPI
+      communicator = mpi_communicator(collective);
+#endif
+    }
+
+    /// Start summing v over the processes in place, v must not be used before wait()
+    void startSum(std::vector<double>& v)
+    {
+#if HAVE_MPI
+      if (size == 1 || v.empty())
+        return;
+      Dune::Timer timer;
+#if MPI_VERSION >= 3
+      requests.push_back(MPI_REQUEST_NULL);
+      MPI_Iallreduce(MPI_IN_PLACE, &v[0], v.size(), MPI_DOUBLE, MPI_SUM, communicator,
+          &requests.back());
+#else
+      MPI_Allreduce(MPI_IN_PLACE, &v[0], v.size(), MPI_DOUBLE, MPI_SUM, communicator);
+#endif
+      elapsed += timer.elapsed();
+#endif
+    }
+
+    // ------------------------------------------------------------------------
+    /// Start summing v over the processes, keeping only the rows of this process
+    // ------------------------------------------------------------------------
+    /*!
+       \param rows the sums of the rows of this process on return from wait()
+       \param counts number of rows of each process, in the order of the ranks
+       \param width number of values per row
+    */
+    void startSumRows(const std::vector<double>& v, std::vector<double>& rows,
+                      const std::vector<int>& counts, int width = 1)
+    {
+      int rank = 0, offset = 0;
+#if HAVE_MPI
+      MPI_Comm_rank(communicator, &rank);
+#endif
+      for (int p = 0; p < rank; p++)
+        offset += width * counts[p];
+      rows.assign(v.begin() + offset, v.begin() + offset + width*counts[rank]);
+#if HAVE_MPI
+      if (size == 1)
+        return;
+      Dune::Timer timer;
+      lengths.resize(counts.size());
+      for (size_t p = 0; p < counts.size(); p++)
+        lengths[p] = width * counts[p];
+      double dummy = 0;
+      double* result = rows.empty() ? &dummy : &rows[0];
+#if MPI_VERSION >= 3
+      requests.push_back(MPI_REQUEST_NULL);
+      MPI_Ireduce_scatter(v.empty() ? &dummy : const_cast<double*>(&v[0]), result,
+          &lengths[0], MPI_DOUBLE, MPI_SUM, communicator, &requests.back());
+#else
+      MPI_Reduce_scatter(v.empty() ? &dummy : const_cast<double*>(&v[0]), result,
+          &lengths[0], MPI_DOUBLE, MPI_SUM, communicator);
+#endif
+      elapsed += timer.elapsed();
+#endif
+    }
+
+    /// Complete the sums started since the last wait()
+    void wait()
+    {
+#if HAVE_MPI
+      if (requests.empty())
+        return;
+      Dune::Timer timer;
+      MPI_Waitall(requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+      requests.clear();
+      elapsed += timer.elapsed();
+#endif
+    }
+
+    /// Sum v over the processes
+    void sum(std::vector<double>& v)
+    {
+      startSum(v);
+      wait();
+    }
+
+    /// Maximum of v over the processes
+    void max(std::vector<double>& v)
+    {
+#if HAVE_MPI
+      if (size == 1 || v.empty())
+        return;
+      Dune::Timer timer;
+      MPI_Allreduce(MPI_IN_PLACE, &v[0], v.size(), MPI_DOUBLE, MPI_MAX, communicator);
+      elapsed += timer.elapsed();
+#endif
+    }
+
+    // ------------------------------------------------------------------------
+    /// Collect the rows each process computed in the replicated vector v
+    // ------------------------------------------------------------------------
+    /*!
+       \param counts number of rows of each process, in the order of the ranks
+       \param width number of values per row
+    */
+    void gatherRows(std::vector<double>& v, const std::vector<int>& counts, int width = 1)
+    {
+#if HAVE_MPI
+      if (size == 1 || v.empty())
+        return;
+      Dune::Timer timer;
+      std::vector<int> lengths(counts.size()), displacements(counts.size(), 0);
+      for (size_t p = 0; p < counts.size(); p++)
+        lengths[p] = width * counts[p];
+      for (size_t p = 1; p < counts.size(); p++)
+        displacements[p] = displacements[p-1] + lengths[p-1];
+      MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, &v[0], &lengths[0],
+          &displacements[0], MPI_DOUBLE, communicator);
+      elapsed += timer.elapsed();
+#endif
+    }
+
+    // ------------------------------------------------------------------------
+    /// Move rows from one distribution over the processes to another
+    // ------------------------------------------------------------------------
+    /*!
+       Both distributions split the rows into consecutive blocks in the order
+       of the ranks, each row is sent once from its old to its new process.
+
+       \param from the rows of this process in the first distribution
+       \param to the rows of this process in the second distribution on return
+    */
+    void moveRows(const std::vector<double>& from, const std::vector<int>& fromCounts,
+                  std::vector<double>& to, const std::vector<int>& toCounts)
+    {
+      if (size == 1) {
+        to = from;
+        return;
+      }
+#if HAVE_MPI
+      Dune::Timer timer;
+      int rank;
+      MPI_Comm_rank(communicator, &rank);
+      const int nproc = fromCounts.size();
+      std::vector<int> fromOffsets(nproc+1, 0), toOffsets(nproc+1, 0);
+      for (int p = 0; p < nproc; p++) {
+        fromOffsets[p+1] = fromOffsets[p] + fromCounts[p];
+        toOffsets[p+1] = toOffsets[p] + toCounts[p];
+      }
+      // overlaps of the block of this process in one distribution with those of p in the other
+      std::vector<int> sendCounts(nproc), sendDisplacements(nproc);
+      std::vector<int> recvCounts(nproc), recvDisplacements(nproc);
+      for (int p = 0; p < nproc; p++) {
+        const int sendBegin = std::max(fromOffsets[rank], toOffsets[p]);
+        sendCounts[p] = std::max(std::min(fromOffsets[rank+1], toOffsets[p+1]) - sendBegin, 0);
+        sendDisplacements[p] = sendCounts[p] > 0 ? sendBegin - fromOffsets[rank] : 0;
+        const int recvBegin = std::max(fromOffsets[p], toOffsets[rank]);
+        recvCounts[p] = std::max(std::min(fromOffsets[p+1], toOffsets[rank+1]) - recvBegin, 0);
+        recvDisplacements[p] = recvCounts[p] > 0 ? recvBegin - toOffsets[rank] : 0;
+      }
+      to.resize(toCounts[rank]);
+      double dummy = 0;
+      MPI_Alltoallv(from.empty() ? &dummy : const_cast<double*>(&from[0]), &sendCounts[0],
+          &sendDisplacements[0], MPI_DOUBLE, to.empty() ? &dummy : &to[0], &recvCounts[0],
+          &recvDisplacements[0], MPI_DOUBLE, communicator);
+      elapsed += timer.elapsed();
+#endif
+    }
+
+    /// Collect the rows of all processes in v on rank 0, for output
+    void gatherRowsToRoot(const std::vector<double>& rows, std::vector<double>& v,
+                          const std::vector<int>& counts)
+    {
+      v = rows;
+#if HAVE_MPI
+      if (size == 1)
+        return;
+      int rank;
+      MPI_Comm_rank(communicator, &rank);
+      std::vector<int> displacements(counts.size(), 0);
+      for (size_t p = 1; p < counts.size(); p++)
+        displacements[p] = displacements[p-1] + counts[p-1];
+      v.assign(rank == 0 ? displacements.back() + counts.back() : 0, 0.);
+      double dummy = 0;
+      MPI_Gatherv(rows.empty() ? &dummy : const_cast<double*>(&rows[0]), rows.size(), MPI_DOUBLE,
+          v.empty() ? &dummy : &v[0], const_cast<int*>(&counts[0]), &displacements[0],
+          MPI_DOUBLE, 0, communicator);
+#endif
+    }
+
+    /// Time spent in communication since the last reset, in seconds
+    double time() const
+    {
+      return elapsed;
+    }
+
+    void resetTime()
+    {
+      elapsed = 0;
+    }
+
+  private:
+#if HAVE_MPI
+    MPI_Comm communicator;
+    std::vector<MPI_Request> requests;
+    std::vector<int> lengths;	// must live until the reduction is completed
+#endif
+    int size;
+    double elapsed;
+};
+
+#endif  // _REDUCTION_HH
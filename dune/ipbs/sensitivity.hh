@@ -0,0 +1,186 @@
+#ifndef _SENSITIVITY_HH
+#define _SENSITIVITY_HH
+
+/** \file
+    \brief Derivatives of the forces with respect to the physical parameters
+
+    At the converged solution the residual R(u, p) of the PB problem vanishes,
+    so the derivative of a force component F(u, p) with respect to a
+    parameter p is
+    \f[ \frac{dF}{dp} = \frac{\partial F}{\partial p} - z^T \frac{\partial R}{\partial p},
+        \qquad A^T z = \frac{\partial F}{\partial u}, \f]
+    with one adjoint solve per force component (see ForceFunctional) for all
+    parameters. The partial derivatives are central differences at fixed u.
+    The iterated boundary values of the perturbed problems are one step of
+    the IPBS map without relaxation, started from the converged state, and
+    all perturbed problems are updated in one traversal of the grid.
+
+    As in the Newton solver the response of the iterated boundary values to
+    a change of u is not part of A, so for iterated boundaries (type 2) the
+    derivatives are those at a fixed volume integral of the boundary update.
+    They are exact for prescribed surface charges (type 1).
+*/
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dune/pdelab/gridfunctionspace/constraints.hh>
+#include <dune/pdelab/gridfunctionspace/gridfunctionspaceutilities.hh>
+
+#include "context.hh"
+#include "parser.hh"
+#include "ipbsolver.hh"
+#include "adjoint.hh"
+
+// ------------------------------------------------------------------------
+/// Parameters the forces are differentiated for, as keys of apply_parameter()
+// ------------------------------------------------------------------------
+inline std::vector<std::string> sensitivity_keys(IpbsContext& context)
+{
+  std::vector<std::string> keys;
+  keys.push_back("system.lambda");
+  keys.push_back("system.epsilon");
+  for (size_t i = 0; i < context.boundary.size(); i++)
+  {
+    std::ostringstream name;
+    name << "boundary_" << i;
+    const int type = context.boundary[i]->get_type();
+    if (type == 1 || type == 2)
+      keys.push_back(name.str() + ".charge_density");
+    // pK only matters for charge regulation
+    if (type == 2 && context.boundary[i]->get_sigma_max() != 0)
+      keys.push_back(name.str() + ".pK");
+  }
+  return keys;
+}
+
+// ------------------------------------------------------------------------
+/// Write the derivatives of the forces on all particles to filename
+// ------------------------------------------------------------------------
+/*!
+   Each line holds a parameter, its value and the derivatives of the force
+   components on particles 0, ..., npart-1 (only the axial one with symmetry).
+
+   \tparam J the boundary flux and LOP the local operator of the problem, go
+             is a grid operator on LOP
+   \param ipbs the converged boundary iteration
+   \param intorder integration order of the local operator
+*/
+template<class J, class LOP, class GV, class GFS, class PGMap, class Ipbs,
+         class M, class B, class CC, class GO, class LS, class U>
+void write_sensitivities(IpbsContext& context, const GV& gv, const GFS& gfs,
+    const PGMap& boundaryIndexToEntity, const Ipbs& ipbs, const M& m, const B& b,
+    const CC& cc, const GO& go, LS& ls, const U& u, int intorder,
+    const std::string& filename)
+{
+  SysParams& sysParams = context.sysParams;
+  const int dim = GV::dimension;
+  const int npart = sysParams.get_npart();
+  const int ndir = sysParams.get_symmetry() > 0 ? 1 : dim;
+
+  // perturbed problems p + h (even) and p - h (odd) for each parameter
+  const std::vector<std::string> keys = sensitivity_keys(context);
+  std::vector<double> values(keys.size()), steps(keys.size());
+  std::vector<IpbsContext*> contexts;
+  std::vector<Ipbs*> members;
+  typename Ipbs::State state;
+  ipbs.saveState(state);
+  for (size_t p = 0; p < keys.size(); p++)
+  {
+    values[p] = parameter_value(context, keys[p]);
+    steps[p] = 1e-4 * (values[p] != 0 ? std::abs(values[p]) : 1.);
+    for (int s = 0; s < 2; s++)
+    {
+      IpbsContext* perturbed = new IpbsContext(context);
+      apply_parameter(*perturbed, keys[p], values[p] + (s == 0 ? steps[p] : -steps[p]));
+      perturbed->sysParams.set_alpha_ipbs(1.);
+      perturbed->sysParams.set_alpha_ic(1.);
+      contexts.push_back(perturbed);
+      members.push_back(new Ipbs(*perturbed, gv, gfs, boundaryIndexToEntity, 1, false));
+      members.back()->restoreState(state);
+    }
+  }
+  if (!members.empty())
+  {
+    typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+    DGF udgf(gfs,u);
+    const SolutionValues<DGF> solution(udgf);
+    Ipbs::updateChargeRegulation(members, solution);
+    Ipbs::updateBC(members, solution);
+  }
+
+  // dR/dp of all parameters
+  std::vector<U*> dR;
+  for (size_t p = 0; p < keys.size(); p++)
+  {
+    dR.push_back(new U(gfs,0.0));
+    for (int s = 0; s < 2; s++)
+    {
+      const J j(*contexts[2*p+s], gv, boundaryIndexToEntity, *members[2*p+s]);
+      LOP lop(*contexts[2*p+s], m, b, j, intorder);
+      GO perturbedGo(gfs,cc,gfs,cc,lop);
+      U r(gfs,0.0);
+      perturbedGo.residual(u, r);
+      dR[p]->axpy(s == 0 ? 1. : -1., r);
+    }
+    *dR[p] *= .5 / steps[p];
+    Dune::PDELab::set_constrained_dofs(cc, 0.0, *dR[p]);
+  }
+
+  typedef typename GO::Traits::Jacobian Matrix;
+  Matrix A(go);
+  A = 0.0;
+  go.jacobian(u, A);
+
+  // one adjoint solve per force component
+  typedef ForceFunctional<GV,GFS,PGMap> Functional;
+  std::vector<std::vector<double> > dF(keys.size());
+  for (int i = 0; i < npart; i++)
+    for (int d = 0; d < ndir; d++)
+    {
+      const Functional functional(context, gv, gfs, boundaryIndexToEntity, i, d);
+      U dFdu(gfs,0.0), z(gfs,0.0);
+      functional.derivative(u, dFdu);
+      Dune::PDELab::set_constrained_dofs(cc, 0.0, dFdu);
+      ls.apply(A, z, dFdu, 1e-8);
+
+      for (size_t p = 0; p < keys.size(); p++)
+      {
+        // explicit dependence of the force on the parameter
+        U scratch(gfs,0.0);
+        const double Fplus = Functional(*contexts[2*p], gv, gfs, boundaryIndexToEntity, i, d)
+          .derivative(u, scratch);
+        const double Fminus = Functional(*contexts[2*p+1], gv, gfs, boundaryIndexToEntity, i, d)
+          .derivative(u, scratch);
+        // the residual is additive and z consistent on the process borders
+        const double zdR = gv.comm().sum(z.base() * dR[p]->base());
+        dF[p].push_back(.5 * (Fplus - Fminus) / steps[p] - zdR);
+      }
+    }
+
+  if (gv.comm().rank() == 0)
+  {
+    std::ofstream out(filename.c_str());
+    out << "# parameter value, derivatives of the force components on particles 0.."
+        << npart-1 << std::endl;
+    for (size_t p = 0; p < keys.size(); p++)
+    {
+      out << keys[p] << " " << values[p];
+      for (size_t c = 0; c < dF[p].size(); c++)
+        out << " " << dF[p][c];
+      out << std::endl;
+    }
+  }
+
+  for (size_t p = 0; p < keys.size(); p++)
+    delete dR[p];
+  for (size_t c = 0; c < members.size(); c++) {
+    delete members[c];
+    delete contexts[c];
+  }
+}
+
+#endif  // _SENSITIVITY_HH
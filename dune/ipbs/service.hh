@@ -0,0 +1,382 @@
+#ifndef _SERVICE_HH
+#define _SERVICE_HH
+
+/** \file
+    \brief Long running solver answering parameter updates
+
+    With "ipbs --serve config" the problem of the configuration is solved
+    once and then kept: grid, function space, the precomputed boundary data
+    of Ipbsolver and the solver objects. Each request changes parameters and
+    the problem is solved again, starting from the previous solution like the
+    points of a parameter continuation.
+
+    A request is one line of key=value pairs with keys as in
+    apply_parameter(), e.g.
+
+    \code
+    boundary_0.charge_density=-0.02 system.pH=6
+    \endcode
+
+    Keys not given keep their values. The answer is one line
+
+    \code
+    ok iterations=7 latency=1.3 cached=0 F0_x=... phi0=... energy=...
+    \endcode
+
+    or "error <message>", "error not converged" when Newton failed or the
+    maximum number of iterations was reached. The answers of all solved
+    parameter sets are cached, a set solved before is answered without
+    solving. "stats" returns the number of requests, solves, failures and
+    cache hits and the latencies, "quit" ends the service, as does the end
+    of the input.
+
+    Requests are read from stdin and answered on stdout, the log of the
+    solver goes to stderr in the meantime. With service.socket the requests
+    come from the clients of a UNIX socket instead, one after the other.
+*/
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fvector.hh>
+#include <dune/common/timer.hh>
+
+#include "context.hh"
+#include "parser.hh"
+
+// ------------------------------------------------------------------------
+/// Lines from stdin or the clients of a UNIX socket, only used on rank 0
+// ------------------------------------------------------------------------
+class ServiceChannel
+{
+  public:
+    explicit ServiceChannel(const std::string& path_) : path(path_), listener(-1), in(0), out(1)
+    {
+      if (path.empty())
+        return;
+      listener = socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un address;
+      std::memset(&address, 0, sizeof(address));
+      address.sun_family = AF_UNIX;
+      std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+      // only the socket of an earlier service is replaced, never another file
+      struct stat status;
+      if (lstat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+          if (listener >= 0)
+            close(listener);
+          DUNE_THROW(Dune::IOError, "Could not listen on " << path << ": not a socket");
+        }
+        unlink(path.c_str());
+      }
+      if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address),
+            sizeof(address)) != 0 || listen(listener, 1) != 0)
+        DUNE_THROW(Dune::IOError, "Could not listen on " << path << ": " << std::strerror(errno));
+      in = out = -1;
+    }
+
+    ~ServiceChannel()
+    {
+      if (listener >= 0) {
+        disconnect();
+        close(listener);
+        unlink(path.c_str());
+      }
+    }
+
+    /// Next request line, false at the end of stdin
+    bool read(std::string& line)
+    {
+      for (;;)
+      {
+        const size_t end = buffer.find('\n');
+        if (end != std::string::npos) {
+          line = buffer.substr(0, end);
+          buffer.erase(0, end + 1);
+          return true;
+        }
+        if (in < 0) {
+          // wait for the next client
+          in = out = accept(listener, 0, 0);
+          continue;
+        }
+        char chunk[4096];
+        const ssize_t n = ::read(in, chunk, sizeof(chunk));
+        if (n > 0)
+          buffer.append(chunk, n);
+        else if (n < 0 && errno == EINTR)
+          continue;
+        else if (listener >= 0)
+          disconnect();
+        else
+          return false;
+      }
+    }
+
+    /// Answer the last request, a client that went away is not an error
+    void write(const std::string& line)
+    {
+      const std::string message = line + "\n";
+      size_t written = 0;
+      while (out >= 0 && written < message.size())
+      {
+        const ssize_t n = listener >= 0 ?
+          send(out, message.data() + written, message.size() - written, MSG_NOSIGNAL) :
+          ::write(out, message.data() + written, message.size() - written);
+        if (n > 0)
+          written += n;
+        else if (n < 0 && errno == EINTR)
+          continue;
+        else
+          break;
+      }
+    }
+
+  private:
+    ServiceChannel(const ServiceChannel&);
+    ServiceChannel& operator=(const ServiceChannel&);
+
+    void disconnect()
+    {
+      if (in >= 0)
+        close(in);
+      in = out = -1;
+      buffer.clear();
+    }
+
+    const std::string path;
+    int listener;
+    int in, out;
+    std::string buffer;	// received but not yet returned
+};
+
+// ------------------------------------------------------------------------
+/// Requests, answers and statistics of the service
+// ------------------------------------------------------------------------
+class IpbsService
+{
+  public:
+    /// Start serving, stdout is kept free for the answers
+    IpbsService(IpbsContext& context_, int rank_) :
+      context(context_), rank(rank_), channel(rank_ == 0 ? new ServiceChannel(
+            context_.sysParams.get_serviceSocket()) : 0),
+      pending(false), requests(0), solves(0), failures(0), hits(0), totalLatency(0), maxLatency(0),
+      totalIterations(0)
+    {
+      std::cout.flush();
+      log = std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    ~IpbsService()
+    {
+      std::cout.rdbuf(log);
+      if (rank == 0)
+        std::cout << statistics() << std::endl;
+      delete channel;
+    }
+
+    // ------------------------------------------------------------------------
+    /// Answer the request the problem was just solved for
+    // ------------------------------------------------------------------------
+    /*!
+       The results of the first solve, before any request, are only cached.
+       Results of a solve that did not converge are neither cached nor
+       returned, the request is answered "error not converged".
+    */
+    template<typename Real, int dim>
+    void answer(const std::vector<Dune::FieldVector<Real,dim> >& F,
+                const std::vector<double>& potentials, double energy, int iterations,
+                bool converged)
+    {
+      if (!converged) {
+        if (pending) {
+          failures++;
+          pending = false;
+          if (rank == 0)
+            channel->write("error not converged");
+        }
+        return;
+      }
+      std::ostringstream results;
+      for (size_t i = 0; i < F.size(); i++)
+        for (int d = 0; d < dim; d++)
+          results << " F" << i << "_" << "xyz"[d] << "=" << F[i][d];
+      for (size_t i = 0; i < potentials.size(); i++)
+        results << " phi" << i << "=" << potentials[i];
+      results << " energy=" << energy;
+      cache[state()] = results.str();
+      if (!pending)
+        return;
+
+      solves++;
+      totalIterations += iterations;
+      std::ostringstream line;
+      line << "iterations=" << iterations;
+      reply(line.str(), false, results.str());
+    }
+
+    // ------------------------------------------------------------------------
+    /// Take requests until one needs a solve, false when the service ends
+    // ------------------------------------------------------------------------
+    /*!
+       The request is read on rank 0 and applied to the context on all
+       processes of the communicator.
+    */
+    template<class CollectiveCommunication>
+    bool next(const CollectiveCommunication& communicator)
+    {
+      for (;;)
+      {
+        std::string line;
+        int open = 1;
+        if (rank == 0) {
+          open = channel->read(line);
+          latency.reset();
+        }
+        broadcast(communicator, open, line);
+        if (!open)
+          return false;
+
+        std::istringstream in(line);
+        std::vector<std::pair<std::string,double> > updates;
+        std::string token, error;
+        bool stats = false;
+        while (in >> token)
+        {
+          if (token == "quit")
+            return false;
+          if (token == "stats") {
+            stats = true;
+            break;
+          }
+          const size_t equal = token.find('=');
+          std::istringstream value(equal == std::string::npos ? "" : token.substr(equal+1));
+          double x;
+          if (!(value >> x) || !value.eof()) {
+            error = "error no value in \"" + token + "\"";
+            break;
+          }
+          updates.push_back(std::make_pair(token.substr(0, equal), x));
+        }
+        if (stats) {
+          if (rank == 0)
+            channel->write(statistics());
+          continue;
+        }
+
+        // all keys are checked before the first one is set
+        requests++;
+        if (error.empty()) {
+          IpbsContext copy(context);
+          for (size_t u = 0; u < updates.size() && error.empty(); u++)
+            if (!set_parameter(copy, updates[u].first, updates[u].second))
+              error = "error parameter \"" + updates[u].first + "\" can not be changed";
+        }
+        if (!error.empty()) {
+          if (rank == 0)
+            channel->write(error);
+          continue;
+        }
+        for (size_t u = 0; u < updates.size(); u++)
+          set_parameter(context, updates[u].first, updates[u].second);
+
+        std::map<std::string,std::string>::const_iterator cached = cache.find(state());
+        if (cached != cache.end()) {
+          hits++;
+          reply("iterations=0", true, cached->second);
+          continue;
+        }
+        pending = true;
+        return true;
+      }
+    }
+
+    /// Requests, solves, cache hits and latencies in one line
+    std::string statistics() const
+    {
+      std::ostringstream line;
+      line << "stats requests=" << requests << " solves=" << solves << " failures=" << failures
+           << " hits=" << hits
+           << " hit_rate=" << (solves + hits > 0 ? double(hits) / (solves + hits) : 0.)
+           << " mean_latency=" << (solves + hits > 0 ? totalLatency / (solves + hits) : 0.)
+           << " max_latency=" << maxLatency
+           << " mean_iterations=" << (solves > 0 ? double(totalIterations) / solves : 0.);
+      return line.str();
+    }
+
+  private:
+    IpbsService(const IpbsService&);
+    IpbsService& operator=(const IpbsService&);
+
+    void reply(const std::string& iterations, bool hit, const std::string& results)
+    {
+      pending = false;
+      if (rank != 0)
+        return;
+      const double time = latency.elapsed();
+      totalLatency += time;
+      maxLatency = std::max(maxLatency, time);
+      std::ostringstream line;
+      line << "ok " << iterations << " latency=" << time << " cached=" << hit << results;
+      channel->write(line.str());
+    }
+
+    /// Values of all parameters a request can change, the key of the cache
+    std::string state()
+    {
+      static const char* const system[] = { "system.lambda", "system.pH", "system.epsilon",
+        "system.salt" };
+      static const char* const fields[] = { ".charge_density", ".pK", ".potential" };
+      std::ostringstream key;
+      key.precision(17);
+      for (int k = 0; k < 4; k++)
+        key << parameter_value(context, system[k]) << " ";
+      for (size_t i = 0; i < context.boundary.size(); i++)
+        for (int f = 0; f < 3; f++) {
+          std::ostringstream name;
+          name << "boundary_" << i << fields[f];
+          key << parameter_value(context, name.str()) << " ";
+        }
+      return key.str();
+    }
+
+    template<class CollectiveCommunication>
+    static void broadcast(const CollectiveCommunication& communicator, int& open,
+                          std::string& line)
+    {
+      int length = line.size();
+      communicator.broadcast(&open, 1, 0);
+      communicator.broadcast(&length, 1, 0);
+      std::vector<char> characters(line.begin(), line.end());
+      characters.resize(length + 1);
+      communicator.broadcast(&characters[0], length + 1, 0);
+      line.assign(characters.begin(), characters.begin() + length);
+    }
+
+    IpbsContext& context;
+    const int rank;
+    ServiceChannel* channel;
+    std::streambuf* log;	// buffer of std::cout before the service
+    std::map<std::string,std::string> cache;	// answers by the values of the parameters
+    bool pending;	// a request waits for the solve
+    Dune::Timer latency;
+    int requests, solves, failures, hits;
+    double totalLatency, maxLatency;
+    int totalIterations;
+};
+
+#endif  // _SERVICE_HH
@@ -0,0 +1,349 @@
+#ifndef _SNAPSHOT_HH
+#define _SNAPSHOT_HH
+
+/** \file
+    \brief Solution snapshots used as initial guess on a different mesh
+
+    A snapshot stores the potential at the corners of all simplices (the P1
+    interpolant of the solution) together with the iterated boundary state.
+    Each process writes its interior elements to name_pRANK.snap, the
+    boundary state is replicated and only written by rank 0.
+
+    SnapshotFunction reads all pieces and evaluates the stored potential at
+    arbitrary points by locating the old element containing them; points
+    outside the old domain are extrapolated from the closest element found.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/fvector.hh>
+#include <dune/common/fmatrix.hh>
+#include <dune/pdelab/common/function.hh>
+#include <dune/pdelab/gridfunctionspace/gridfunctionspaceutilities.hh>
+
+#include "checkpoint.hh"
+
+inline std::string snapshot_filename(const std::string& name, int rank)
+{
+  std::ostringstream filename;
+  filename << name << "_p" << rank << ".snap";
+  return filename.str();
+}
+
+// ------------------------------------------------------------------------
+/// Write the P1 interpolant of u and the iterated boundary state
+// ------------------------------------------------------------------------
+template<class GV, class GFS, class U, class State>
+void write_snapshot(const std::string& name, const GV& gv, const GFS& gfs, const U& u,
+    const State& state)
+{
+  typedef typename GV::template Codim<0>::template Partition
+          <Dune::Interior_Partition>::Iterator LeafIterator;
+  typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+  typedef typename DGF::Traits::RangeType RT;
+  const int dim = GV::dimension;
+
+  DGF udgf(gfs,u);
+  std::vector<double> corners, values;
+  for (LeafIterator it = gv.template begin<0,Dune::Interior_Partition>();
+           	it!=gv.template end<0,Dune::Interior_Partition>(); ++it)
+  {
+    if (!it->type().isSimplex())
+      DUNE_THROW(Dune::NotImplemented, "Snapshots are only implemented for simplices");
+    for (int c = 0; c < it->geometry().corners(); c++) {
+      for (int d = 0; d < dim; d++)
+        corners.push_back(it->geometry().corner(c)[d]);
+      RT value;
+      udgf.evaluate(*it, it->geometry().local(it->geometry().corner(c)), value);
+      values.push_back(value);
+    }
+  }
+
+  const std::string filename = snapshot_filename(name, gv.comm().rank());
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  int header[4] = { gv.comm().size(), dim, (int) values.size()/(dim+1), 0 };
+  if (gv.comm().rank() == 0)
+    header[3] = state.size();
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  CheckpointIO::write(out, corners);
+  CheckpointIO::write(out, values);
+  if (gv.comm().rank() == 0) {
+    std::vector<double> positions;
+    for (size_t i = 0; i < state.size(); i++)
+      for (int d = 0; d < dim; d++)
+        positions.push_back(state.positions[i][d]);
+    int ngroups = state.efieldShift.size();
+    out.write(reinterpret_cast<const char*>(&ngroups), sizeof(int));
+    CheckpointIO::write(out, positions);
+    CheckpointIO::write(out, state.types);
+    CheckpointIO::write(out, state.bContainer);
+    CheckpointIO::write(out, state.inducedChargeDensity);
+    CheckpointIO::write(out, state.regulatedChargeDensity);
+    CheckpointIO::write(out, state.efieldShift);
+  }
+  if (!out)
+    DUNE_THROW(Dune::IOError, "Could not write snapshot " << filename);
+}
+
+
+/** \brief The potential stored in a snapshot as grid function on another mesh */
+template<typename GV, typename RF, typename State>
+class SnapshotFunction
+  : public Dune::PDELab::GridFunctionBase<Dune::PDELab::
+           GridFunctionTraits<GV,RF,1,Dune::FieldVector<RF,1> >,
+           SnapshotFunction<GV,RF,State> >
+{
+public :
+
+  typedef Dune::PDELab::GridFunctionTraits<GV,RF,1,Dune::FieldVector<RF,1> > Traits;
+  typedef typename GV::ctype ctype;
+  static const int dim = GV::dimension;
+  typedef Dune::FieldVector<ctype,dim> Position;
+
+  //! read all pieces of the snapshot
+  SnapshotFunction(const GV& gv_, const std::string& name) : gv(gv_)
+  {
+    int pieces = 1;
+    for (int rank = 0; rank < pieces; rank++)
+    {
+      const std::string filename = snapshot_filename(name, rank);
+      std::ifstream in(filename.c_str(), std::ios::binary);
+      int header[4];
+      in.read(reinterpret_cast<char*>(header), sizeof(header));
+      if (!in || header[1] != dim)
+        DUNE_THROW(Dune::IOError, "Could not read snapshot " << filename);
+      pieces = header[0];
+
+      std::vector<double> c, v;
+      CheckpointIO::read(in, c, header[2]*(dim+1)*dim);
+      CheckpointIO::read(in, v, header[2]*(dim+1));
+      corners.insert(corners.end(), c.begin(), c.end());
+      values.insert(values.end(), v.begin(), v.end());
+
+      if (rank == 0) {
+        int ngroups;
+        in.read(reinterpret_cast<char*>(&ngroups), sizeof(int));
+        std::vector<double> positions;
+        CheckpointIO::read(in, positions, header[3]*dim);
+        CheckpointIO::read(in, boundaryState.types, header[3]);
+        CheckpointIO::read(in, boundaryState.bContainer, header[3]);
+        CheckpointIO::read(in, boundaryState.inducedChargeDensity, header[3]);
+        CheckpointIO::read(in, boundaryState.regulatedChargeDensity, header[3]);
+        CheckpointIO::read(in, boundaryState.efieldShift, ngroups);
+        boundaryState.positions.resize(header[3]);
+        for (int i = 0; i < header[3]; i++)
+          for (int d = 0; d < dim; d++)
+            boundaryState.positions[i][d] = positions[i*dim+d];
+      }
+      if (!in)
+        DUNE_THROW(Dune::IOError, "Snapshot " << filename << " is truncated");
+    }
+    // the iteration starts over on the new mesh
+    boundaryState.iterationCounter = 0;
+    buildLookup();
+  }
+
+  //! boundary state of the old run, to be mapped with Ipbsolver::restoreState
+  const State& state() const
+  {
+    return boundaryState;
+  }
+
+  //! evaluate the stored potential on element
+  inline void evaluate (const typename Traits::ElementType& e,
+                        const typename Traits::DomainType& xlocal,
+                        typename Traits::RangeType& y) const
+  {
+    Position x = e.geometry().global(xlocal);
+    Key c = key(x);
+
+    // the containing element is found in the cell of x, otherwise look for the
+    // closest one in the neighborhood
+    int best = -1;
+    double bestQuality = 0;
+    Dune::FieldVector<double,dim+1> bestLambda;
+    for (int ring = 0; best < 0 || (ring <= 1 && bestQuality < -1e-8); ring++)
+    {
+      if (ring > cellsPerDirection)
+        break;
+      visitRing(c, ring, 0, Key(), x, best, bestQuality, bestLambda);
+    }
+    // far outside of the old domain
+    if (best < 0) {
+      Dune::FieldVector<double,dim+1> lambda;
+      for (int n = 0; n < (int) values.size()/(dim+1); n++) {
+        double quality = barycentric(n, x, lambda);
+        if (best < 0 || quality > bestQuality) {
+          best = n;
+          bestQuality = quality;
+          bestLambda = lambda;
+        }
+      }
+    }
+
+    y = 0;
+    // clamp the barycentric coordinates for points outside the old mesh
+    double sum = 0;
+    for (int i = 0; i <= dim; i++) {
+      bestLambda[i] = std::max(bestLambda[i], 0.);
+      sum += bestLambda[i];
+    }
+    for (int i = 0; i <= dim; i++)
+      y += bestLambda[i] / sum * values[best*(dim+1)+i];
+  }
+
+  //! get a reference to the grid view
+  inline const GV& getGridView() { return gv; }
+
+private :
+
+  typedef Dune::FieldVector<int,dim> Key;
+
+  struct KeyCompare
+  {
+    bool operator() (const Key& a, const Key& b) const
+    {
+      for (int d = 0; d < dim; d++) {
+        if (a[d] < b[d]) return true;
+        if (a[d] > b[d]) return false;
+      }
+      return false;
+    }
+  };
+  typedef std::map<Key, std::vector<int>, KeyCompare> Cells;
+
+  Position corner(int element, int c) const
+  {
+    Position p;
+    for (int d = 0; d < dim; d++)
+      p[d] = corners[(element*(dim+1)+c)*dim+d];
+    return p;
+  }
+
+  Key key(const Position& pos) const
+  {
+    Key k;
+    for (int d = 0; d < dim; d++)
+      k[d] = (int) std::floor((pos[d]-lower[d])/cellSize);
+    return k;
+  }
+
+  // bucket the elements by their bounding boxes
+  void buildLookup()
+  {
+    const int nElems = values.size()/(dim+1);
+    if (nElems == 0)
+      DUNE_THROW(Dune::IOError, "Snapshot contains no elements");
+    lower = corner(0,0);
+    Position upper = lower;
+    for (int e = 0; e < nElems; e++)
+      for (int c = 0; c <= dim; c++)
+        for (int d = 0; d < dim; d++) {
+          lower[d] = std::min(lower[d], corner(e,c)[d]);
+          upper[d] = std::max(upper[d], corner(e,c)[d]);
+        }
+    double extent = 0;
+    for (int d = 0; d < dim; d++)
+      extent = std::max(extent, (double) (upper[d]-lower[d]));
+    cellsPerDirection = std::max(1, (int) std::ceil(std::pow((double) nElems, 1./dim)));
+    cellSize = extent / cellsPerDirection;
+
+    for (int e = 0; e < nElems; e++) {
+      Key lo = key(corner(e,0)), hi = lo;
+      for (int c = 1; c <= dim; c++) {
+        Key k = key(corner(e,c));
+        for (int d = 0; d < dim; d++) {
+          lo[d] = std::min(lo[d], k[d]);
+          hi[d] = std::max(hi[d], k[d]);
+        }
+      }
+      insert(e, lo, hi, 0, lo);
+    }
+  }
+
+  void insert(int e, const Key& lo, const Key& hi, int d, Key k)
+  {
+    if (d == dim) {
+      cells[k].push_back(e);
+      return;
+    }
+    for (k[d] = lo[d]; k[d] <= hi[d]; k[d]++)
+      insert(e, lo, hi, d+1, k);
+  }
+
+  // barycentric coordinates of x in element e, returns the smallest one
+  double barycentric(int e, const Position& x, Dune::FieldVector<double,dim+1>& lambda) const
+  {
+    Dune::FieldMatrix<double,dim,dim> A;
+    Position c0 = corner(e,0);
+    for (int c = 1; c <= dim; c++) {
+      Position edge = corner(e,c);
+      edge -= c0;
+      for (int d = 0; d < dim; d++)
+        A[d][c-1] = edge[d];
+    }
+    Dune::FieldVector<double,dim> rhs, l;
+    for (int d = 0; d < dim; d++)
+      rhs[d] = x[d] - c0[d];
+    A.solve(l, rhs);
+    lambda[0] = 1.;
+    double minimum = 1.;
+    for (int d = 0; d < dim; d++) {
+      lambda[d+1] = l[d];
+      lambda[0] -= l[d];
+      minimum = std::min(minimum, l[d]);
+    }
+    return std::min(minimum, lambda[0]);
+  }
+
+  // test the elements in all cells with maximum norm distance ring from center
+  void visitRing(const Key& center, int ring, int d, Key offset, const Position& x,
+                 int& best, double& bestQuality, Dune::FieldVector<double,dim+1>& bestLambda) const
+  {
+    if (d == dim) {
+      int norm = 0;
+      for (int e = 0; e < dim; e++)
+        norm = std::max(norm, std::abs(offset[e]));
+      if (norm != ring)
+        return;
+      Key k = center;
+      k += offset;
+      typename Cells::const_iterator cell = cells.find(k);
+      if (cell == cells.end())
+        return;
+      Dune::FieldVector<double,dim+1> lambda;
+      for (size_t n = 0; n < cell->second.size(); n++) {
+        double quality = barycentric(cell->second[n], x, lambda);
+        if (best < 0 || quality > bestQuality) {
+          best = cell->second[n];
+          bestQuality = quality;
+          bestLambda = lambda;
+        }
+      }
+      return;
+    }
+    for (int o = -ring; o <= ring; o++) {
+      offset[d] = o;
+      visitRing(center, ring, d+1, offset, x, best, bestQuality, bestLambda);
+    }
+  }
+
+  const GV& gv;
+  std::vector<double> corners;
+  std::vector<double> values;
+  State boundaryState;
+  Cells cells;
+  Position lower;
+  double cellSize;
+  int cellsPerDirection;
+};
+
+#endif  // _SNAPSHOT_HH
@@ -0,0 +1,270 @@
+#ifndef _SWEEP_HH
+#define _SWEEP_HH
+
+/** \file
+    \brief Parameter sweeps over a grid of configurations
+
+    A sweep file names a base configuration and lists values for any of its
+    keys, the points of the sweep are all combinations of them:
+
+    \code
+    [sweep]
+    config = sphere.cfg
+    directory = sweep_lambda
+    processes = 1
+
+    [grid]
+    system.lambda = 1 2 4
+    boundary_0.charge_density = -0.01 -0.02
+    \endcode
+
+    Every point gets a directory with its configuration, output.name points
+    into it and output.summary is set. The summary written at the end of a
+    run marks the point as done, so a sweep that was stopped is resumed by
+    starting it again. Finally rank 0 collects all summaries into one table,
+    results.dat, with the parameters of each point in front.
+
+    Distance sweeps need a mesh per point. Keys geometry.<name> in [grid]
+    replace \@name\@ in the gmsh file given by sweep.mesh_template, which is
+    meshed for each point by the group solving it (sweep.mesher).
+*/
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/parametertree.hh>
+#include <dune/common/parametertreeparser.hh>
+
+class ParameterSweep
+{
+  public:
+    /// Read the sweep file and the base configuration it names
+    explicit ParameterSweep(const std::string& sweepFile)
+    {
+      Dune::ParameterTree sweep;
+      Dune::ParameterTreeParser::readINITree(sweepFile, sweep);
+      Dune::ParameterTreeParser::readINITree(sweep.get<std::string>("sweep.config"), base);
+      directory = sweep.get<std::string>("sweep.directory", "sweep");
+      processes = sweep.get<int>("sweep.processes", 1);
+      meshTemplate = sweep.get<std::string>("sweep.mesh_template", "");
+      mesher = sweep.get<std::string>("sweep.mesher", "gmsh -2 -v 0");
+      if (!sweep.hasSub("grid"))
+        DUNE_THROW(Dune::Exception, "Sweep file " << sweepFile << " has no [grid]");
+      read_grid(sweep.sub("grid"), "");
+
+      points = 1;
+      for (size_t j = 0; j < values.size(); j++)
+        points *= values[j].size();
+    }
+
+    /// Number of points of the sweep
+    size_t size() const
+    {
+      return points;
+    }
+
+    /// Processes solving one point
+    int groupSize() const
+    {
+      return processes;
+    }
+
+    /// Values of the keys at point i, the first key varies slowest
+    std::vector<std::string> point(size_t i) const
+    {
+      std::vector<std::string> point(keys.size());
+      for (size_t j = keys.size(); j-- > 0; )
+      {
+        point[j] = values[j][i % values[j].size()];
+        i /= values[j].size();
+      }
+      return point;
+    }
+
+    std::string config(size_t i) const
+    {
+      return pointDirectory(i) + "/config.cfg";
+    }
+
+    /// A point is done when its summary was written for the same parameters
+    bool done(size_t i) const
+    {
+      std::ifstream summary(summaryFile(i).c_str());
+      std::ifstream in((pointDirectory(i) + "/parameters").c_str());
+      std::string written;
+      return summary && std::getline(in, written) && written == parameters(i);
+    }
+
+    // ------------------------------------------------------------------------
+    /// Write the directory and the configuration of point i
+    // ------------------------------------------------------------------------
+    void prepare(size_t i) const
+    {
+      make_directory(directory);
+      make_directory(pointDirectory(i));
+      const std::vector<std::string> p = point(i);
+      Dune::ParameterTree tree(base);
+      for (size_t j = 0; j < keys.size(); j++)
+        if (!geometry(j))
+          tree[keys[j]] = p[j];
+      if (!meshTemplate.empty())
+        tree["mesh.filename"] = pointDirectory(i) + "/mesh.msh";
+      tree["output.name"] = pointDirectory(i) + "/ipbs";
+      tree["output.summary"] = "true";
+
+      std::ofstream out(config(i).c_str());
+      tree.report(out);
+      std::ofstream written((pointDirectory(i) + "/parameters").c_str());
+      written << parameters(i) << std::endl;
+      // an old summary belongs to other parameters
+      std::remove(summaryFile(i).c_str());
+    }
+
+    // ------------------------------------------------------------------------
+    /// Mesh the template for point i, false if the mesher failed
+    // ------------------------------------------------------------------------
+    bool mesh(size_t i) const
+    {
+      if (meshTemplate.empty())
+        return true;
+      std::ifstream in(meshTemplate.c_str());
+      if (!in) {
+        std::cerr << "Could not read mesh template \"" << meshTemplate << "\"!" << std::endl;
+        return false;
+      }
+      std::stringstream buffer;
+      buffer << in.rdbuf();
+      std::string geo = buffer.str();
+      const std::vector<std::string> p = point(i);
+      for (size_t j = 0; j < keys.size(); j++)
+        if (geometry(j)) {
+          const std::string placeholder = "@" + keys[j].substr(9) + "@";
+          for (size_t pos = geo.find(placeholder); pos != std::string::npos;
+               pos = geo.find(placeholder, pos + p[j].size()))
+            geo.replace(pos, placeholder.size(), p[j]);
+        }
+      const std::string prefix = pointDirectory(i) + "/mesh";
+      std::ofstream out((prefix + ".geo").c_str());
+      out << geo;
+      out.close();
+      const std::string command = mesher + " " + prefix + ".geo -o " + prefix + ".msh";
+      if (std::system(command.c_str()) != 0) {
+        std::cerr << "Meshing point " << i << " failed: " << command << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    // ------------------------------------------------------------------------
+    /// Collect the summaries of all points in one table
+    // ------------------------------------------------------------------------
+    /*!
+       Points without a summary are listed as comments.
+    */
+    void aggregate() const
+    {
+      const std::string filename = directory + "/results.dat";
+      std::ofstream results(filename.c_str());
+      bool header = false;
+      size_t missing = 0;
+      for (size_t i = 0; i < points; i++)
+      {
+        std::ifstream summary(summaryFile(i).c_str());
+        std::string columns, line;
+        if (!done(i) || !std::getline(summary, columns) || !std::getline(summary, line)) {
+          results << "# point " << i << " (" << parameters(i) << ") not solved" << std::endl;
+          missing++;
+          continue;
+        }
+        if (!header) {
+          results << "# point";
+          for (size_t j = 0; j < keys.size(); j++)
+            results << " " << keys[j];
+          results << " " << columns.substr(columns.find_first_not_of("# ")) << std::endl;
+          header = true;
+        }
+        results << i;
+        const std::vector<std::string> p = point(i);
+        for (size_t j = 0; j < p.size(); j++)
+          results << " " << p[j];
+        results << " " << line << std::endl;
+      }
+      std::cout << "Results of " << points - missing << " of " << points << " points written to "
+                << filename << std::endl;
+    }
+
+  private:
+    /// Collect the keys of the grid with their lists of values
+    void read_grid(const Dune::ParameterTree& grid, const std::string& prefix)
+    {
+      const Dune::ParameterTree::KeyVector& valueKeys = grid.getValueKeys();
+      for (size_t k = 0; k < valueKeys.size(); k++)
+      {
+        std::istringstream in(grid.get<std::string>(valueKeys[k]));
+        std::vector<std::string> list;
+        std::string value;
+        while (in >> value)
+          list.push_back(value);
+        if (list.empty())
+          DUNE_THROW(Dune::Exception, "No values for " << prefix + valueKeys[k] << " in the sweep");
+        keys.push_back(prefix + valueKeys[k]);
+        values.push_back(list);
+      }
+      const Dune::ParameterTree::KeyVector& subKeys = grid.getSubKeys();
+      for (size_t k = 0; k < subKeys.size(); k++)
+        read_grid(grid.sub(subKeys[k]), prefix + subKeys[k] + ".");
+    }
+
+    bool geometry(size_t j) const
+    {
+      return keys[j].compare(0, 9, "geometry.") == 0;
+    }
+
+    std::string pointDirectory(size_t i) const
+    {
+      std::ostringstream name;
+      name << directory << "/point_" << i;
+      return name.str();
+    }
+
+    std::string summaryFile(size_t i) const
+    {
+      return pointDirectory(i) + "/ipbs_summary.dat";
+    }
+
+    std::string parameters(size_t i) const
+    {
+      const std::vector<std::string> p = point(i);
+      std::string line;
+      for (size_t j = 0; j < keys.size(); j++)
+        line += (j > 0 ? " " : "") + keys[j] + "=" + p[j];
+      return line;
+    }
+
+    static void make_directory(const std::string& name)
+    {
+      if (mkdir(name.c_str(), 0755) != 0 && errno != EEXIST)
+        DUNE_THROW(Dune::IOError, "Could not create directory " << name);
+    }
+
+    Dune::ParameterTree base;
+    std::string directory;
+    int processes;
+    std::string meshTemplate;
+    std::string mesher;
+    std::vector<std::string> keys;
+    std::vector<std::vector<std::string> > values;
+    size_t points;
+};
+
+#endif  // _SWEEP_HH
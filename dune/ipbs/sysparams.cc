@@ -10,6 +10,15 @@ SysParams::SysParams() :
 {
   totalError = 1E8;
   epsilon  = 1.;
+  integrationScaled = false;
+  ensemble = false;
+  ensembleMember = -1;
+  lockstep = false;
+  checkpointFinal = false;
+  sensitivities = false;
+  loadBalance = 0;
+  writeSummary = false;
+  service = false;
 }
 
 int SysParams::get_outStep()
@@ -135,6 +144,11 @@ double SysParams::get_epsilon()
 	return epsilon;
 }
 
+void SysParams::set_epsilon(double value)
+{
+	epsilon = value;
+}
+
 double SysParams::get_bjerrum()
 {
 	return bjerrum;
@@ -181,6 +195,26 @@ std::string SysParams::get_meshfile()
   return meshfile;
 }
 
+void SysParams::set_meshCache(std::string directory)
+{
+  meshCache = directory;
+}
+
+std::string SysParams::get_meshCache()
+{
+  return meshCache;
+}
+
+void SysParams::set_loadBalance(int mode)
+{
+  loadBalance = mode;
+}
+
+int SysParams::get_loadBalance()
+{
+  return loadBalance;
+}
+
 void SysParams::set_outname(std::string _outname)
 {
   outname = _outname;
@@ -215,6 +249,14 @@ double SysParams::get_integration_maxintorder() {
     return integration_maxintorder;
 }
 
+void SysParams::set_integrationScaled(bool value) {
+    integrationScaled = value;
+}
+
+bool SysParams::get_integrationScaled() {
+    return integrationScaled;
+}
+
 void SysParams::set_pH(double pH_) {
     pH=pH_;
 }
@@ -223,3 +265,389 @@ double SysParams::get_pH()
 {
     return pH;
 }
+
+void SysParams::set_refinementSteps(int value)
+{
+  refinementSteps = value;
+}
+
+int SysParams::get_refinementSteps()
+{
+  return refinementSteps;
+}
+
+void SysParams::set_refinementFraction(double value)
+{
+  refinementFraction = value;
+}
+
+double SysParams::get_refinementFraction()
+{
+  return refinementFraction;
+}
+
+void SysParams::set_coarsenFraction(double value)
+{
+  coarsenFraction = value;
+}
+
+double SysParams::get_coarsenFraction()
+{
+  return coarsenFraction;
+}
+
+void SysParams::set_adaptiveStrategy(int value)
+{
+  adaptiveStrategy = value;
+}
+
+int SysParams::get_adaptiveStrategy()
+{
+  return adaptiveStrategy;
+}
+
+void SysParams::set_goalParticle(int value)
+{
+  goalParticle = value;
+}
+
+int SysParams::get_goalParticle()
+{
+  return goalParticle;
+}
+
+void SysParams::set_goalDirection(int value)
+{
+  goalDirection = value;
+}
+
+int SysParams::get_goalDirection()
+{
+  return goalDirection;
+}
+
+void SysParams::set_nestedLevels(int value)
+{
+  nestedLevels = value;
+}
+
+int SysParams::get_nestedLevels()
+{
+  return nestedLevels;
+}
+
+void SysParams::set_nestedTolerance(double value)
+{
+  nestedTolerance = value;
+}
+
+double SysParams::get_nestedTolerance()
+{
+  return nestedTolerance;
+}
+
+void SysParams::set_degree(int value)
+{
+  degree = value;
+}
+
+int SysParams::get_degree()
+{
+  return degree;
+}
+
+void SysParams::set_pContinuation(bool value)
+{
+  pContinuation = value;
+}
+
+bool SysParams::get_pContinuation()
+{
+  return pContinuation;
+}
+
+void SysParams::set_initialGuess(int value)
+{
+  initialGuess = value;
+}
+
+int SysParams::get_initialGuess()
+{
+  return initialGuess;
+}
+
+void SysParams::set_checkpointName(std::string name)
+{
+  checkpointName = name;
+}
+
+std::string SysParams::get_checkpointName()
+{
+  return checkpointName;
+}
+
+void SysParams::set_checkpointInterval(int value)
+{
+  checkpointInterval = value;
+}
+
+int SysParams::get_checkpointInterval()
+{
+  return checkpointInterval;
+}
+
+void SysParams::set_checkpointWalltime(double value)
+{
+  checkpointWalltime = value;
+}
+
+double SysParams::get_checkpointWalltime()
+{
+  return checkpointWalltime;
+}
+
+void SysParams::set_checkpointOnSignal(bool value)
+{
+  checkpointOnSignal = value;
+}
+
+bool SysParams::get_checkpointOnSignal()
+{
+  return checkpointOnSignal;
+}
+
+void SysParams::set_restart(bool value)
+{
+  restart = value;
+}
+
+bool SysParams::get_restart()
+{
+  return restart;
+}
+
+void SysParams::set_checkpointFinal(bool value)
+{
+  checkpointFinal = value;
+}
+
+bool SysParams::get_checkpointFinal()
+{
+  return checkpointFinal;
+}
+
+void SysParams::set_warmStart(std::string name)
+{
+  warmStart = name;
+}
+
+std::string SysParams::get_warmStart()
+{
+  return warmStart;
+}
+
+void SysParams::set_writeSnapshot(bool value)
+{
+  writeSnapshot = value;
+}
+
+bool SysParams::get_writeSnapshot()
+{
+  return writeSnapshot;
+}
+
+void SysParams::set_writeSummary(bool value)
+{
+  writeSummary = value;
+}
+
+bool SysParams::get_writeSummary()
+{
+  return writeSummary;
+}
+
+void SysParams::set_morphParticle(int value)
+{
+  morphParticle = value;
+}
+
+int SysParams::get_morphParticle()
+{
+  return morphParticle;
+}
+
+void SysParams::set_morphDirection(int value)
+{
+  morphDirection = value;
+}
+
+int SysParams::get_morphDirection()
+{
+  return morphDirection;
+}
+
+void SysParams::set_morphIncrement(double value)
+{
+  morphIncrement = value;
+}
+
+double SysParams::get_morphIncrement()
+{
+  return morphIncrement;
+}
+
+void SysParams::set_morphSteps(int value)
+{
+  morphSteps = value;
+}
+
+int SysParams::get_morphSteps()
+{
+  return morphSteps;
+}
+
+void SysParams::set_morphInnerRadius(double value)
+{
+  morphInnerRadius = value;
+}
+
+double SysParams::get_morphInnerRadius()
+{
+  return morphInnerRadius;
+}
+
+void SysParams::set_morphOuterRadius(double value)
+{
+  morphOuterRadius = value;
+}
+
+double SysParams::get_morphOuterRadius()
+{
+  return morphOuterRadius;
+}
+
+void SysParams::set_continuation(std::string key, const std::vector<double>& values)
+{
+  continuationKey = key;
+  continuationValues = values;
+}
+
+std::string SysParams::get_continuationKey()
+{
+  return continuationKey;
+}
+
+const std::vector<double>& SysParams::get_continuationValues()
+{
+  return continuationValues;
+}
+
+void SysParams::set_ensemble(bool value)
+{
+  ensemble = value;
+}
+
+bool SysParams::get_ensemble()
+{
+  return ensemble;
+}
+
+void SysParams::set_ensembleMember(int value)
+{
+  ensembleMember = value;
+}
+
+int SysParams::get_ensembleMember()
+{
+  return ensembleMember;
+}
+
+void SysParams::set_lockstep(bool value)
+{
+  lockstep = value;
+}
+
+bool SysParams::get_lockstep()
+{
+  return lockstep;
+}
+
+void SysParams::set_superposition(std::string filename)
+{
+  superposition = filename;
+}
+
+std::string SysParams::get_superposition()
+{
+  return superposition;
+}
+
+void SysParams::set_sensitivities(bool value)
+{
+  sensitivities = value;
+}
+
+bool SysParams::get_sensitivities()
+{
+  return sensitivities;
+}
+
+void SysParams::set_reducedTraining(std::string filename)
+{
+  reducedTraining = filename;
+}
+
+std::string SysParams::get_reducedTraining()
+{
+  return reducedTraining;
+}
+
+void SysParams::set_reducedQueries(std::string filename)
+{
+  reducedQueries = filename;
+}
+
+std::string SysParams::get_reducedQueries()
+{
+  return reducedQueries;
+}
+
+void SysParams::set_reducedTolerance(double value)
+{
+  reducedTolerance = value;
+}
+
+double SysParams::get_reducedTolerance()
+{
+  return reducedTolerance;
+}
+
+void SysParams::set_podTolerance(double value)
+{
+  podTolerance = value;
+}
+
+double SysParams::get_podTolerance()
+{
+  return podTolerance;
+}
+
+void SysParams::set_service(bool value)
+{
+  service = value;
+}
+
+bool SysParams::get_service()
+{
+  return service;
+}
+
+void SysParams::set_serviceSocket(std::string path)
+{
+  serviceSocket = path;
+}
+
+std::string SysParams::get_serviceSocket()
+{
+  return serviceSocket;
+}
@@ -7,6 +7,7 @@
 #define _SYSPARAMS_H
 
 #include <string>
+#include <vector>
 
 class SysParams {
   public:
@@ -31,11 +32,53 @@ class SysParams {
   int get_outStep();
   size_t get_npart();
   std::string get_meshfile();
+  std::string get_meshCache();
+  int get_loadBalance();
   double get_pH();
   double get_integration_d();
   double get_integration_l();
   double get_integration_maxintorder();
+  bool get_integrationScaled();
   std::string get_outname();
+  int get_refinementSteps();
+  double get_refinementFraction();
+  double get_coarsenFraction();
+  int get_adaptiveStrategy();
+  int get_goalParticle();
+  int get_goalDirection();
+  int get_nestedLevels();
+  double get_nestedTolerance();
+  int get_degree();
+  bool get_pContinuation();
+  int get_initialGuess();
+  std::string get_checkpointName();
+  int get_checkpointInterval();
+  double get_checkpointWalltime();
+  bool get_checkpointOnSignal();
+  bool get_restart();
+  bool get_checkpointFinal();
+  std::string get_warmStart();
+  bool get_writeSnapshot();
+  bool get_writeSummary();
+  int get_morphParticle();
+  int get_morphDirection();
+  double get_morphIncrement();
+  int get_morphSteps();
+  double get_morphInnerRadius();
+  double get_morphOuterRadius();
+  std::string get_continuationKey();
+  const std::vector<double>& get_continuationValues();
+  bool get_ensemble();
+  int get_ensembleMember();
+  bool get_lockstep();
+  std::string get_superposition();
+  bool get_sensitivities();
+  std::string get_reducedTraining();
+  std::string get_reducedQueries();
+  double get_reducedTolerance();
+  double get_podTolerance();
+  bool get_service();
+  std::string get_serviceSocket();
 
   // Functions setting the private members
   void add_error(double);
@@ -47,6 +90,8 @@ class SysParams {
   void set_alpha_ipbs(double);
   void set_maxiter(unsigned int);
   void set_meshfile(std::string filename);
+  void set_meshCache(std::string directory);
+  void set_loadBalance(int mode);
   void set_refinement(int level);
   void set_tolerance(double value);
   void set_verbose(int value);
@@ -55,6 +100,43 @@ class SysParams {
   void set_boxLength (double value);
   void set_refinementFraction (double value);
   void set_refinementSteps (int value);
+  void set_coarsenFraction (double value);
+  void set_adaptiveStrategy (int value);
+  void set_goalParticle (int value);
+  void set_goalDirection (int value);
+  void set_nestedLevels (int value);
+  void set_nestedTolerance (double value);
+  void set_degree (int value);
+  void set_pContinuation (bool value);
+  void set_initialGuess (int value);
+  void set_checkpointName (std::string name);
+  void set_checkpointInterval (int value);
+  void set_checkpointWalltime (double value);
+  void set_checkpointOnSignal (bool value);
+  void set_restart (bool value);
+  void set_checkpointFinal (bool value);
+  void set_warmStart (std::string name);
+  void set_writeSnapshot (bool value);
+  void set_writeSummary (bool value);
+  void set_morphParticle (int value);
+  void set_morphDirection (int value);
+  void set_morphIncrement (double value);
+  void set_morphSteps (int value);
+  void set_morphInnerRadius (double value);
+  void set_morphOuterRadius (double value);
+  void set_continuation (std::string key, const std::vector<double>& values);
+  void set_epsilon (double value);
+  void set_ensemble (bool value);
+  void set_ensembleMember (int value);
+  void set_lockstep (bool value);
+  void set_superposition (std::string filename);
+  void set_sensitivities (bool value);
+  void set_reducedTraining (std::string filename);
+  void set_reducedQueries (std::string filename);
+  void set_reducedTolerance (double value);
+  void set_podTolerance (double value);
+  void set_service (bool value);
+  void set_serviceSocket (std::string path);
   void set_salt (int value);
   void set_outStep (int value);
   void set_npart (size_t value);
@@ -62,6 +144,7 @@ class SysParams {
   void set_integration_d(double value);
   void set_integration_l(double value);
   void set_integration_maxintorder(double value);
+  void set_integrationScaled(bool value);
   void set_outname(std::string _outname);
 	
   private:
@@ -81,13 +164,53 @@ class SysParams {
 	double alpha_ipbs;	// SOR parameter
   int maxiter;
   std::string meshfile;
+  std::string meshCache;	// directory of the binary mesh cache, empty if not used
+  int loadBalance;	// 0 element counts, 1 cost model, 2 measured costs of updateBC
   std::string outname;
   int verbose;
   double integration_d;
   double integration_l;
   double integration_maxintorder;
+  bool integrationScaled;	// integration lengths follow lambda
   double refinementFraction;
+  double coarsenFraction;
   int refinementSteps;
+  int adaptiveStrategy;	// 0 - residual, 1 - force on a particle (DWR)
+  int goalParticle;
+  int goalDirection;
+  int nestedLevels;
+  double nestedTolerance;
+  int degree;	// polynomial degree, <= 0 for the highest compiled one
+  bool pContinuation;
+  int initialGuess;	// 0 - constant flux, 1 - Debye-Hueckel
+  std::string checkpointName;
+  int checkpointInterval;
+  double checkpointWalltime;	// in seconds
+  bool checkpointOnSignal;
+  bool restart;
+  bool checkpointFinal;	// write a checkpoint of the converged solution
+  std::string warmStart;
+  bool writeSnapshot;
+  bool writeSummary;	// one line of results per run, e.g. for the tables of a sweep
+  int morphParticle;
+  int morphDirection;
+  double morphIncrement;
+  int morphSteps;
+  double morphInnerRadius;
+  double morphOuterRadius;
+  std::string continuationKey;	// parameter walked through in one run, empty if none
+  std::vector<double> continuationValues;
+  bool ensemble;	// solve the list of values as independent members instead of a continuation
+  int ensembleMember;	// index within the ensemble, -1 for a single run
+  bool lockstep;	// solve the ensemble members together on blocked vectors
+  std::string superposition;	// charge combinations evaluated from unit charge solutions
+  bool sensitivities;	// derivatives of the forces with respect to the parameters
+  std::string reducedTraining;	// parameter sets the reduced model is built from
+  std::string reducedQueries;	// parameter sets evaluated with the reduced model
+  double reducedTolerance;	// error indicator above which the full problem is solved
+  double podTolerance;	// relative energy of the snapshots left out of the bases
+  bool service;	// answer parameter updates after the first solve (ipbs --serve)
+  std::string serviceSocket;	// UNIX socket of the service, empty for stdin and stdout
   double pH;
 };
 
@@ -0,0 +1,233 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// global DUNE includes
+#include<dune/common/mpihelper.hh>
+#include<dune/common/exceptions.hh>
+#include<dune/common/fvector.hh>
+
+/* include grid IO */
+#include <dune/grid/io/file/gmshreader.hh>
+#include <dune/grid/utility/gridtype.hh>
+
+#include<dune/pdelab/finiteelementmap/pk2dfem.hh>
+#include<dune/pdelab/finiteelementmap/conformingconstraints.hh>
+#include<dune/pdelab/gridfunctionspace/gridfunctionspace.hh>
+#include<dune/pdelab/gridfunctionspace/gridfunctionspaceutilities.hh>
+#include<dune/pdelab/backend/istlvectorbackend.hh>
+
+// global typedefs
+typedef double Real;
+
+#include <dune/ipbs/ipbsstate.hh>
+#include <dune/ipbs/checkpoint.hh>
+#include <dune/ipbs/snapshot.hh>
+
+typedef IpbsState<double,2> State;
+
+// Boundary state with distinct values on nelem elements of a circle, of two physical groups
+State make_state(int nelem)
+{
+  State state;
+  for (int i = 0; i < nelem; i++) {
+    const double phi = 3.14159265358979 * (i + 0.5*(std::rand()/(double) RAND_MAX)) / nelem;
+    State::Position p;
+    p[0] = 10. * std::cos(phi);
+    p[1] = 10. * std::sin(phi);
+    state.positions.push_back(p);
+    state.types.push_back(i % 2);
+    state.bContainer.push_back(0.1 * i);
+    state.inducedChargeDensity.push_back(-0.01 * i);
+    state.regulatedChargeDensity.push_back(0.001 * i);
+  }
+  state.efieldShift.push_back(1.5);
+  state.efieldShift.push_back(-2.5);
+  state.iterationCounter = 17;
+  return state;
+}
+
+bool same_state(const State& a, const State& b)
+{
+  if (a.size() != b.size() || a.types != b.types || a.bContainer != b.bContainer
+      || a.inducedChargeDensity != b.inducedChargeDensity
+      || a.regulatedChargeDensity != b.regulatedChargeDensity
+      || a.efieldShift != b.efieldShift)
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (a.positions[i] != b.positions[i])
+      return false;
+  return true;
+}
+
+// nearest() has to agree with a search over all elements of the same group
+int check_nearest()
+{
+  int errors = 0;
+  State state = make_state(500);
+  for (int q = 0; q < 1000; q++) {
+    State::Position x;
+    // mostly near the surface, some far away for the fallback to the linear search
+    const double scale = q % 10 == 0 ? 1000. : 12.;
+    x[0] = scale * (2.*std::rand()/(double) RAND_MAX - 1.);
+    x[1] = scale * std::rand()/(double) RAND_MAX;
+    const int type = q % 2;
+    int expected = -1;
+    double best = 0;
+    for (size_t i = 0; i < state.size(); i++) {
+      State::Position diff = state.positions[i];
+      diff -= x;
+      if (state.types[i] == type && (expected < 0 || diff.two_norm2() < best)) {
+        expected = i;
+        best = diff.two_norm2();
+      }
+    }
+    const int found = state.nearest(x, type);
+    if (found != expected) {
+      std::cerr << "nearest(" << x << ", " << type << ") = " << found << ", expected "
+        << expected << std::endl;
+      errors++;
+    }
+  }
+  // no element of the group, and an empty state
+  State::Position origin(0.);
+  if (state.nearest(origin, 2) != -1 || State().nearest(origin, 0) != -1) {
+    std::cerr << "nearest() found an element of a missing group" << std::endl;
+    errors++;
+  }
+  // the lookup has to be rebuilt after the positions changed
+  state.positions[0] = State::Position(0.);
+  state.invalidate();
+  if (state.nearest(origin, 0) != 0) {
+    std::cerr << "nearest() used positions from before invalidate()" << std::endl;
+    errors++;
+  }
+  return errors;
+}
+
+//===============================================================
+// Main programm
+//===============================================================
+int main(int argc, char** argv)
+{
+ try{
+  Dune::MPIHelper& helper = Dune::MPIHelper::instance(argc, argv);
+  int errors = check_nearest();
+
+#if GRIDDIM == 2
+  typedef Dune::GridSelector::GridType GridType;
+  Dune::GridFactory<GridType> factory;
+  std::vector<int> boundaryIndexToEntity;
+  std::vector<int> elementIndexToEntity;
+  if(helper.rank() == 0)
+  {
+    Dune::GmshReader<GridType> gmshreader;
+    gmshreader.read(factory, "sphere2d.msh", boundaryIndexToEntity, elementIndexToEntity, true, true);
+  }
+  GridType* grid = factory.createGrid();
+  grid->loadBalance();
+
+  typedef GridType::LeafGridView GV;
+  const GV& gv = grid->leafView();
+  typedef Dune::PDELab::Pk2DLocalFiniteElementMap<GV, GridType::ctype, Real, 1> FEM;
+  FEM fem(gv);
+  typedef Dune::PDELab::ConformingDirichletConstraints CON;
+  CON con;
+  typedef Dune::PDELab::GridFunctionSpace<GV,FEM,CON,Dune::PDELab::ISTLVectorBackend<1> > GFS;
+  GFS gfs(gv,fem,con);
+  typedef Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+  U u(gfs,0.0);
+  const Dune::CollectiveCommunication<Dune::MPIHelper::MPICommunicator> comm =
+    helper.getCollectiveCommunication();
+  for (size_t i = 0; i < u.base().N(); i++)
+    u.base()[i] = std::sin(0.1*i) + 0.01*i;
+
+  // checkpoint: the coefficients and the state are read back unchanged
+  const State state = make_state(40);
+  write_checkpoint("test_checkpoint", helper.rank(), helper.size(), 1, u, state);
+  U v(gfs,0.0);
+  State read;
+  read_checkpoint("test_checkpoint", comm, 1, v, read);
+  for (size_t i = 0; i < u.base().N(); i++)
+    if (v.base()[i] != u.base()[i]) {
+      std::cerr << "checkpoint coefficient " << i << " is " << v.base()[i] << ", expected "
+        << u.base()[i] << std::endl;
+      errors++;
+      break;
+    }
+  if (!same_state(state, read) || read.iterationCounter != state.iterationCounter) {
+    std::cerr << "checkpoint state differs" << std::endl;
+    errors++;
+  }
+  if (checkpoint_degree("test_checkpoint", helper.rank()) != 1) {
+    std::cerr << "checkpoint degree differs" << std::endl;
+    errors++;
+  }
+  // a different setup is rejected
+  try {
+    read_checkpoint("test_checkpoint", comm, 2, v, read);
+    std::cerr << "checkpoint of P1 was read as P2" << std::endl;
+    errors++;
+  }
+  catch (Dune::IOError&) {}
+  // files of different iterations, as left by a job killed while renaming them
+  if (helper.size() > 1) {
+    State other = state;
+    other.iterationCounter += helper.rank();
+    write_checkpoint("test_checkpoint_mixed", helper.rank(), helper.size(), 1, u, other);
+    try {
+      read_checkpoint("test_checkpoint_mixed", comm, 1, v, read);
+      std::cerr << "checkpoint of different iterations was read" << std::endl;
+      errors++;
+    }
+    catch (Dune::IOError&) {}
+  }
+
+  // snapshot: the potential is reproduced on the same mesh, the state by rank 0
+  write_snapshot("test_checkpoint", gv, gfs, u, state);
+  grid->comm().barrier();
+  typedef SnapshotFunction<GV,Real,State> Snapshot;
+  const Snapshot snapshot(gv, "test_checkpoint");
+  State expected = state;
+  expected.iterationCounter = 0;
+  if (!same_state(expected, snapshot.state()) || snapshot.state().iterationCounter != 0) {
+    std::cerr << "snapshot state differs" << std::endl;
+    errors++;
+  }
+  typedef Dune::PDELab::DiscreteGridFunction<GFS,U> DGF;
+  DGF udgf(gfs,u);
+  double maxError = 0;
+  typedef GV::Codim<0>::Partition<Dune::Interior_Partition>::Iterator Iterator;
+  for (Iterator it = gv.begin<0,Dune::Interior_Partition>();
+       it != gv.end<0,Dune::Interior_Partition>(); ++it)
+  {
+    const Dune::FieldVector<GridType::ctype,2> center(1./3.);
+    DGF::Traits::RangeType y, z;
+    udgf.evaluate(*it, center, y);
+    snapshot.evaluate(*it, center, z);
+    maxError = std::max(maxError, std::abs(y[0] - z[0]));
+  }
+  if (maxError > 1e-10) {
+    std::cerr << "snapshot differs from the solution by " << maxError << std::endl;
+    errors++;
+  }
+  delete grid;
+#endif
+
+  std::cout << errors << " errors" << std::endl;
+  return errors > 0;
+ }
+ catch (Dune::Exception &e){
+  std::cerr << "Dune reported error: " << e << std::endl;
+  return 1;
+ }
+ catch (...){
+  std::cerr << "Unknown exception thrown!" << std::endl;
+  return 2;
+ }
+}
@@ -0,0 +1,126 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// global DUNE includes
+#include<dune/common/mpihelper.hh>
+#include<dune/common/exceptions.hh>
+#include<dune/common/fvector.hh>
+
+/* include grid IO */
+#include <dune/grid/io/file/gmshreader.hh>
+#include <dune/grid/utility/gridtype.hh>
+
+// global typedefs
+typedef double Real;
+
+#include <dune/ipbs/ipbs.hh>
+#include <dune/ipbs/loadbalance.hh>
+
+typedef Dune::FieldVector<double,2> Point;
+
+// ------------------------------------------------------------------------
+/// Split the points onto nproc processes and check the groups
+// ------------------------------------------------------------------------
+/*!
+   Every group has to get a point, and its weight may differ from the
+   average by at most one heaviest point per bisection level.
+*/
+int check_split(const std::vector<Point>& points, const std::vector<double>& weights, int nproc)
+{
+  std::vector<int> elements(points.size()), targets(points.size(), -1);
+  for (size_t i = 0; i < points.size(); i++)
+    elements[i] = i;
+  weighted_bisection<2>(points, weights, elements.begin(), elements.end(), 0, nproc, targets);
+
+  int errors = 0;
+  std::vector<int> count(nproc, 0), seen(points.size(), 0);
+  std::vector<double> load(nproc, 0.);
+  double total = 0, heaviest = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    seen[elements[i]]++;
+    total += weights[i];
+    heaviest = std::max(heaviest, weights[i]);
+    if (targets[i] < 0 || targets[i] >= nproc) {
+      std::cerr << "point " << i << " went to process " << targets[i] << std::endl;
+      return errors + 1;
+    }
+    count[targets[i]]++;
+    load[targets[i]] += weights[i];
+  }
+  for (size_t i = 0; i < points.size(); i++)
+    if (seen[i] != 1) {
+      std::cerr << "elements are no permutation of the points" << std::endl;
+      errors++;
+      break;
+    }
+  int levels = 0;
+  while ((1 << levels) < nproc)
+    levels++;
+  for (int p = 0; p < nproc; p++) {
+    if (count[p] == 0) {
+      std::cerr << "process " << p << " of " << nproc << " got no point" << std::endl;
+      errors++;
+    }
+    if (points.size() >= 10 * size_t(nproc)
+        && std::abs(load[p] - total / nproc) > levels * heaviest) {
+      std::cerr << "process " << p << " of " << nproc << " got the weight " << load[p]
+        << " instead of " << total / nproc << std::endl;
+      errors++;
+    }
+  }
+  return errors;
+}
+
+//===============================================================
+// Main programm
+//===============================================================
+int main(int argc, char** argv)
+{
+ try{
+  Dune::MPIHelper::instance(argc, argv);
+  int errors = 0;
+
+  // a lattice whose weight is concentrated at a particle in the corner, as
+  // the kernel evaluations close to its surface
+  std::vector<Point> points;
+  std::vector<double> weights;
+  for (int i = 0; i < 40; i++)
+    for (int j = 0; j < 20; j++) {
+      Point x;
+      x[0] = i + 0.1 * std::rand() / (double) RAND_MAX;
+      x[1] = 0.5 * j;
+      points.push_back(x);
+      weights.push_back(1. + 50. * std::exp(-0.2 * x.two_norm()));
+    }
+  for (int nproc = 1; nproc <= 8; nproc++)
+    errors += check_split(points, weights, nproc);
+
+  // one point outweighs all others, the other process still gets points
+  std::vector<Point> few(points.begin(), points.begin() + 10);
+  std::vector<double> heavy(10, 1.);
+  heavy[0] = 1000.;
+  errors += check_split(few, heavy, 2);
+  heavy[0] = 1.;
+  heavy[9] = 1000.;
+  errors += check_split(few, heavy, 2);
+  // as many points as processes
+  errors += check_split(few, heavy, 10);
+
+  std::cout << errors << " errors" << std::endl;
+  return errors > 0;
+ }
+ catch (Dune::Exception &e){
+  std::cerr << "Dune reported error: " << e << std::endl;
+  return 1;
+ }
+ catch (...){
+  std::cerr << "Unknown exception thrown!" << std::endl;
+  return 2;
+ }
+}
@@ -0,0 +1,205 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// global DUNE includes
+#include<dune/common/mpihelper.hh>
+#include<dune/common/exceptions.hh>
+
+/* include grid IO */
+#include <dune/grid/io/file/gmshreader.hh>
+#include <dune/grid/utility/gridtype.hh>
+
+// global typedefs
+typedef double Real;
+
+#include <dune/ipbs/ipbs.hh>
+#include <dune/ipbs/context.hh>
+#include <dune/ipbs/ipbs_Pk.hh>
+
+#if GRIDDIM == 2
+// ------------------------------------------------------------------------
+/// Compare the matrix-free Jacobian and Newton solver with the assembled ones
+// ------------------------------------------------------------------------
+/*!
+   The product and the diagonal are compared with the Jacobian assembled
+   by the grid operator at a perturbed iterate. Both Newton solvers have to
+   reach the same solution.
+*/
+template<class GridType>
+int check_matrixfree(IpbsContext& context, GridType& grid,
+    const std::vector<int>& elementIndexToEntity, const std::vector<int>& boundaryIndexToEntity)
+{
+  typedef typename GridType::LeafGridView GV;
+  const GV& gv = grid.leafView();
+  typedef typename GV::Grid::ctype ctype;
+
+  typedef Regions<GV,double,std::vector<int> > M;
+  M m(gv, elementIndexToEntity);
+  typedef BCTypeParam<std::vector<int> > B;
+  B b(context, boundaryIndexToEntity);
+  typedef BCExtension<GV,double,std::vector<int> > G;
+  G g(context, gv, boundaryIndexToEntity);
+
+  typedef Dune::PDELab::Pk2DLocalFiniteElementMap<GV, ctype, Real, 2> FEM;
+  FEM fem(gv);
+  typedef Dune::PDELab::ISTLVectorBackend<1> VBE;
+#if HAVE_MPI
+  typedef Dune::PDELab::NonoverlappingConformingDirichletConstraints CON;
+#else
+  typedef Dune::PDELab::ConformingDirichletConstraints CON;
+#endif
+  CON con;
+  typedef Dune::PDELab::GridFunctionSpace<GV,FEM,CON,VBE> GFS;
+  GFS gfs(gv,fem,con);
+#if HAVE_MPI
+  con.compute_ghosts(gfs);
+#endif
+
+  typedef typename Dune::PDELab::BackendVectorSelector<GFS,Real>::Type U;
+  typedef typename U::BaseT V;
+  typedef typename GFS::template ConstraintsContainer<Real>::Type CC;
+  CC cc;
+  Dune::PDELab::constraints(b,gfs,cc);
+  U u(gfs,0.0);
+  Dune::PDELab::interpolate(g,gfs,u);
+  Dune::PDELab::set_nonconstrained_dofs(cc,0.0,u);
+
+  typedef Ipbsolver<GV, GFS> Ipbs;
+  Ipbs ipbs(context, gv, gfs, boundaryIndexToEntity, 1);
+  typedef BoundaryFlux<GV,double,std::vector<int>, Ipbs > J;
+  J j(context, gv, boundaryIndexToEntity, ipbs);
+
+  typedef PBLocalOperator<M,B,J> LOP;
+  LOP lop(context,m,b,j,3);
+  typedef Dune::PDELab::ISTLBCRSMatrixBackend<1,1> MBE;
+#if HAVE_MPI
+  typedef Dune::PDELab::GridOperator<GFS,GFS,LOP,MBE,
+                                    Real,Real,Real,CC,CC,true> GO;
+#else
+  typedef Dune::PDELab::GridOperator<GFS,GFS,LOP,MBE,
+                                    Real,Real,Real,CC,CC> GO;
+#endif
+  GO go(gfs,cc,gfs,cc,lop);
+
+  typedef MatrixFreeJacobian<GV,GFS,LOP,CC,U> MFJ;
+  MFJ jacobian(gv,gfs,lop,cc);
+
+  // a perturbed iterate with the Dirichlet values, and a direction vanishing
+  // on them like the Newton corrections
+  U x(u), z(gfs,0.0);
+  for (size_t i = 0; i < x.base().N(); i++)
+    if (!jacobian.isConstrained(i)) {
+      x.base()[i] += 0.1 * std::rand() / (double) RAND_MAX;
+      z.base()[i] = std::rand() / (double) RAND_MAX - 0.5;
+    }
+
+  int errors = 0;
+  typedef typename GO::Traits::Jacobian Matrix;
+  Matrix A(go);
+  A = 0.0;
+  go.jacobian(x,A);
+  jacobian.setLinearizationPoint(x);
+
+  V assembled(z.base()), matrixfree(z.base()), diagonal(z.base());
+  A.base().mv(z.base(), assembled);
+  jacobian.apply(z.base(), matrixfree);
+  matrixfree -= assembled;
+  if (matrixfree.infinity_norm() > 1e-10 * assembled.infinity_norm()) {
+    std::cerr << "matrix-free product differs by " << matrixfree.infinity_norm() << std::endl;
+    errors++;
+  }
+  jacobian.diagonal(diagonal);
+  for (size_t i = 0; i < diagonal.N(); i++)
+    if (std::abs(diagonal[i][0] - A.base()[i][i][0][0]) > 1e-10 * std::abs(A.base()[i][i][0][0])) {
+      std::cerr << "diagonal " << i << " is " << diagonal[i][0] << " instead of "
+        << A.base()[i][i][0][0] << std::endl;
+      errors++;
+      break;
+    }
+
+  // both Newton solvers from the same start
+  U reference(u);
+  typedef Dune::PDELab::ISTLBackend_SEQ_BCGS_SSOR LS;
+  LS ls(5000, false);
+  typedef Dune::PDELab::Newton<GO,LS,U> Newton;
+  Newton newton(go,reference,ls);
+  newton.setReduction(1e-10);
+  newton.setMinLinearReduction(1e-9);
+  newton.setLineSearchStrategy(newton.hackbuschReuskenAcceptBest);
+  newton.apply();
+
+  LOP lop1(context,m,b,j,2);
+  typedef P1CoarsePreconditioner<GV,GFS,B,LOP,MFJ,U> Preconditioner;
+  Preconditioner preconditioner(gv,gfs,b,lop1,jacobian);
+  typedef MatrixFreeNewton<GO,CC,MFJ,Preconditioner,U> MatrixFreeNewtonType;
+  MatrixFreeNewtonType matrixFreeNewton(go,cc,jacobian,preconditioner,u);
+  matrixFreeNewton.setReduction(1e-10);
+  matrixFreeNewton.setMinLinearReduction(1e-9);
+  matrixFreeNewton.apply();
+
+  V difference(u.base());
+  difference -= reference.base();
+  std::cout << "solutions differ by " << difference.infinity_norm() << std::endl;
+  if (difference.infinity_norm() > 1e-6 * reference.base().infinity_norm()) {
+    std::cerr << "matrix-free Newton solution differs by " << difference.infinity_norm()
+      << std::endl;
+    errors++;
+  }
+  return errors;
+}
+#endif
+
+//===============================================================
+// Main programm
+//===============================================================
+int main(int argc, char** argv)
+{
+ try{
+  Dune::MPIHelper& helper = Dune::MPIHelper::instance(argc, argv);
+  // the matrix-free Jacobian runs on one process, the mesh is 2d
+#if GRIDDIM != 2
+  return 77;
+#else
+  if (helper.size() > 1)
+    return 77;
+
+  IpbsContext context;
+  SysParams& sysParams = context.sysParams;
+  sysParams.set_symmetry(2);
+  sysParams.set_bjerrum(0.71);
+  sysParams.set_lambda(1);
+  sysParams.set_salt(0);
+  sysParams.set_npart(1);
+  context.add_boundary();
+  context.boundary[0]->set_charge_density(1e-3);
+  context.boundary[0]->set_epsilons(1., 1.);
+
+  std::vector<int> boundaryIndexToEntity;
+  std::vector<int> elementIndexToEntity;
+  typedef Dune::GridSelector::GridType GridType;
+  Dune::GridFactory<GridType> factory;
+  Dune::GmshReader<GridType> gmshreader;
+  gmshreader.read(factory, "sphere2d.msh", boundaryIndexToEntity, elementIndexToEntity, true, true);
+  std::auto_ptr<GridType> grid(factory.createGrid());
+
+  const int errors = check_matrixfree(context, *grid, elementIndexToEntity, boundaryIndexToEntity);
+  std::cout << errors << " errors" << std::endl;
+  return errors > 0;
+#endif
+ }
+ catch (Dune::Exception &e){
+  std::cerr << "Dune reported error: " << e << std::endl;
+  return 1;
+ }
+ catch (...){
+  std::cerr << "Unknown exception thrown!" << std::endl;
+  return 2;
+ }
+}
@@ -0,0 +1,181 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+// global DUNE includes
+#include<dune/common/mpihelper.hh>
+#include<dune/common/exceptions.hh>
+#include<dune/common/fvector.hh>
+
+/* include grid IO */
+#include <dune/grid/io/file/gmshreader.hh>
+#include <dune/grid/utility/gridtype.hh>
+
+#include <dune/ipbs/meshcache.hh>
+
+typedef Dune::GridSelector::GridType GridType;
+static const int dim = GridType::dimension;
+
+// ------------------------------------------------------------------------
+/// What has to agree between the grid read from gmsh and from the cache
+// ------------------------------------------------------------------------
+struct GridSummary
+{
+  int vertices, elements;
+  /// Number of elements and sum of their centers per physical group
+  std::map<int, std::pair<int, Dune::FieldVector<double,dim> > > elementGroups;
+  /// Number of boundary intersections and their total volume per physical group
+  std::map<int, std::pair<int, double> > boundaryGroups;
+
+  GridSummary(GridType& grid, const std::vector<int>& elementIndexToEntity,
+              const std::vector<int>& boundaryIndexToEntity, Dune::GridFactory<GridType>& factory)
+  {
+    typedef GridType::LeafGridView GV;
+    const GV& gv = grid.leafView();
+    vertices = gv.size(dim);
+    elements = gv.size(0);
+    for (GV::Codim<0>::Iterator it = gv.begin<0>(); it != gv.end<0>(); ++it)
+    {
+      std::pair<int, Dune::FieldVector<double,dim> >& group =
+        elementGroups[elementIndexToEntity[factory.insertionIndex(*it)]];
+      if (group.first++ == 0)
+        group.second = 0.;
+      group.second += it->geometry().center();
+      for (GV::IntersectionIterator is = gv.ibegin(*it); is != gv.iend(*it); ++is)
+        if (is->boundary()) {
+          std::pair<int, double>& boundary =
+            boundaryGroups[boundaryIndexToEntity[is->boundarySegmentIndex()]];
+          boundary.first++;
+          boundary.second += is->geometry().volume();
+        }
+    }
+  }
+
+  int compare(const GridSummary& cached) const
+  {
+    int errors = 0;
+    if (vertices != cached.vertices || elements != cached.elements) {
+      std::cerr << "cached grid has " << cached.vertices << " vertices and " << cached.elements
+        << " elements instead of " << vertices << " and " << elements << std::endl;
+      errors++;
+    }
+    if (elementGroups.size() != cached.elementGroups.size()
+        || boundaryGroups.size() != cached.boundaryGroups.size()) {
+      std::cerr << "cached grid has other physical groups" << std::endl;
+      return errors + 1;
+    }
+    typedef std::map<int, std::pair<int, Dune::FieldVector<double,dim> > >::const_iterator
+      ElementIterator;
+    for (ElementIterator e = elementGroups.begin(), c = cached.elementGroups.begin();
+         e != elementGroups.end(); ++e, ++c) {
+      Dune::FieldVector<double,dim> diff = e->second.second;
+      diff -= c->second.second;
+      if (e->first != c->first || e->second.first != c->second.first
+          || diff.two_norm() > 1e-8 * (1. + e->second.second.two_norm())) {
+        std::cerr << "elements of physical group " << e->first << " differ" << std::endl;
+        errors++;
+      }
+    }
+    typedef std::map<int, std::pair<int, double> >::const_iterator BoundaryIterator;
+    for (BoundaryIterator b = boundaryGroups.begin(), c = cached.boundaryGroups.begin();
+         b != boundaryGroups.end(); ++b, ++c)
+      if (b->first != c->first || b->second.first != c->second.first
+          || std::abs(b->second.second - c->second.second) > 1e-8 * b->second.second) {
+        std::cerr << "boundary segments of physical group " << b->first << " differ" << std::endl;
+        errors++;
+      }
+    return errors;
+  }
+};
+
+/// Copy of a file with n bytes dropped from the end and text appended
+void copy_file(const std::string& from, const std::string& to, size_t drop,
+               const std::string& append)
+{
+  std::ifstream in(from.c_str(), std::ios::binary);
+  std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  std::ofstream out(to.c_str(), std::ios::binary);
+  out << content.substr(0, content.size() - drop) << append;
+}
+
+//===============================================================
+// Main programm
+//===============================================================
+int main(int argc, char** argv)
+{
+ try{
+  Dune::MPIHelper& helper = Dune::MPIHelper::instance(argc, argv);
+  // sphere2d.msh is read on one process, the result 77 skips the test
+  if (helper.size() > 1 || GRIDDIM != 2) {
+    std::cerr << "test_meshcache needs a sequential run on a 2d grid" << std::endl;
+    return 77;
+  }
+  int errors = 0;
+  const std::string meshfile = "sphere2d.msh";
+  const std::string cachefile = mesh_cache_filename(".", meshfile);
+  std::remove(cachefile.c_str());
+
+  // parse the gmsh file and record it
+  std::vector<int> elementIndexToEntity, boundaryIndexToEntity;
+  RecordingGridFactory<GridType> recorder;
+  recorder.record();
+  Dune::GmshReader<GridType> gmshreader;
+  gmshreader.read(recorder, meshfile, boundaryIndexToEntity, elementIndexToEntity, true, true);
+  if (!recorder.write(cachefile, elementIndexToEntity, boundaryIndexToEntity)) {
+    std::cerr << "could not write " << cachefile << std::endl;
+    return 1;
+  }
+  GridType* grid = recorder.createGrid();
+  const GridSummary parsed(*grid, elementIndexToEntity, boundaryIndexToEntity, recorder);
+  delete grid;
+
+  // build the grid from the cache only
+  std::vector<int> cachedElements, cachedBoundaries;
+  Dune::GridFactory<GridType> factory;
+  if (!read_mesh_cache(cachefile, factory, cachedElements, cachedBoundaries)) {
+    std::cerr << "could not read " << cachefile << std::endl;
+    return 1;
+  }
+  if (cachedElements != elementIndexToEntity || cachedBoundaries != boundaryIndexToEntity) {
+    std::cerr << "cached physical groups differ" << std::endl;
+    errors++;
+  }
+  grid = factory.createGrid();
+  errors += parsed.compare(GridSummary(*grid, cachedElements, cachedBoundaries, factory));
+  delete grid;
+
+  // an edited mesh gets another cache, a truncated cache is not used
+  copy_file(meshfile, "test_meshcache.msh", 0, "\n");
+  if (mesh_cache_filename(".", "test_meshcache.msh") == cachefile) {
+    std::cerr << "edited mesh maps to the same cache" << std::endl;
+    errors++;
+  }
+  copy_file(cachefile, "test_meshcache.cache", 4, "");
+  Dune::GridFactory<GridType> truncated;
+  if (read_mesh_cache("test_meshcache.cache", truncated, cachedElements, cachedBoundaries)) {
+    std::cerr << "truncated cache was read" << std::endl;
+    errors++;
+  }
+  std::remove(cachefile.c_str());
+
+  std::cout << errors << " errors" << std::endl;
+  return errors > 0;
+ }
+ catch (Dune::Exception &e){
+  std::cerr << "Dune reported error: " << e << std::endl;
+  return 1;
+ }
+ catch (...){
+  std::cerr << "Unknown exception thrown!" << std::endl;
+  return 2;
+ }
+}
@@ -16,14 +16,9 @@
 typedef double Real;
 
 #include <dune/ipbs/ipbs.hh>
-#include <dune/ipbs/sysparams.hh>
-#include <dune/ipbs/boundary.hh>
+#include <dune/ipbs/context.hh>
 #include <dune/ipbs/ipbs_Pk.hh>
 
-// global access to particles and parameters
-std::vector<Boundary*> boundary;
-SysParams sysParams;
-
 //===============================================================
 // Main programm
 //===============================================================
@@ -43,6 +38,10 @@ int main(int argc, char** argv)
     }
   }
  
+  IpbsContext context;
+  SysParams& sysParams = context.sysParams;
+  std::vector<Boundary*>& boundary = context.boundary;
+
     // set the symmetry of the system
   sysParams.set_symmetry(2);
   
@@ -62,7 +61,7 @@ int main(int argc, char** argv)
   int n_particle = 1;
   sysParams.set_npart(n_particle);
   for (int i = 0; i < n_particle; i++)
-    boundary.push_back(new Boundary());
+    context.add_boundary();
 
   for(int i = 0; i < n_particle; i++)
   {
@@ -119,7 +118,8 @@ int main(int argc, char** argv)
   std::cout << "Grid has been modified by load balancing: " << grid->loadBalance() << std::endl;
 
  // Call problem driver
- ipbs_Pk<GridType, 1>(grid, elementIndexToEntity, boundaryIndexToEntity, helper);
+ DegreeSequence<GridType, std::vector<int>, 1, 1>::start(context, grid, elementIndexToEntity,
+     boundaryIndexToEntity);
  
  double dhsurfacepot = 4.*sysParams.pi*sysParams.get_bjerrum()*(10./(1.+10.*1.));
  for (int i = 0; i < sysParams.get_npart(); i++)
@@ -0,0 +1,167 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// global DUNE includes
+#include<dune/common/mpihelper.hh>
+#include<dune/common/exceptions.hh>
+
+#include <dune/ipbs/sweep.hh>
+
+static const char* lambdas[] = { "1", "2", "4" };
+static const char* charges[] = { "-0.01", "-0.02" };
+
+/// Write a base configuration and a sweep over 3 x 2 of its values
+void write_sweep()
+{
+  std::ofstream base("test_sweep_base.cfg");
+  base << "[system]" << std::endl
+       << "lambda = 1" << std::endl
+       << "[boundary_0]" << std::endl
+       << "charge_density = 0.001" << std::endl;
+  std::ofstream sweep("test_sweep.sweep");
+  sweep << "[sweep]" << std::endl
+        << "config = test_sweep_base.cfg" << std::endl
+        << "directory = test_sweep" << std::endl
+        << "[grid]" << std::endl
+        << "system.lambda = 1 2 4" << std::endl
+        << "boundary_0.charge_density = -0.01 -0.02" << std::endl;
+}
+
+/// Summary as written by a run, with the iterations as the only column
+void write_summary(size_t i, int iterations)
+{
+  std::ostringstream name;
+  name << "test_sweep/point_" << i << "/ipbs_summary.dat";
+  std::ofstream summary(name.str().c_str());
+  summary << "# iterations" << std::endl << iterations << std::endl;
+}
+
+// the points are all combinations, the first key varies slowest
+int check_points(const ParameterSweep& sweep)
+{
+  int errors = 0;
+  if (sweep.size() != 6) {
+    std::cerr << "sweep has " << sweep.size() << " points instead of 6" << std::endl;
+    return 1;
+  }
+  std::set<std::vector<std::string> > seen;
+  for (size_t i = 0; i < sweep.size(); i++) {
+    const std::vector<std::string> p = sweep.point(i);
+    if (p.size() != 2 || p[0] != lambdas[i / 2] || p[1] != charges[i % 2]) {
+      std::cerr << "point " << i << " has the wrong values" << std::endl;
+      errors++;
+    }
+    seen.insert(p);
+  }
+  if (seen.size() != sweep.size()) {
+    std::cerr << "points are not unique" << std::endl;
+    errors++;
+  }
+  return errors;
+}
+
+// a point is done with its summary, and only for the parameters it was solved for
+int check_done(const ParameterSweep& sweep)
+{
+  int errors = 0;
+  for (size_t i = 0; i < sweep.size(); i++)
+    sweep.prepare(i);
+  write_summary(1, 7);
+  write_summary(4, 9);
+  for (size_t i = 0; i < sweep.size(); i++)
+    if (sweep.done(i) != (i == 1 || i == 4)) {
+      std::cerr << "point " << i << " is " << (sweep.done(i) ? "" : "not ") << "done" << std::endl;
+      errors++;
+    }
+  // the configuration carries the values of the point
+  Dune::ParameterTree config;
+  Dune::ParameterTreeParser::readINITree(sweep.config(3), config);
+  if (config.get<std::string>("system.lambda") != "2"
+      || config.get<std::string>("boundary_0.charge_density") != "-0.02"
+      || config.get<std::string>("output.name") != "test_sweep/point_3/ipbs") {
+    std::cerr << "configuration of point 3 differs" << std::endl;
+    errors++;
+  }
+  // a summary of other parameters does not count
+  std::ofstream other("test_sweep/point_4/parameters");
+  other << "system.lambda=8" << std::endl;
+  other.close();
+  if (sweep.done(4)) {
+    std::cerr << "point 4 is done for other parameters" << std::endl;
+    errors++;
+  }
+  return errors;
+}
+
+// results.dat has the header, a row per solved point and a comment per missing one
+int check_results(const ParameterSweep& sweep)
+{
+  write_summary(4, 9);
+  std::ofstream parameters("test_sweep/point_4/parameters");
+  parameters << "system.lambda=4 boundary_0.charge_density=-0.01" << std::endl;
+  parameters.close();
+  sweep.aggregate();
+  std::vector<std::string> expected;
+  expected.push_back("# point 0 (system.lambda=1 boundary_0.charge_density=-0.01) not solved");
+  expected.push_back("# point system.lambda boundary_0.charge_density iterations");
+  expected.push_back("1 1 -0.02 7");
+  expected.push_back("# point 2 (system.lambda=2 boundary_0.charge_density=-0.01) not solved");
+  expected.push_back("# point 3 (system.lambda=2 boundary_0.charge_density=-0.02) not solved");
+  expected.push_back("4 4 -0.01 9");
+  expected.push_back("# point 5 (system.lambda=4 boundary_0.charge_density=-0.02) not solved");
+  std::ifstream results("test_sweep/results.dat");
+  std::string line;
+  int errors = 0;
+  for (size_t k = 0; k < expected.size(); k++)
+    if (!std::getline(results, line) || line != expected[k]) {
+      std::cerr << "results.dat line " << k << " is \"" << line << "\", expected \""
+        << expected[k] << "\"" << std::endl;
+      errors++;
+    }
+  if (std::getline(results, line)) {
+    std::cerr << "results.dat has more lines" << std::endl;
+    errors++;
+  }
+  return errors;
+}
+
+//===============================================================
+// Main programm
+//===============================================================
+int main(int argc, char** argv)
+{
+ try{
+  Dune::MPIHelper& helper = Dune::MPIHelper::instance(argc, argv);
+  // the sweep directory is written by one process, the result 77 skips the test
+  if (helper.size() > 1) {
+    std::cerr << "test_sweep needs a sequential run" << std::endl;
+    return 77;
+  }
+  write_sweep();
+  const ParameterSweep sweep("test_sweep.sweep");
+  int errors = check_points(sweep);
+  if (errors == 0) {
+    errors += check_done(sweep);
+    errors += check_results(sweep);
+  }
+
+  std::cout << errors << " errors" << std::endl;
+  return errors > 0;
+ }
+ catch (Dune::Exception &e){
+  std::cerr << "Dune reported error: " << e << std::endl;
+  return 1;
+ }
+ catch (...){
+  std::cerr << "Unknown exception thrown!" << std::endl;
+  return 2;
+ }
+}
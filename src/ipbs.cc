@@ -25,12 +25,27 @@
 #ifndef LINEARSOLVER
 #define LINEARSOLVER BCGS_SSORk
 #endif
+// build with -DMORPHING=1 for distance sweeps on a deformed mesh
+#ifndef MORPHING
+#define MORPHING 0
+#endif
+// build with -DLOCKSTEP=K to solve K ensemble members together on blocked vectors
+#ifndef LOCKSTEP
+#define LOCKSTEP 0
+#endif
+// build with -DMATRIXFREE=1 to apply the Jacobian without assembling it (one process)
+#ifndef MATRIXFREE
+#define MATRIXFREE 0
+#endif
 
 // std includes
 //#include<math.h>
 //#include<iostream>
 //#include<vector>
 //#include<string>
+#include<algorithm>
+#include<cstdlib>
+#include<exception>
 
 // global DUNE includes
 #include<dune/common/mpihelper.hh>
@@ -63,14 +78,194 @@
 // global typedefs
 typedef double Real;
 
-#include "dune/ipbs/sysparams.hh"
-#include "dune/ipbs/boundary.hh"
+#include "dune/ipbs/context.hh"
 #include "dune/ipbs/parser.hh"
 #include "dune/ipbs/ipbs_Pk.hh"
+#include "dune/ipbs/processgroup.hh"
+#include "dune/ipbs/sweep.hh"
+
+// ------------------------------------------------------------------------
+/// Stop all processes after a failure the others may not know of
+// ------------------------------------------------------------------------
+/*!
+   Processes that did not fail may wait in a collective operation forever,
+   and MPI_Finalize would wait for them.
+*/
+void ipbs_abort()
+{
+#if HAVE_MPI
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  if (size > 1)
+    MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+}
+
+// ------------------------------------------------------------------------
+/// Solve the problem of a configuration file on a group of processes
+// ------------------------------------------------------------------------
+/*!
+   A configuration that can not be read or is not supported throws
+   GroupFailure on all processes of the group.
+
+   \param serve answer parameter updates after the first solve, see service.hh
+*/
+void ipbs_run(const std::string& config_file, const ProcessGroup& group, bool serve = false)
+{
+  // Parse configuration file.
+  IpbsContext context;
+  std::string error;
+  try {
+    parser(config_file, context);
+    context.sysParams.set_service(serve);
+    if (serve && (context.sysParams.get_lockstep() || context.sysParams.get_ensemble()
+          || !context.sysParams.get_reducedTraining().empty()
+          || !context.sysParams.get_superposition().empty()))
+      DUNE_THROW(Dune::NotImplemented, "The service solves single problems only");
+#if !LOCKSTEP
+    if (context.sysParams.get_lockstep())
+      DUNE_THROW(Dune::NotImplemented, "Lock-step ensembles are solved by ipbs_lockstep");
+#endif
+  }
+  catch (Dune::Exception &e) {
+    error = e.what();
+  }
+  catch (std::exception &e) {
+    error = e.what();
+  }
+  // the file may be missing on some processes only
+  if (!group.agree(error.empty()))
+    DUNE_THROW(GroupFailure, "Could not set up " << config_file
+        << (error.empty() ? " on all processes" : ": " + error));
+
+  // Read the mesh and call problem driver
+  typedef Dune::GridSelector::GridType GridType;
+#if LOCKSTEP
+  if (context.sysParams.get_lockstep())
+    ipbs_lockstep<GridType, PDEGREE, LOCKSTEP>(config_file, context, group);
+  else
+#endif
+  if (context.sysParams.get_ensemble())
+    ipbs_ensemble<GridType, PDEGREE>(config_file, context, group);
+  else if (!context.sysParams.get_reducedTraining().empty())
+    ipbs_reduced<GridType, PDEGREE>(context, group);
+  else if (!context.sysParams.get_superposition().empty())
+    ipbs_superposition<GridType, PDEGREE>(context, group);
+  else
+    ipbs_solve<GridType, PDEGREE>(context, group);
+}
 
-// global access to particles
-std::vector<Boundary*> boundary;
-SysParams sysParams;
+// ------------------------------------------------------------------------
+/// Solve the configurations a group takes from the queue shared by all groups
+// ------------------------------------------------------------------------
+/*!
+   A configuration the group failed on together (GroupFailure) is reported
+   and skipped. Any other failure may have left the other processes of the
+   group waiting, so a group of several processes aborts the job.
+
+   \param sweep if given, configs[i] is the configuration of points[i] of
+                the sweep and its mesh is generated first
+*/
+void ipbs_work_queue(const ProcessGroup& group, int color, int ngroups,
+                     const std::vector<std::string>& configs,
+                     const ParameterSweep* sweep = 0, const std::vector<size_t>& points =
+                     std::vector<size_t>())
+{
+  ConfigQueue queue(group, configs.size(), color, ngroups);
+  const Dune::CollectiveCommunication<ProcessGroup::Communicator>
+    collective(group.getCommunicator());
+  for (size_t i = queue.next(); i < configs.size(); i = queue.next())
+  {
+    if (group.rank() == 0)
+      std::cout << "Group " << color << " solves " << configs[i] << std::endl;
+    if (sweep) {
+      int meshed = group.rank() == 0 ? sweep->mesh(points[i]) : 0;
+      collective.broadcast(&meshed, 1, 0);
+      if (!meshed)
+        continue;
+    }
+    try {
+      ipbs_run(configs[i], group);
+    }
+    catch (GroupFailure &e) {
+      std::cerr << "Group " << color << " failed on " << configs[i] << ": " << e << std::endl;
+    }
+    catch (Dune::Exception &e) {
+      std::cerr << "Group " << color << " failed on " << configs[i] << ": " << e << std::endl;
+      if (group.size() > 1)
+        ipbs_abort();
+    }
+    catch (std::exception &e) {
+      std::cerr << "Group " << color << " failed on " << configs[i] << ": " << e.what() << std::endl;
+      if (group.size() > 1)
+        ipbs_abort();
+    }
+    catch (...) {
+      std::cerr << "Group " << color << " failed on " << configs[i] << ": unknown exception"
+                << std::endl;
+      if (group.size() > 1)
+        ipbs_abort();
+    }
+  }
+}
+
+/// Solve many configurations with groups of groupSize processes
+void ipbs_launch(Dune::MPIHelper& helper, int groupSize,
+                 const std::vector<std::string>& configs,
+                 const ParameterSweep* sweep = 0, const std::vector<size_t>& points =
+                 std::vector<size_t>())
+{
+  const int color = helper.rank() / groupSize;
+  const int ngroups = (helper.size() + groupSize - 1) / groupSize;
+  // fail once instead of on every configuration
+  typedef Dune::GridSelector::GridType GridType;
+  if (!GroupGridFactory<GridType>::supported(groupSize, ngroups == 1))
+    DUNE_THROW(Dune::NotImplemented, "The grid manager can not create grids in groups of "
+        << groupSize << " process(es), run with " << helper.size() << " process(es) per group"
+        << (SequentialGrid<GridType>::value ? " or one" : ""));
+  if (helper.rank() == 0)
+    std::cout << "Launching " << configs.size() << " configurations on " << ngroups
+              << " group(s) of " << groupSize << " process(es)" << std::endl;
+#if HAVE_MPI
+  MPI_Comm communicator;
+  MPI_Comm_split(MPI_COMM_WORLD, color, helper.rank(), &communicator);
+  ipbs_work_queue(ProcessGroup(communicator), color, ngroups, configs, sweep, points);
+  MPI_Comm_free(&communicator);
+#else
+  ipbs_work_queue(ProcessGroup(helper), color, ngroups, configs, sweep, points);
+#endif
+}
+
+// ------------------------------------------------------------------------
+/// Solve the open points of a parameter sweep and collect the results
+// ------------------------------------------------------------------------
+/*!
+   Points solved by an earlier run of the same sweep are skipped.
+*/
+void ipbs_sweep(Dune::MPIHelper& helper, const std::string& sweep_file)
+{
+  const ParameterSweep sweep(sweep_file);
+  std::vector<size_t> points;
+  std::vector<std::string> configs;
+  for (size_t i = 0; i < sweep.size(); i++)
+    if (!sweep.done(i)) {
+      points.push_back(i);
+      configs.push_back(sweep.config(i));
+    }
+  if (helper.rank() == 0) {
+    std::cout << "Sweep of " << sweep.size() << " points, " << sweep.size() - points.size()
+              << " of them done before" << std::endl;
+    for (size_t k = 0; k < points.size(); k++)
+      sweep.prepare(points[k]);
+  }
+  helper.getCollectiveCommunication().barrier();
+
+  ipbs_launch(helper, std::min(sweep.groupSize(), helper.size()), configs, &sweep, points);
+
+  helper.getCollectiveCommunication().barrier();
+  if (helper.rank() == 0)
+    sweep.aggregate();
+}
 
 //===============================================================
 // Main programm
@@ -92,87 +287,45 @@ int main(int argc, char** argv)
   }
   
   // check arguments
-  if (argc!=2)
+  const bool launch = argc > 1 && std::string(argv[1]) == "--launch";
+  const bool sweep = argc == 3 && std::string(argv[1]) == "--sweep";
+  const bool serve = argc == 3 && std::string(argv[1]) == "--serve";
+  int groupSize = 0;
+  if (launch && argc > 3)
+    groupSize = std::atoi(argv[2]);
+  if ((!launch && !sweep && !serve && argc!=2) || (launch && groupSize < 1))
   {
     if (helper.rank()==0)
     {
 	std::cout << "usage: ./ipbs <configuration file>" << std::endl;
-	return 1;
+	std::cout << "       ./ipbs --launch <processes per group> <configuration file> ..." << std::endl;
+	std::cout << "       ./ipbs --sweep <sweep file>" << std::endl;
+	std::cout << "       ./ipbs --serve <configuration file>" << std::endl;
     }
+    return 1;
   }
-  
-  // Parse configuration file.
-  std::string config_file(argv[1]);
-  parser(config_file);
 
-  
-//===============================================================
-// Setup problem
-//===============================================================
-  
-  
-  // <<<1>>> Setup the problem from mesh file
-  
-  // define vectors to store boundary and element mapping
-  typedef std::vector<int> PGMap;
-  PGMap boundaryIndexToEntity;
-  PGMap elementIndexToEntity;
-  
-  typedef Dune::GridSelector::GridType GridType;
-  Dune::GridFactory<GridType> factory;
-
-  if(helper.rank() == 0)
-  {
-    // read a gmsh file
-    Dune::GmshReader<GridType> gmshreader;
-    gmshreader.read(factory, sysParams.get_meshfile(), boundaryIndexToEntity, elementIndexToEntity, true, true);
-  }
-
-  // MPIHelper ensures that this works for the sequential case
-  Dune::CollectiveCommunication<Dune::MPIHelper::MPICommunicator> colCom(helper.getCommunicator());
- 
-  // Communicate boundary vector
-  int size = boundaryIndexToEntity.size();
-  colCom.broadcast (&size, 1, 0);
-  if (helper.rank() > 0)
-    boundaryIndexToEntity.reserve(size);
-  colCom.broadcast(&boundaryIndexToEntity[0],size,0);
-  
-  // create the grid
-  GridType* grid = factory.createGrid();
- 
-//  // Load balance the parallel grid
-  std::cout << "Grid has been modified by load balancing: " << grid->loadBalance() << std::endl;
-  
-  typedef GridType::LeafGridView myGV;
-
-  myGV gv = grid->leafView();
-
-  typedef typename myGV::Codim<0>::Iterator GVIT;
-  typedef typename myGV::IntersectionIterator IntersectionIterator;
-  
-  GVIT it = gv.begin<0>();
-
-//  for (; it != gv.end<0>(); ++it) {
-//    for (IntersectionIterator iit = gv.ibegin(*it); iit!=  gv.iend(*it); ++iit) 
-//      if (iit->boundary())
-//        std::cout << "" << iit->geometry().center() << " " << iit->boundarySegmentIndex() 
-////            << " " << factory.insertionIndex(*iit) 
-////            << " " << boundaryIndexToEntity[factory.insertionIndex(*iit)] 
-//            << " " << boundaryIndexToEntity[iit->boundarySegmentIndex()]  << std::endl ;
-//    }
-  
-
- // Call problem driver
- ipbs_Pk<GridType, PGMap, PDEGREE>(grid, elementIndexToEntity, boundaryIndexToEntity);
+  if (launch)
+    ipbs_launch(helper, groupSize, std::vector<std::string>(argv+3, argv+argc));
+  else if (sweep)
+    ipbs_sweep(helper, argv[2]);
+  else if (serve)
+    ipbs_run(argv[2], helper, true);
+  else
+    ipbs_run(argv[1], helper);
   }
   
  // done
+ catch (GroupFailure &e){
+  std::cerr << "Dune reported error: " << e << std::endl;
+ }
  catch (Dune::Exception &e){
   std::cerr << "Dune reported error: " << e << std::endl;
+  ipbs_abort();
  }
  catch (...){
   std::cerr << "Unknown exception thrown!" << std::endl;
+  ipbs_abort();
  }
 } 
 
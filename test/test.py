@@ -73,5 +73,23 @@ def test_2d_dh():
   p.plot(radial, reldev, '.')
   p.title("relative deviation")
 
+def test_sweep():
+  print "Testing a parameter sweep over the Debye length"
+  print "===================================================================\n"
+  if (checkmsh("sphere") != 0 and domesh("sphere") != 0):
+    print "GMSH failed"
+    return 1
+  success = runtest('$(pwd)/../src/ipbs --sweep test_sweep.cfg')
+  if success != 0:
+    print 'IPBS sweep failed'
+    return 1
+  results = numpy.loadtxt("sweep_lambda/results.dat", ndmin=2)
+  if results.shape[0] != 3 or list(results[:,1]) != [0.5, 1, 2]:
+    print 'results.dat does not have a row per point'
+    return 1
+  print 'IPBS sweep has succesfully finished'
+  return 0
+
 test_2d_dh()
+test_sweep()
 p.show()